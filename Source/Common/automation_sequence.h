@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cassert>
 #include <stdexcept>
 #include <vector>
 #include "containers/choc_NonAllocatingStableSort.h"
 #include "containers/choc_Span.h"
+#include "xen_frameindex.h"
 
 namespace xenakios
 {
@@ -31,51 +33,61 @@ struct AutomationEvent
 
 struct AutomationSequence
 {
+    // code changing the events directly must call mark_modified
     std::vector<AutomationEvent> events;
     bool is_sorted = false;
+    ModificationCounter modification_count;
     AutomationSequence() { events.reserve(128); }
+    void mark_modified() { modification_count.increment(); }
     void add_event(double timestamp, uint32_t id, double value)
     {
         events.emplace_back(timestamp, value, id, 0);
         is_sorted = false;
+        mark_modified();
     }
     void add_event_as_modulation(double timestamp, uint32_t id, double amount)
     {
         events.emplace_back(timestamp, amount, id, ISMODULATION);
         is_sorted = false;
+        mark_modified();
     }
     size_t size() const { return events.size(); }
-    void clear() { events.clear(); }
+    void clear()
+    {
+        events.clear();
+        mark_modified();
+    }
     void sort_events()
     {
         choc::sorting::stable_sort(events.begin(), events.end());
         is_sorted = true;
+        mark_modified();
     }
+    // Like ClapEventSequence::IteratorSampleTime, the frame index is built when the iterator is
+    // created and the iterator returns no events after the sequence has been modified.
     struct Iterator
     {
         /// Creates an iterator positioned at the start of the sequence.
-        Iterator(const AutomationSequence &s, double sr) : owner(s), sampleRate(sr)
+        Iterator(const AutomationSequence &s, double sr) : owner(s)
         {
             if (!owner.is_sorted)
                 throw std::runtime_error("AutomationSequence is not sorted");
+            frameIndex.build(owner.events.data(), owner.events.size(), sr,
+                             owner.modification_count.get(),
+                             [](const AutomationEvent &e) { return e.timestamp; });
         }
         Iterator(const Iterator &) = default;
         Iterator(Iterator &&) = default;
 
+        /// Whether the sequence is unchanged since creating the iterator
+        bool isValid() const { return frameIndex.isValidFor(owner.modification_count.get()); }
+
         /// Seeks the iterator to the given time
 
         void setTime(int64_t newTimeStamp)
         {
-            auto eventData = owner.events.data();
-
-            while (nextIndex != 0 &&
-                   eventData[nextIndex - 1].timestamp * sampleRate >= newTimeStamp)
-                --nextIndex;
-
-            while (nextIndex < owner.events.size() &&
-                   eventData[nextIndex].timestamp * sampleRate < newTimeStamp)
-                ++nextIndex;
-
+            if (isValid())
+                nextIndex = frameIndex.findFirstAtOrAfter(newTimeStamp, nextIndex);
             currentTime = newTimeStamp;
         }
 
@@ -90,24 +102,20 @@ struct AutomationSequence
         {
             auto start = nextIndex;
             auto eventData = owner.events.data();
-            auto end = start;
-            auto total = owner.events.size();
             auto endTime = currentTime + duration;
             currentTime = endTime;
-
-            while (end < total && eventData[end].timestamp * sampleRate < endTime)
-                ++end;
-
-            nextIndex = end;
-
-            return {eventData + start, eventData + end};
+            assert(isValid() && "sequence modified after creating its iterator");
+            if (!isValid())
+                return {eventData, eventData};
+            nextIndex = frameIndex.findFirstAtOrAfter(endTime, start);
+            return {eventData + start, eventData + nextIndex};
         }
 
       private:
         const AutomationSequence &owner;
         int64_t currentTime = 0;
         size_t nextIndex = 0;
-        double sampleRate = 0.0;
+        SampleFrameIndex frameIndex;
     };
 };
 } // namespace xenakios
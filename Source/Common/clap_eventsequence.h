@@ -1,15 +1,24 @@
 #pragma once
 
 #include "../Common/xap_utils.h"
+#include "../Common/xen_frameindex.h"
 #include "clap/events.h"
 #include "containers/choc_Span.h"
 #include "containers/choc_Value.h"
 #include "containers/choc_NonAllocatingStableSort.h"
 #include "memory/choc_xxHash.h"
 #include "text/choc_JSON.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class ClapEventSequence
 {
@@ -44,10 +53,57 @@ class ClapEventSequence
         clap_multi_event event;
         bool operator<(const Event &other) { return timestamp < other.timestamp; }
     };
+    // code changing the events directly must call markModified
     std::vector<Event> m_evlist;
     ClapEventSequence() { m_evlist.reserve(4096); }
-    void sortEvents() { choc::sorting::stable_sort(m_evlist.begin(), m_evlist.end()); }
-    void clearEvents() { m_evlist.clear(); }
+    // counts the changes of the events, so the sample time iterators can tell that their frame
+    // index no longer matches the events
+    uint64_t getModificationCount() const { return m_modificationCount.get(); }
+    void markModified() { m_modificationCount.increment(); }
+    void pushEvent(const Event &e)
+    {
+        m_evlist.push_back(e);
+        markModified();
+    }
+    static bool eventTimeLess(const Event &a, const Event &b) { return a.timestamp < b.timestamp; }
+    // sequences built in time order, or kept sorted with mergeAppendedEvents, are only checked
+    void sortEvents()
+    {
+        if (!std::is_sorted(m_evlist.begin(), m_evlist.end(), eventTimeLess))
+        {
+            choc::sorting::stable_sort(m_evlist.begin(), m_evlist.end());
+            markModified();
+        }
+    }
+    // reserves room for numEvents more events, growing geometrically for repeated bulk adds
+    void reserveAdditional(size_t numEvents)
+    {
+        size_t needed = m_evlist.size() + numEvents;
+        if (needed > m_evlist.capacity())
+            m_evlist.reserve(std::max(needed, m_evlist.capacity() * 2));
+    }
+    // Puts the events appended from index firstNew onwards into time order among the earlier
+    // events, when those are sorted. The order is the same sortEvents would give, but only the
+    // new events are sorted (if they aren't in order already) and then merged in.
+    void mergeAppendedEvents(size_t firstNew)
+    {
+        if (firstNew >= m_evlist.size())
+            return;
+        markModified();
+        auto newbegin = m_evlist.begin() + firstNew;
+        if (!std::is_sorted(newbegin, m_evlist.end(), eventTimeLess))
+            choc::sorting::stable_sort(newbegin, m_evlist.end());
+        if (firstNew == 0 || !eventTimeLess(*newbegin, *(newbegin - 1)))
+            return;
+        if (!std::is_sorted(m_evlist.begin(), newbegin, eventTimeLess))
+            return;
+        std::inplace_merge(m_evlist.begin(), newbegin, m_evlist.end(), eventTimeLess);
+    }
+    void clearEvents()
+    {
+        m_evlist.clear();
+        markModified();
+    }
     size_t getNumEvents() const { return m_evlist.size(); }
     // should be fairly accurate, despite the name of the method
     size_t getApproxSizeInBytes() const { return m_evlist.capacity() * sizeof(Event); }
@@ -55,34 +111,34 @@ class ClapEventSequence
     {
         auto ev =
             xenakios::make_event_note(0, CLAP_EVENT_NOTE_ON, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addNoteOff(double time, int port, int channel, int key, double velo, int note_id)
     {
         auto ev =
             xenakios::make_event_note(0, CLAP_EVENT_NOTE_OFF, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addNoteChoke(double time, int port, int channel, int key, double velo, int note_id)
     {
         auto ev =
             xenakios::make_event_note(0, CLAP_EVENT_NOTE_CHOKE, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addNote(double time, double duration, int port, int channel, int key, int note_id,
                  double velo, double retune)
     {
         auto ev =
             xenakios::make_event_note(0, CLAP_EVENT_NOTE_ON, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
         if (std::abs(retune) >= 0.001)
         {
             auto exprev = xenakios::make_event_note_expression(0, CLAP_NOTE_EXPRESSION_TUNING, port,
                                                                channel, key, note_id, retune);
-            m_evlist.push_back(Event(time, &exprev));
+            pushEvent(Event(time, &exprev));
         }
         ev = xenakios::make_event_note(0, CLAP_EVENT_NOTE_OFF, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time + duration, &ev));
+        pushEvent(Event(time + duration, &ev));
     }
     void addNoteF(double time, double duration, int port, int channel, double pitch, int note_id,
                   double velo)
@@ -91,21 +147,21 @@ class ClapEventSequence
         double frac = pitch - key;
         auto ev =
             xenakios::make_event_note(0, CLAP_EVENT_NOTE_ON, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
         if (frac > 0.0)
         {
             auto exprev = xenakios::make_event_note_expression(0, CLAP_NOTE_EXPRESSION_TUNING, port,
                                                                channel, key, note_id, frac);
-            m_evlist.push_back(Event(time, &exprev));
+            pushEvent(Event(time, &exprev));
         }
         ev = xenakios::make_event_note(0, CLAP_EVENT_NOTE_OFF, port, channel, key, note_id, velo);
-        m_evlist.push_back(Event(time + duration, &ev));
+        pushEvent(Event(time + duration, &ev));
     }
     void addNoteExpression(double time, int port, int channel, int key, int note_id, int net,
                            double amt)
     {
         auto ev = xenakios::make_event_note_expression(0, net, port, channel, key, note_id, amt);
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addParameterEvent(bool ismod, double time, int port, int channel, int key, int note_id,
                            uint32_t par_id, double value)
@@ -114,13 +170,13 @@ class ClapEventSequence
         {
             auto ev = xenakios::make_event_param_mod(0, par_id, value, nullptr, port, channel, key,
                                                      note_id, 0);
-            m_evlist.push_back(Event(time, &ev));
+            pushEvent(Event(time, &ev));
         }
         else
         {
             auto ev = xenakios::make_event_param_value(0, par_id, value, nullptr, port, channel,
                                                        key, note_id, 0);
-            m_evlist.push_back(Event(time, &ev));
+            pushEvent(Event(time, &ev));
         }
     }
     void addTransportEvent(double time, double tempo);
@@ -139,7 +195,7 @@ class ClapEventSequence
         ev.numframes = numframes;
         ev.samplerate = samplerate;
         ev.target = target;
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addAudioRoutingEvent(double time, int32_t target, int32_t opcode, int32_t src,
                               int32_t dest)
@@ -154,7 +210,7 @@ class ClapEventSequence
         ev.opcode = opcode;
         ev.src = src;
         ev.dest = dest;
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     std::unordered_map<int, std::string> sequenceStrings;
     void addString(int id, std::string str) { sequenceStrings[id] = str; }
@@ -173,7 +229,7 @@ class ClapEventSequence
             ev.header.type = XENAKIOS_STRING_MSG;
             ev.target = target;
             ev.str = (char *)it->second.c_str();
-            m_evlist.push_back(Event(time, &ev));
+            pushEvent(Event(time, &ev));
         }
     }
     void addProgramChange(double time, int port, int channel, int program)
@@ -188,7 +244,7 @@ class ClapEventSequence
         ev.data[0] = 0xc0 + (channel % 16);
         ev.data[1] = program & 0x7f;
         ev.data[2] = 0;
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     void addMIDI1Message(double time, int port, uint8_t b0, uint8_t b1, uint8_t b2)
     {
@@ -202,7 +258,7 @@ class ClapEventSequence
         ev.data[0] = b0;
         ev.data[1] = b1;
         ev.data[2] = b2;
-        m_evlist.push_back(Event(time, &ev));
+        pushEvent(Event(time, &ev));
     }
     // doesn't require events to be pre-sorted, so needs to scan all events
     double getMaximumEventTime() const
@@ -390,21 +446,173 @@ class ClapEventSequence
         auto root = toValueTree("e");
         return choc::json::toString(root, true);
     }
+    // Hash of the event contents, field by field so that the padding and the unused bytes of the
+    // event union don't affect it. Equal sequences hash equal across runs, the header times and
+    // sizes are left out because they are only meaningful while processing. Strings and audio
+    // buffers referred to by the Xenakios events are hashed by content.
     uint64_t getHash() const
     {
         choc::hash::xxHash64 h;
-        size_t sz = m_evlist.size();
-        h.addInput(&sz, sizeof(size_t));
+        auto add = [&h](auto value) {
+            // -0.0 and 0.0 behave the same
+            if constexpr (std::is_floating_point_v<decltype(value)>)
+                if (value == 0)
+                    value = 0;
+            h.addInput(&value, sizeof(value));
+        };
+        add((uint64_t)m_evlist.size());
         for (auto &e : m_evlist)
         {
-            h.addInput(&e.timestamp, sizeof(double));
-            // Can't do it this way, the events may contain spurious undefined data
-            // because of padding. I am afraid that if hashing is needed, it needs
-            // to be done quite tediously taking all event types manually into account...
-            h.addInput(&e.event, e.event.header.size);
+            add(e.timestamp);
+            add((int32_t)e.extdata0);
+            add((int32_t)e.extdata1);
+            const auto &hdr = e.event.header;
+            add((uint32_t)hdr.space_id);
+            add((uint32_t)hdr.type);
+            add((uint32_t)hdr.flags);
+            if (hdr.space_id != CLAP_CORE_EVENT_SPACE_ID)
+            {
+                addXenEventToHash(e.event, add);
+                continue;
+            }
+            switch (hdr.type)
+            {
+            case CLAP_EVENT_NOTE_ON:
+            case CLAP_EVENT_NOTE_OFF:
+            case CLAP_EVENT_NOTE_CHOKE:
+            case CLAP_EVENT_NOTE_END:
+            {
+                const auto &ev = e.event.note;
+                add((int32_t)ev.note_id);
+                add((int32_t)ev.port_index);
+                add((int32_t)ev.channel);
+                add((int32_t)ev.key);
+                add((double)ev.velocity);
+                break;
+            }
+            case CLAP_EVENT_NOTE_EXPRESSION:
+            {
+                const auto &ev = e.event.noteexpression;
+                add((int32_t)ev.expression_id);
+                add((int32_t)ev.note_id);
+                add((int32_t)ev.port_index);
+                add((int32_t)ev.channel);
+                add((int32_t)ev.key);
+                add((double)ev.value);
+                break;
+            }
+            case CLAP_EVENT_PARAM_VALUE:
+            {
+                const auto &ev = e.event.param;
+                add((uint32_t)ev.param_id);
+                add((int32_t)ev.note_id);
+                add((int32_t)ev.port_index);
+                add((int32_t)ev.channel);
+                add((int32_t)ev.key);
+                add((double)ev.value);
+                break;
+            }
+            case CLAP_EVENT_PARAM_MOD:
+            {
+                const auto &ev = e.event.parammod;
+                add((uint32_t)ev.param_id);
+                add((int32_t)ev.note_id);
+                add((int32_t)ev.port_index);
+                add((int32_t)ev.channel);
+                add((int32_t)ev.key);
+                add((double)ev.amount);
+                break;
+            }
+            case CLAP_EVENT_PARAM_GESTURE_BEGIN:
+            case CLAP_EVENT_PARAM_GESTURE_END:
+                add((uint32_t)e.event.paramgest.param_id);
+                break;
+            case CLAP_EVENT_MIDI:
+            {
+                const auto &ev = e.event.midi;
+                add((uint32_t)ev.port_index);
+                for (auto b : ev.data)
+                    add((uint8_t)b);
+                break;
+            }
+            case CLAP_EVENT_MIDI2:
+            {
+                const auto &ev = e.event.midi2;
+                add((uint32_t)ev.port_index);
+                for (auto w : ev.data)
+                    add((uint32_t)w);
+                break;
+            }
+            case CLAP_EVENT_TRANSPORT:
+            {
+                const auto &ev = e.event.transport;
+                add((uint32_t)ev.flags);
+                add((int64_t)ev.song_pos_beats);
+                add((int64_t)ev.song_pos_seconds);
+                add((double)ev.tempo);
+                add((double)ev.tempo_inc);
+                add((int64_t)ev.loop_start_beats);
+                add((int64_t)ev.loop_end_beats);
+                add((int64_t)ev.loop_start_seconds);
+                add((int64_t)ev.loop_end_seconds);
+                add((int64_t)ev.bar_start);
+                add((int32_t)ev.bar_number);
+                add((uint16_t)ev.tsig_num);
+                add((uint16_t)ev.tsig_denom);
+                break;
+            }
+            default:
+                // unknown core events only contribute their header
+                break;
+            }
         }
         return h.getHash();
     }
+    template <typename AddFunc>
+    static void addXenEventToHash(const clap_multi_event &event, AddFunc &add)
+    {
+        switch (event.header.type)
+        {
+        case XENAKIOS_STRING_MSG:
+        {
+            const auto &ev = event.xstr;
+            add((int32_t)ev.target);
+            if (ev.str)
+            {
+                std::string_view str{ev.str};
+                add((uint64_t)str.size());
+                for (char c : str)
+                    add(c);
+            }
+            break;
+        }
+        case XENAKIOS_AUDIOBUFFER_MSG:
+        {
+            const auto &ev = event.xabuf;
+            add((int32_t)ev.target);
+            add((int32_t)ev.numchans);
+            add((int32_t)ev.numframes);
+            add((int32_t)ev.samplerate);
+            if (ev.buffer)
+            {
+                for (int64_t i = 0; i < (int64_t)ev.numchans * ev.numframes; ++i)
+                    add(ev.buffer[i]);
+            }
+            break;
+        }
+        case XENAKIOS_ROUTING_MSG:
+        {
+            const auto &ev = event.xrout;
+            add((int32_t)ev.target);
+            add((int32_t)ev.opcode);
+            add((int32_t)ev.src);
+            add((int32_t)ev.dest);
+            break;
+        }
+        default:
+            break;
+        }
+    }
     struct Iterator
     {
         /// Creates an iterator positioned at the start of the sequence.
@@ -460,27 +668,30 @@ class ClapEventSequence
     // to avoid issues with accumulating time counts going out of sync,
     // this iterator deals with time positions as samples and needs to be provided
     // the current playback sample rate
+    // The frame index of the events is built when the iterator is created, so the iterator
+    // doesn't allocate after that. If the sequence is modified after creating the iterator, the
+    // iterator returns no events until it's recreated, instead of events from a stale index.
     struct IteratorSampleTime
     {
         /// Creates an iterator positioned at the start of the sequence.
-        IteratorSampleTime(const ClapEventSequence &s, double sr) : owner(s), sampleRate(sr) {}
+        IteratorSampleTime(const ClapEventSequence &s, double sr) : owner(s)
+        {
+            frameIndex.build(owner.m_evlist.data(), owner.m_evlist.size(), sr,
+                             owner.getModificationCount(),
+                             [](const Event &e) { return e.timestamp; });
+        }
         IteratorSampleTime(const IteratorSampleTime &) = default;
         IteratorSampleTime(IteratorSampleTime &&) = default;
 
+        /// Whether the sequence is unchanged since creating the iterator
+        bool isValid() const { return frameIndex.isValidFor(owner.getModificationCount()); }
+
         /// Seeks the iterator to the given time
 
         void setTime(int64_t newTimeStamp)
         {
-            auto eventData = owner.m_evlist.data();
-
-            while (nextIndex != 0 &&
-                   eventData[nextIndex - 1].timestamp * sampleRate >= newTimeStamp)
-                --nextIndex;
-
-            while (nextIndex < owner.m_evlist.size() &&
-                   eventData[nextIndex].timestamp * sampleRate < newTimeStamp)
-                ++nextIndex;
-
+            if (isValid())
+                nextIndex = frameIndex.findFirstAtOrAfter(newTimeStamp, nextIndex);
             currentTime = newTimeStamp;
         }
 
@@ -495,23 +706,224 @@ class ClapEventSequence
         {
             auto start = nextIndex;
             auto eventData = owner.m_evlist.data();
-            auto end = start;
-            auto total = owner.m_evlist.size();
             auto endTime = currentTime + duration;
             currentTime = endTime;
+            assert(isValid() && "sequence modified after creating its iterator");
+            if (!isValid())
+                return {eventData, eventData};
+            nextIndex = frameIndex.findFirstAtOrAfter(endTime, start);
+            return {eventData + start, eventData + nextIndex};
+        }
 
-            while (end < total && eventData[end].timestamp * sampleRate < endTime)
-                ++end;
+      private:
+        const ClapEventSequence &owner;
+        int64_t currentTime = 0;
+        size_t nextIndex = 0;
+        xenakios::SampleFrameIndex frameIndex;
+    };
 
-            nextIndex = end;
+  private:
+    xenakios::ModificationCounter m_modificationCount;
+};
 
-            return {eventData + start, eventData + end};
+// Read-only, compact copy of a ClapEventSequence for large scores. The events are stored as
+// variable length records in one byte arena, so a note event takes the size of a
+// clap_event_note instead of the size of the largest event type, and the timestamps are in
+// their own array, so seeking and finding the events of a block only touches 8 bytes per event.
+// The events are in time order regardless of whether the source sequence was sorted.
+// String events point to the strings of the source sequence, which must outlive the copy.
+class CompactClapEventSequence
+{
+  public:
+    struct EventView
+    {
+        double timestamp = 0.0;
+        const clap_event_header *header = nullptr;
+        // copy of the event, for passing it on with its time changed
+        ClapEventSequence::clap_multi_event copyEvent() const
+        {
+            ClapEventSequence::clap_multi_event result;
+            std::memcpy(&result, header, std::min<size_t>(header->size, sizeof(result)));
+            return result;
         }
+    };
+    // range of events returned by the iterators, iterates as EventViews
+    class EventRange
+    {
+      public:
+        struct const_iterator
+        {
+            const CompactClapEventSequence *owner = nullptr;
+            size_t index = 0;
+            EventView operator*() const { return owner->getEvent(index); }
+            const_iterator &operator++()
+            {
+                ++index;
+                return *this;
+            }
+            bool operator==(const const_iterator &other) const { return index == other.index; }
+        };
+        EventRange() = default;
+        EventRange(const CompactClapEventSequence &s, size_t startIndex, size_t endIndex)
+            : owner(&s), start(startIndex), end_(endIndex)
+        {
+        }
+        const_iterator begin() const { return {owner, start}; }
+        const_iterator end() const { return {owner, end_}; }
+        size_t size() const { return end_ - start; }
+        bool empty() const { return start == end_; }
+        EventView operator[](size_t i) const { return owner->getEvent(start + i); }
 
       private:
-        const ClapEventSequence &owner;
+        const CompactClapEventSequence *owner = nullptr;
+        size_t start = 0;
+        size_t end_ = 0;
+    };
+    CompactClapEventSequence() = default;
+    explicit CompactClapEventSequence(const ClapEventSequence &source)
+    {
+        auto &evlist = source.m_evlist;
+        // the order is only needed for unsorted sources, sorted ones are copied as they are
+        std::vector<uint32_t> order;
+        if (!std::is_sorted(evlist.begin(), evlist.end(), ClapEventSequence::eventTimeLess))
+        {
+            order.resize(evlist.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&evlist](uint32_t a, uint32_t b) {
+                return evlist[a].timestamp < evlist[b].timestamp;
+            });
+        }
+        size_t arenasize = 0;
+        for (auto &e : evlist)
+            arenasize += getRecordSize(e.event.header);
+        if (arenasize > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Sequence too large for CompactClapEventSequence");
+        m_arena.resize(arenasize);
+        m_timestamps.reserve(evlist.size());
+        m_offsets.reserve(evlist.size());
+        size_t offset = 0;
+        for (size_t i = 0; i < evlist.size(); ++i)
+        {
+            auto &e = evlist[order.empty() ? i : order[i]];
+            if (e.extdata0 != 0 || e.extdata1 != 0)
+                m_extdata.push_back({(uint32_t)m_timestamps.size(), e.extdata0, e.extdata1});
+            m_timestamps.push_back(e.timestamp);
+            m_offsets.push_back(offset);
+            size_t recsize = getRecordSize(e.event.header);
+            std::memcpy(&m_arena[offset], &e.event,
+                        std::min<size_t>(e.event.header.size, sizeof(e.event)));
+            offset += recsize;
+        }
+    }
+    size_t getNumEvents() const { return m_timestamps.size(); }
+    EventView getEvent(size_t index) const
+    {
+        return {m_timestamps[index], (const clap_event_header *)&m_arena[m_offsets[index]]};
+    }
+    // extdata0 and extdata1 of the source event, only stored for the events that had them
+    std::pair<int, int> getExtData(size_t index) const
+    {
+        auto it = std::lower_bound(m_extdata.begin(), m_extdata.end(), index,
+                                   [](const ExtData &e, size_t i) { return e.index < i; });
+        if (it != m_extdata.end() && it->index == index)
+            return {it->data0, it->data1};
+        return {0, 0};
+    }
+    double getMaximumEventTime() const
+    {
+        if (m_timestamps.empty())
+            throw std::runtime_error("No events in sequence");
+        return m_timestamps.back();
+    }
+    size_t getSizeInBytes() const
+    {
+        return m_arena.capacity() + m_timestamps.capacity() * sizeof(double) +
+               m_offsets.capacity() * sizeof(uint32_t) + m_extdata.capacity() * sizeof(ExtData);
+    }
+    // Same interface as the ClapEventSequence iterators, but the events are returned as an
+    // EventRange
+    struct Iterator
+    {
+        Iterator(const CompactClapEventSequence &s) : owner(s) {}
+        void setTime(double newTimeStamp)
+        {
+            nextIndex = owner.findIndex(nextIndex, [newTimeStamp](double t) {
+                return t < newTimeStamp;
+            });
+            currentTime = newTimeStamp;
+        }
+        double getTime() const noexcept { return currentTime; }
+        EventRange readNextEvents(double duration)
+        {
+            auto start = nextIndex;
+            auto endTime = currentTime + duration;
+            currentTime = endTime;
+            nextIndex = owner.findIndex(start, [endTime](double t) { return t < endTime; });
+            return {owner, start, nextIndex};
+        }
+
+      private:
+        const CompactClapEventSequence &owner;
+        double currentTime = 0;
+        size_t nextIndex = 0;
+    };
+    struct IteratorSampleTime
+    {
+        IteratorSampleTime(const CompactClapEventSequence &s, double sr) : owner(s)
+        {
+            // the compact sequence can't be modified, so the index is always valid
+            frameIndex.build(owner.m_timestamps.data(), owner.m_timestamps.size(), sr, 0,
+                             [](double t) { return t; });
+        }
+        void setTime(int64_t newTimeStamp)
+        {
+            nextIndex = frameIndex.findFirstAtOrAfter(newTimeStamp, nextIndex);
+            currentTime = newTimeStamp;
+        }
+        int64_t getTime() const noexcept { return currentTime; }
+        EventRange readNextEvents(int duration)
+        {
+            auto start = nextIndex;
+            auto endTime = currentTime + duration;
+            currentTime = endTime;
+            nextIndex = frameIndex.findFirstAtOrAfter(endTime, start);
+            return {owner, start, nextIndex};
+        }
+
+      private:
+        const CompactClapEventSequence &owner;
         int64_t currentTime = 0;
         size_t nextIndex = 0;
-        double sampleRate = 0.0;
+        xenakios::SampleFrameIndex frameIndex;
+    };
+
+  private:
+    struct ExtData
+    {
+        uint32_t index = 0;
+        int data0 = 0;
+        int data1 = 0;
     };
+    // records are padded to keep the 8 byte alignment of the CLAP event structs
+    static size_t getRecordSize(const clap_event_header &header)
+    {
+        size_t sz = std::min<size_t>(header.size, sizeof(ClapEventSequence::clap_multi_event));
+        return (std::max<size_t>(sz, sizeof(clap_event_header)) + 7) & ~(size_t)7;
+    }
+    // index of the first event at or after hint for which isBefore is false, the timestamps
+    // before the hint are walked back over like the ClapEventSequence iterators do
+    template <typename Pred> size_t findIndex(size_t hint, Pred isBefore) const
+    {
+        size_t index = std::min(hint, m_timestamps.size());
+        while (index != 0 && !isBefore(m_timestamps[index - 1]))
+            --index;
+        while (index < m_timestamps.size() && isBefore(m_timestamps[index]))
+            ++index;
+        return index;
+    }
+    std::vector<std::byte> m_arena;
+    std::vector<double> m_timestamps;
+    std::vector<uint32_t> m_offsets;
+    std::vector<ExtData> m_extdata;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 #include <optional>
@@ -205,18 +207,9 @@ class Envelope
             newIndex = 0;
         else if (t > m_points.back().getX())
             newIndex = m_points.size() - 1;
-        else
+        else if (t >= m_points.front().getX())
         {
-            // could do some optimization trick here, like binary search
-            // or search backwards/forwards depending on current point index etc
-            // but this shall suffice for now
-            for (int i = 0; i < m_points.size(); ++i)
-            {
-                if (t >= m_points[i].getX())
-                {
-                    newIndex = i;
-                }
-            }
+            newIndex = findSegmentIndex(t);
         }
 
         if (newIndex != currentPointIndex)
@@ -325,6 +318,46 @@ class Envelope
             }
         }
     }
+    // Evaluates the envelope at all the positions, with the same results as getValueAtPosition.
+    // Sorted positions are handled with a single merge walk over the points, otherwise each
+    // position is binary searched. Consecutive positions in the same segment are evaluated
+    // together with branchless loops the compiler can vectorize.
+    void getValuesAtPositions(const double *positions, double *output, size_t count)
+    {
+        if (m_points.empty())
+            throw std::runtime_error("Envelope has no points to evaluate");
+        if (!m_sorted)
+            sortPoints();
+        const bool sortedinput = std::is_sorted(positions, positions + count);
+        const int numpoints = m_points.size();
+        auto insegment = [this, numpoints](int index, double t) {
+            return (index == 0 || t >= m_points[index].getX()) &&
+                   (index == numpoints - 1 || t < m_points[index + 1].getX());
+        };
+        int index = 0;
+        size_t i = 0;
+        while (i < count)
+        {
+            double t = positions[i];
+            if (std::isnan(t))
+            {
+                output[i++] = t;
+                continue;
+            }
+            if (sortedinput)
+            {
+                while (index + 1 < numpoints && m_points[index + 1].getX() <= t)
+                    ++index;
+            }
+            else if (!insegment(index, t))
+                index = findSegmentIndex(t);
+            size_t runend = i + 1;
+            while (runend < count && insegment(index, positions[runend]))
+                ++runend;
+            evaluateSegment(index, positions + i, output + i, runend - i);
+            i = runend;
+        }
+    }
     std::vector<EnvelopePoint> &getPoints() { return m_points; }
     class Iterator
     {
@@ -348,6 +381,69 @@ class Envelope
     Iterator defaultIterator{*this};
 
   private:
+    // index of the last point at or before t, 0 if t is before the first point
+    int findSegmentIndex(double t) const
+    {
+        auto it = std::upper_bound(m_points.begin(), m_points.end(), t,
+                                   [](double x, const EnvelopePoint &pt) { return x < pt.getX(); });
+        if (it == m_points.begin())
+            return 0;
+        return std::distance(m_points.begin(), it) - 1;
+    }
+    // the segment math of processBlock for a run of positions, shape by shape so that the loops
+    // stay free of branches
+    void evaluateSegment(int index, const double *positions, double *output, size_t count) const
+    {
+        const auto &pt0 = getPointSafe(index);
+        const auto &pt1 = getPointSafe(index + 1);
+        const double x0 = pt0.getX();
+        const double y0 = pt0.getY();
+        const double y1 = pt1.getY();
+        const double xdiff = pt1.getX() - x0;
+        if (xdiff < 0.00001)
+        {
+            std::fill(output, output + count, y1);
+            return;
+        }
+        const double invxdiff = 1.0 / xdiff;
+        for (size_t i = 0; i < count; ++i)
+            output[i] = invxdiff * (positions[i] - x0);
+        const double p0 = pt0.getPar0();
+        switch (pt0.getShape())
+        {
+        case EnvelopePoint::Shape::Hold:
+        {
+            const double range = 1.0 - p0;
+            for (size_t i = 0; i < count; ++i)
+                output[i] = output[i] < p0 ? 0.0 : (output[i] - p0) / range;
+            break;
+        }
+        case EnvelopePoint::Shape::Abrupt:
+            std::fill(output, output + count, 0.0);
+            break;
+        case EnvelopePoint::Shape::Power:
+        {
+            if (p0 < 0.0)
+            {
+                const double exponent = mapvalue(p0, -1.0, 0.0, 4.0, 1.0);
+                for (size_t i = 0; i < count; ++i)
+                    output[i] = 1.0 - std::pow(1.0 - output[i], exponent);
+            }
+            else
+            {
+                const double exponent = mapvalue(p0, 0.0, 1.0, 1.0, 4.0);
+                for (size_t i = 0; i < count; ++i)
+                    output[i] = std::pow(output[i], exponent);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        const double ydiff = y1 - y0;
+        for (size_t i = 0; i < count; ++i)
+            output[i] = y0 + ydiff * output[i];
+    }
     std::vector<EnvelopePoint> m_points;
     bool m_sorted = false;
 };
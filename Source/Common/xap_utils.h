@@ -5,6 +5,8 @@
 #include "audio/choc_AudioFileFormat.h"
 #include "containers/choc_SingleReaderSingleWriterFIFO.h"
 #include <concepts>
+#include <atomic>
+#include <array>
 #include <algorithm>
 #include <cstdint>
 #include <limits>
@@ -529,6 +531,48 @@ template <typename T, size_t Size> class SimpleRingBuffer
     int m_available = 0;
 };
 
+/*
+Lock-free single writer/single reader triple buffer. The writer fills the write buffer and
+publishes it, the reader fetches the most recently published buffer. Neither side ever waits,
+but the reader will miss buffers if it fetches less often than the writer publishes, unless
+the writer checks isPublishedFetched before publishing.
+*/
+template <typename T> class TripleBuffer
+{
+  public:
+    TripleBuffer() = default;
+    TripleBuffer(const T &initvalue) { m_buffers.fill(initvalue); }
+    T &getWriteBuffer() { return m_buffers[m_write_index]; }
+    void publish()
+    {
+        m_write_index = m_middle.exchange(m_write_index | dirty_flag, std::memory_order_acq_rel) &
+                        index_mask;
+    }
+    // false while the reader hasn't fetched the most recently published buffer, so the writer can
+    // keep adding to its write buffer instead of publishing over an unread one
+    bool isPublishedFetched() const
+    {
+        return (m_middle.load(std::memory_order_acquire) & dirty_flag) == 0;
+    }
+    // returns true if a newer buffer than the previous read buffer was available
+    bool fetch()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & dirty_flag) == 0)
+            return false;
+        m_read_index = m_middle.exchange(m_read_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+    const T &getReadBuffer() const { return m_buffers[m_read_index]; }
+
+  private:
+    static constexpr uint8_t dirty_flag = 4;
+    static constexpr uint8_t index_mask = 3;
+    std::array<T, 3> m_buffers;
+    uint8_t m_write_index = 0;
+    std::atomic<uint8_t> m_middle{1};
+    uint8_t m_read_index = 2;
+};
+
 // note that limits can't be the same and the loop may run for long!
 // looks like this is broken...need to explore further
 template <typename T> inline T wrap_value(const T minval, const T val, const T maxval)
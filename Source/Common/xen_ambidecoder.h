@@ -0,0 +1,615 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+#include "xen_ambisonics.h"
+#include "text/choc_Files.h"
+#include "text/choc_JSON.h"
+
+/*
+Ambisonic decoder that maps ACN ordered ambisonic channels to speaker (or headphone) feeds with
+a speakers x ambisonic channels matrix.
+
+The matrices are computed for all ambisonic orders up to 7 and both N3D and SN3D input
+normalizations when the decoder is created, so the order and normalization of the incoming
+signal can change at any time without the decoder needing to be rebuilt.
+
+Speaker directions are given in degrees with the usual ambisonic convention : azimuth 0 is
+front and positive azimuths are to the left, positive elevations are up.
+
+A decoder can be created from a named preset (see getPresetNames) or from a JSON file, which
+either describes a speaker layout :
+
+    {"method" : "allrad", "maxre" : true, "speakers" : [[30, 0], [-30, 0], [110, 0], ...]}
+
+where the method can be "allrad" or "sampled", or a precomputed matrix :
+
+    {"method" : "matrix", "normalization" : "sn3d", "matrix" : [[...], [...], ...]}
+
+with one row per output channel and one column per ambisonic channel.
+*/
+
+namespace xenakios
+{
+struct SpeakerDirection
+{
+    float azimuth = 0.0f;
+    float elevation = 0.0f;
+};
+
+class AmbisonicDecoder
+{
+  public:
+    enum class Method
+    {
+        Sampled,
+        AllRAD
+    };
+    static constexpr int maxOrder = 7;
+    static constexpr int maxInputChannels = (maxOrder + 1) * (maxOrder + 1);
+    static constexpr int maxOutputChannels = 64;
+
+    // virtual speaker grid size used for AllRAD and the energy normalization
+    static constexpr int numGridPoints = 512;
+
+    static std::unique_ptr<AmbisonicDecoder> makeFromLayout(Method method,
+                                                            std::vector<SpeakerDirection> speakers,
+                                                            bool maxRE = true)
+    {
+        if (speakers.empty() || speakers.size() > maxOutputChannels)
+            throw std::runtime_error(
+                std::format("Speaker count must be between 1 and {}", maxOutputChannels));
+        auto result = std::unique_ptr<AmbisonicDecoder>(new AmbisonicDecoder);
+        result->numSpeakers = speakers.size();
+        std::vector<float> panning;
+        int numPanned = speakers.size();
+        if (method == Method::AllRAD)
+            panning = makeAllRADPanning(speakers);
+        for (int order = 1; order <= maxOrder; ++order)
+        {
+            int nch = numChannelsForOrder(order);
+            std::vector<float> mat(numPanned * nch);
+            if (method == Method::Sampled)
+            {
+                // sampling can't decode higher orders than the speaker count supports, those
+                // channels are left unused
+                int usableOrder = std::clamp((int)std::sqrt((float)numPanned) - 1, 1, order);
+                int usableChannels = numChannelsForOrder(usableOrder);
+                auto weights = maxRE ? getMaxREWeights(usableOrder)
+                                     : std::vector<float>(usableChannels, 1.0f);
+                float sh[maxInputChannels];
+                for (int s = 0; s < numPanned; ++s)
+                {
+                    evalDirection(usableOrder, speakers[s], sh);
+                    for (int i = 0; i < usableChannels; ++i)
+                        mat[s * nch + i] = sh[i] * weights[i] * 4.0f * M_PI / numPanned;
+                }
+            }
+            else
+            {
+                auto weights = maxRE ? getMaxREWeights(order) : std::vector<float>(nch, 1.0f);
+                const auto &grid = getGrid();
+                float sh[maxInputChannels];
+                for (int g = 0; g < numGridPoints; ++g)
+                {
+                    evalCartesian(order, grid[g], sh);
+                    for (int s = 0; s < numPanned; ++s)
+                    {
+                        float gain = panning[g * numPanned + s];
+                        if (gain == 0.0f)
+                            continue;
+                        for (int i = 0; i < nch; ++i)
+                            mat[s * nch + i] +=
+                                gain * sh[i] * weights[i] * 4.0f * M_PI / numGridPoints;
+                    }
+                }
+            }
+            result->setOrderMatrix(order, std::move(mat), true);
+        }
+        return result;
+    }
+
+    // a precomputed matrix, numRows * numColumns values in row major order
+    static std::unique_ptr<AmbisonicDecoder> makeFromMatrix(const std::vector<float> &matrix,
+                                                            int numRows, int numColumns,
+                                                            bool sn3dMatrix, bool normalize)
+    {
+        if (numRows < 1 || numRows > maxOutputChannels)
+            throw std::runtime_error(std::format(
+                "Decoder matrix row count must be between 1 and {}", maxOutputChannels));
+        int matrixOrder = (int)std::sqrt((float)numColumns) - 1;
+        if (matrixOrder < 0 || matrixOrder > maxOrder ||
+            numChannelsForOrder(matrixOrder) != numColumns)
+            throw std::runtime_error(
+                std::format("Decoder matrix column count {} is not a valid ambisonic channel count",
+                            numColumns));
+        if ((int)matrix.size() != numRows * numColumns)
+            throw std::runtime_error("Decoder matrix size does not match the row/column counts");
+        auto result = std::unique_ptr<AmbisonicDecoder>(new AmbisonicDecoder);
+        result->numSpeakers = numRows;
+        for (int order = 1; order <= maxOrder; ++order)
+        {
+            // lower orders use the matching columns, higher order channels are ignored
+            int nch = numChannelsForOrder(order);
+            std::vector<float> mat(numRows * nch);
+            for (int s = 0; s < numRows; ++s)
+            {
+                for (int i = 0; i < std::min(nch, numColumns); ++i)
+                {
+                    float v = matrix[s * numColumns + i];
+                    // store as N3D
+                    if (sn3dMatrix)
+                        v *= n3d2sn3d[i];
+                    mat[s * nch + i] = v;
+                }
+            }
+            result->setOrderMatrix(order, std::move(mat), normalize);
+        }
+        return result;
+    }
+
+    static std::vector<std::string> getPresetNames()
+    {
+        return {"stereo_ms", "binaural_basic", "quad", "5.0", "octagon", "cube", "dome_8_4_1"};
+    }
+
+    static std::unique_ptr<AmbisonicDecoder> makePreset(const std::string &name)
+    {
+        auto ring = [](int n, float elevation, float startAzimuth) {
+            std::vector<SpeakerDirection> result;
+            for (int i = 0; i < n; ++i)
+                result.push_back({startAzimuth + 360.0f / n * i, elevation});
+            return result;
+        };
+        if (name == "stereo_ms")
+        {
+            // the fixed mid/side stereo output the plugin used to have, (1.414W +- Y) * 0.5. That
+            // applied the same gains whatever the normalization was, so the N3D matrices are
+            // used for SN3D input too instead of being converted.
+            std::vector<float> mat{0.707f, 0.5f, 0.0f, 0.0f, 0.707f, -0.5f, 0.0f, 0.0f};
+            auto result = makeFromMatrix(mat, 2, 4, false, false);
+            result->matrices[1] = result->matrices[0];
+            return result;
+        }
+        if (name == "binaural_basic")
+            return makeBasicBinaural();
+        if (name == "quad")
+            return makeFromLayout(Method::AllRAD, ring(4, 0.0f, 45.0f));
+        if (name == "5.0")
+            return makeFromLayout(Method::AllRAD,
+                                  {{30.0f, 0.0f}, {-30.0f, 0.0f}, {0.0f, 0.0f}, {110.0f, 0.0f},
+                                   {-110.0f, 0.0f}});
+        if (name == "octagon")
+            return makeFromLayout(Method::AllRAD, ring(8, 0.0f, 0.0f));
+        if (name == "cube")
+        {
+            auto speakers = ring(4, 35.264f, 45.0f);
+            auto lower = ring(4, -35.264f, 45.0f);
+            speakers.insert(speakers.end(), lower.begin(), lower.end());
+            return makeFromLayout(Method::AllRAD, speakers);
+        }
+        if (name == "dome_8_4_1")
+        {
+            auto speakers = ring(8, 0.0f, 0.0f);
+            auto upper = ring(4, 45.0f, 45.0f);
+            speakers.insert(speakers.end(), upper.begin(), upper.end());
+            speakers.push_back({0.0f, 90.0f});
+            return makeFromLayout(Method::AllRAD, speakers);
+        }
+        throw std::runtime_error(std::format("Unknown ambisonic decoder preset \"{}\"", name));
+    }
+
+    static std::unique_ptr<AmbisonicDecoder> loadFromFile(const std::string &path)
+    {
+        auto json = choc::json::parse(choc::file::loadFileAsString(path));
+        std::string method = std::string(json["method"].getWithDefault("allrad"));
+        if (method == "matrix")
+        {
+            auto rows = json["matrix"];
+            std::vector<float> mat;
+            int numColumns = 0;
+            for (int i = 0; i < (int)rows.size(); ++i)
+            {
+                auto row = rows[i];
+                if (i == 0)
+                    numColumns = row.size();
+                if ((int)row.size() != numColumns)
+                    throw std::runtime_error(
+                        std::format("Decoder matrix row {} has {} columns, expected {}", i,
+                                    row.size(), numColumns));
+                for (int j = 0; j < numColumns; ++j)
+                    mat.push_back(row[j].getWithDefault(0.0f));
+            }
+            bool sn3d = std::string(json["normalization"].getWithDefault("sn3d")) == "sn3d";
+            return makeFromMatrix(mat, rows.size(), numColumns, sn3d,
+                                  json["normalize"].getWithDefault(false));
+        }
+        std::vector<SpeakerDirection> speakers;
+        auto spks = json["speakers"];
+        for (int i = 0; i < (int)spks.size(); ++i)
+            speakers.push_back({spks[i][0].getWithDefault(0.0f), spks[i][1].getWithDefault(0.0f)});
+        bool maxre = json["maxre"].getWithDefault(true);
+        if (method == "allrad")
+            return makeFromLayout(Method::AllRAD, speakers, maxre);
+        if (method == "sampled")
+            return makeFromLayout(Method::Sampled, speakers, maxre);
+        throw std::runtime_error(std::format("Unknown ambisonic decoder method \"{}\"", method));
+    }
+
+    // the specification can be a preset name or a path to a decoder JSON file
+    static std::unique_ptr<AmbisonicDecoder> create(const std::string &spec)
+    {
+        auto names = getPresetNames();
+        if (std::find(names.begin(), names.end(), spec) != names.end())
+            return makePreset(spec);
+        if (!std::filesystem::exists(spec))
+            throw std::runtime_error(
+                std::format("\"{}\" is not a decoder preset or an existing file", spec));
+        return loadFromFile(spec);
+    }
+
+    int getNumOutputChannels() const { return numSpeakers; }
+
+    // the decoding matrix used for the order and normalization, numOutputChannels rows of
+    // (order+1)^2 values
+    const std::vector<float> &getMatrix(int order, bool sn3dInput) const
+    {
+        return matrices[sn3dInput ? 1 : 0][std::clamp(order, 1, maxOrder)];
+    }
+
+    // Decodes planar input channels into planar outputs. The input channel count determines
+    // the ambisonic order. Output channels beyond the decoder's channel count are cleared.
+    // Does not allocate or lock.
+    void process(const float *const *input, int numInputChannels, bool sn3dInput,
+                 float *const *output, int numOutputChannels, int numFrames) const
+    {
+        int order = std::clamp((int)std::sqrt((float)numInputChannels) - 1, 1, maxOrder);
+        int nch = numChannelsForOrder(order);
+        const float *mat = matrices[sn3dInput ? 1 : 0][order].data();
+        int numOuts = std::min(numSpeakers, numOutputChannels);
+        // the frames are processed in blocks, so that the inputs stay in the L1 cache while
+        // all the rows are processed
+        for (int f = 0; f < numFrames; f += frameBlockSize)
+        {
+            int framesToDo = std::min(frameBlockSize, numFrames - f);
+            int s = 0;
+            for (; s + 4 <= numOuts; s += 4)
+                processRows<4>(mat + s * nch, nch, input, output + s, f, framesToDo);
+            for (; s < numOuts; ++s)
+                processRows<1>(mat + s * nch, nch, input, output + s, f, framesToDo);
+        }
+        for (int i = numOuts; i < numOutputChannels; ++i)
+            std::fill(output[i], output[i] + numFrames, 0.0f);
+    }
+
+  private:
+    AmbisonicDecoder() = default;
+    static constexpr int frameBlockSize = 64;
+    int numSpeakers = 0;
+    // [normalization][order], the N3D variants are at index 0
+    std::array<std::array<std::vector<float>, maxOrder + 1>, 2> matrices;
+
+    static constexpr int numChannelsForOrder(int order) { return (order + 1) * (order + 1); }
+
+    template <int NumRows>
+    static void processRows(const float *rows, int nch, const float *const *input,
+                            float *const *output, int startFrame, int numFrames)
+    {
+        int f = startFrame;
+        const int endFrame = startFrame + numFrames;
+        for (; f + 8 <= endFrame; f += 8)
+        {
+            __m256 acc[NumRows];
+            for (int r = 0; r < NumRows; ++r)
+                acc[r] = _mm256_setzero_ps();
+            for (int i = 0; i < nch; ++i)
+            {
+                __m256 x = _mm256_loadu_ps(input[i] + f);
+                for (int r = 0; r < NumRows; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_set1_ps(rows[r * nch + i]), x, acc[r]);
+            }
+            for (int r = 0; r < NumRows; ++r)
+                _mm256_storeu_ps(output[r] + f, acc[r]);
+        }
+        for (; f < endFrame; ++f)
+        {
+            for (int r = 0; r < NumRows; ++r)
+            {
+                float sum = 0.0f;
+                for (int i = 0; i < nch; ++i)
+                    sum += rows[r * nch + i] * input[i][f];
+                output[r][f] = sum;
+            }
+        }
+    }
+
+    // takes the N3D matrix for the order and derives the SN3D one from it
+    void setOrderMatrix(int order, std::vector<float> mat, bool normalize)
+    {
+        int nch = numChannelsForOrder(order);
+        if (normalize)
+        {
+            // scale so that the decoded energy averaged over all source directions is 1
+            const auto &grid = getGrid();
+            float sh[maxInputChannels];
+            double energy = 0.0;
+            for (int g = 0; g < numGridPoints; ++g)
+            {
+                evalCartesian(order, grid[g], sh);
+                for (int s = 0; s < numSpeakers; ++s)
+                {
+                    double sum = 0.0;
+                    for (int i = 0; i < nch; ++i)
+                        sum += mat[s * nch + i] * sh[i];
+                    energy += sum * sum;
+                }
+            }
+            energy /= numGridPoints;
+            if (energy > 0.0)
+            {
+                float gain = 1.0 / std::sqrt(energy);
+                for (auto &v : mat)
+                    v *= gain;
+            }
+        }
+        auto sn3dmat = mat;
+        for (int s = 0; s < numSpeakers; ++s)
+            for (int i = 0; i < nch; ++i)
+                sn3dmat[s * nch + i] /= n3d2sn3d[i];
+        matrices[0][order] = std::move(mat);
+        matrices[1][order] = std::move(sn3dmat);
+    }
+
+    static void evalCartesian(int order, const std::array<float, 3> &p, float *sh)
+    {
+        switch (order)
+        {
+        case 1:
+            SHEval1(p[0], p[1], p[2], sh);
+            break;
+        case 2:
+            SHEval2(p[0], p[1], p[2], sh);
+            break;
+        case 3:
+            SHEval3(p[0], p[1], p[2], sh);
+            break;
+        case 4:
+            SHEval4(p[0], p[1], p[2], sh);
+            break;
+        case 5:
+            SHEval5(p[0], p[1], p[2], sh);
+            break;
+        case 6:
+            SHEval6(p[0], p[1], p[2], sh);
+            break;
+        default:
+            SHEval7(p[0], p[1], p[2], sh);
+            break;
+        }
+    }
+
+    static std::array<float, 3> toCartesian(const SpeakerDirection &dir)
+    {
+        std::array<float, 3> result;
+        sphericalToCartesian(degreesToRadians(dir.azimuth), degreesToRadians(dir.elevation),
+                             result[0], result[1], result[2]);
+        return result;
+    }
+
+    static void evalDirection(int order, const SpeakerDirection &dir, float *sh)
+    {
+        evalCartesian(order, toCartesian(dir), sh);
+    }
+
+    // nearly uniform directions on the sphere (Fibonacci lattice)
+    static const std::vector<std::array<float, 3>> &getGrid()
+    {
+        static const std::vector<std::array<float, 3>> grid = [] {
+            std::vector<std::array<float, 3>> result(numGridPoints);
+            const double golden = M_PI * (3.0 - std::sqrt(5.0));
+            for (int i = 0; i < numGridPoints; ++i)
+            {
+                double z = 1.0 - (i + 0.5) * 2.0 / numGridPoints;
+                double r = std::sqrt(1.0 - z * z);
+                double a = golden * i;
+                result[i] = {float(r * std::cos(a)), float(r * std::sin(a)), float(z)};
+            }
+            return result;
+        }();
+        return grid;
+    }
+
+    // max-rE weights per ACN channel, using the approximation
+    // a_n = P_n(cos(137.9 degrees / (order + 1.51)))
+    static std::vector<float> getMaxREWeights(int order)
+    {
+        double x = std::cos(degreesToRadians(137.9) / (order + 1.51));
+        std::vector<double> legendre(order + 1);
+        legendre[0] = 1.0;
+        if (order > 0)
+            legendre[1] = x;
+        for (int n = 2; n <= order; ++n)
+            legendre[n] = ((2 * n - 1) * x * legendre[n - 1] - (n - 1) * legendre[n - 2]) / n;
+        std::vector<float> result;
+        for (int n = 0; n <= order; ++n)
+            for (int m = 0; m < 2 * n + 1; ++m)
+                result.push_back(legendre[n]);
+        return result;
+    }
+
+    // VBAP gains of the grid directions to the speakers, numGridPoints rows of numSpeakers
+    // values. Imaginary speakers are added at the zenith and nadir when the layout doesn't
+    // cover them and their gains are dropped, as usual for AllRAD.
+    static std::vector<float> makeAllRADPanning(const std::vector<SpeakerDirection> &speakers)
+    {
+        using Vec = std::array<float, 3>;
+        std::vector<Vec> points;
+        for (auto &s : speakers)
+            points.push_back(toCartesian(s));
+        float minz = 1.0f;
+        float maxz = -1.0f;
+        for (auto &p : points)
+        {
+            minz = std::min(minz, p[2]);
+            maxz = std::max(maxz, p[2]);
+        }
+        if (maxz < 0.5f)
+            points.push_back({0.0f, 0.0f, 1.0f});
+        if (minz > -0.5f)
+            points.push_back({0.0f, 0.0f, -1.0f});
+        auto sub = [](const Vec &a, const Vec &b) {
+            return Vec{a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+        };
+        auto dot = [](const Vec &a, const Vec &b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        };
+        auto cross = [](const Vec &a, const Vec &b) {
+            return Vec{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                       a[0] * b[1] - a[1] * b[0]};
+        };
+        // the convex hull faces, found by brute force, which is fine for the speaker counts
+        // involved. each face is stored with the inverse of its speaker direction matrix.
+        struct Face
+        {
+            int speakers[3];
+            float inverse[3][3];
+        };
+        std::vector<Face> faces;
+        const int numPoints = points.size();
+        const float eps = 1e-4f;
+        for (int a = 0; a < numPoints; ++a)
+        {
+            for (int b = a + 1; b < numPoints; ++b)
+            {
+                for (int c = b + 1; c < numPoints; ++c)
+                {
+                    Vec normal = cross(sub(points[b], points[a]), sub(points[c], points[a]));
+                    float d = dot(normal, points[a]);
+                    // degenerate or passes through the listener
+                    if (std::abs(d) < eps)
+                        continue;
+                    bool isFace = true;
+                    for (int p = 0; p < numPoints && isFace; ++p)
+                    {
+                        if (p == a || p == b || p == c)
+                            continue;
+                        float side = dot(normal, points[p]) - d;
+                        // other points must be on the same side as the listener
+                        if (side * -d < -eps)
+                            isFace = false;
+                    }
+                    if (!isFace)
+                        continue;
+                    const auto &l1 = points[a];
+                    const auto &l2 = points[b];
+                    const auto &l3 = points[c];
+                    float det = dot(l1, cross(l2, l3));
+                    Face face{{a, b, c}, {}};
+                    Vec c0 = cross(l2, l3);
+                    Vec c1 = cross(l3, l1);
+                    Vec c2 = cross(l1, l2);
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        face.inverse[i][0] = c0[i] / det;
+                        face.inverse[i][1] = c1[i] / det;
+                        face.inverse[i][2] = c2[i] / det;
+                    }
+                    faces.push_back(face);
+                }
+            }
+        }
+        if (faces.empty())
+            throw std::runtime_error("Could not triangulate the speaker layout for AllRAD");
+        const int numReal = speakers.size();
+        const auto &grid = getGrid();
+        std::vector<float> result(numGridPoints * numReal);
+        for (int g = 0; g < numGridPoints; ++g)
+        {
+            // pick the face where the smallest gain is largest, that is the one that contains
+            // the direction, also when rounding puts it slightly outside of all of them
+            float bestMin = -1e9f;
+            float bestGains[3] = {0.0f, 0.0f, 0.0f};
+            const Face *bestFace = nullptr;
+            for (auto &face : faces)
+            {
+                float gains[3];
+                for (int j = 0; j < 3; ++j)
+                    gains[j] = grid[g][0] * face.inverse[0][j] + grid[g][1] * face.inverse[1][j] +
+                               grid[g][2] * face.inverse[2][j];
+                float mingain = std::min({gains[0], gains[1], gains[2]});
+                if (mingain > bestMin)
+                {
+                    bestMin = mingain;
+                    bestFace = &face;
+                    std::copy(gains, gains + 3, bestGains);
+                }
+            }
+            float power = 0.0f;
+            for (int j = 0; j < 3; ++j)
+            {
+                bestGains[j] = std::max(bestGains[j], 0.0f);
+                power += bestGains[j] * bestGains[j];
+            }
+            if (power <= 0.0f)
+                continue;
+            float norm = 1.0f / std::sqrt(power);
+            for (int j = 0; j < 3; ++j)
+            {
+                int spk = bestFace->speakers[j];
+                if (spk < numReal)
+                    result[g * numReal + spk] = bestGains[j] * norm;
+            }
+        }
+        return result;
+    }
+
+    // A sampling decode to virtual speakers that are mixed to the ears with direction
+    // dependent level differences only. There are no HRTFs available here, so this is
+    // a crude approximation but still gives some front/back and elevation cues via the
+    // virtual speakers.
+    static std::unique_ptr<AmbisonicDecoder> makeBasicBinaural()
+    {
+        std::vector<SpeakerDirection> virtualSpeakers;
+        for (int i = 0; i < 8; ++i)
+            virtualSpeakers.push_back({45.0f * i, 0.0f});
+        for (int i = 0; i < 4; ++i)
+        {
+            virtualSpeakers.push_back({45.0f + 90.0f * i, 45.0f});
+            virtualSpeakers.push_back({45.0f + 90.0f * i, -45.0f});
+        }
+        auto virtualDecoder = makeFromLayout(Method::Sampled, virtualSpeakers);
+        const int numVirtual = virtualSpeakers.size();
+        auto result = std::unique_ptr<AmbisonicDecoder>(new AmbisonicDecoder);
+        result->numSpeakers = 2;
+        for (int order = 1; order <= maxOrder; ++order)
+        {
+            int nch = numChannelsForOrder(order);
+            const auto &vmat = virtualDecoder->matrices[0][order];
+            std::vector<float> mat(2 * nch);
+            for (int v = 0; v < numVirtual; ++v)
+            {
+                auto pos = toCartesian(virtualSpeakers[v]);
+                // the ear facing the speaker gets more, sources behind are slightly attenuated
+                float rear = pos[0] < 0.0f ? 1.0f + 0.2f * pos[0] : 1.0f;
+                float left = 0.5f * (1.0f + 0.7f * pos[1]) * rear;
+                float right = 0.5f * (1.0f - 0.7f * pos[1]) * rear;
+                for (int i = 0; i < nch; ++i)
+                {
+                    mat[i] += left * vmat[v * nch + i];
+                    mat[nch + i] += right * vmat[v * nch + i];
+                }
+            }
+            result->setOrderMatrix(order, std::move(mat), true);
+        }
+        return result;
+    }
+};
+} // namespace xenakios
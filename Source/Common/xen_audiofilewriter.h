@@ -0,0 +1,386 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Streaming 32 bit float audio file writing for renders that are too long to keep in memory.
+
+StreamingAudioFileWriter writes interleaved blocks to :
+ - WAV, which is automatically upgraded to RF64 when the file grows past 4 GB (the header has
+   a JUNK chunk reserved for the ds64 chunk). RF64 can also be forced from the start.
+ - Sony Wave64 (W64), which always uses 64 bit sizes.
+ - Raw planar float, all frames of channel 0 followed by all frames of channel 1 etc.
+   The total frame count must be known when the writer is created.
+
+BackgroundAudioFileWriter hands the blocks over to a writer thread via a fixed number of
+preallocated blocks, so the memory used stays constant regardless of the output length.
+If the disk can't keep up, write() waits until a block has been written out.
+*/
+
+namespace xenakios
+{
+class StreamingAudioFileWriter
+{
+  public:
+    enum class Format
+    {
+        WAV,
+        RF64,
+        W64,
+        RawPlanar
+    };
+    static Format formatFromName(const std::string &name)
+    {
+        if (name == "wav")
+            return Format::WAV;
+        if (name == "rf64")
+            return Format::RF64;
+        if (name == "w64")
+            return Format::W64;
+        if (name == "raw")
+            return Format::RawPlanar;
+        throw std::runtime_error(
+            std::format("Unknown audio file format \"{}\", should be wav, rf64, w64 or raw", name));
+    }
+
+    StreamingAudioFileWriter(std::string path, Format format, int numChannels, double sampleRate,
+                             uint64_t totalFrames = 0)
+        : m_path(std::move(path)), m_format(format), m_numChannels(numChannels),
+          m_sampleRate(sampleRate), m_totalFrames(totalFrames)
+    {
+        if (numChannels < 1 || numChannels > 65535)
+            throw std::runtime_error(std::format("Invalid channel count {}", numChannels));
+        if (format == Format::RawPlanar && totalFrames == 0)
+            throw std::runtime_error("The total frame count is needed for raw planar files");
+        m_stream.open(m_path, std::ios::binary | std::ios::trunc);
+        if (!m_stream)
+            throw std::runtime_error(std::format("Could not open {} for writing", m_path));
+        if (format == Format::WAV || format == Format::RF64)
+            writeWavHeader();
+        if (format == Format::W64)
+            writeW64Header();
+        if (format == Format::RawPlanar)
+            m_planarScratch.resize(numChannels);
+        m_dataStart = m_stream.tellp();
+    }
+    ~StreamingAudioFileWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+    StreamingAudioFileWriter(const StreamingAudioFileWriter &) = delete;
+    StreamingAudioFileWriter &operator=(const StreamingAudioFileWriter &) = delete;
+
+    int getNumChannels() const { return m_numChannels; }
+    uint64_t getNumFramesWritten() const { return m_framesWritten; }
+
+    void writeInterleaved(const float *data, int numFrames)
+    {
+        if (m_closed)
+            throw std::runtime_error("Writing to a closed audio file");
+        if (m_format == Format::RawPlanar)
+        {
+            if (m_framesWritten + numFrames > m_totalFrames)
+                throw std::runtime_error("Writing past the end of the raw planar file");
+            for (int ch = 0; ch < m_numChannels; ++ch)
+            {
+                auto &scratch = m_planarScratch[ch];
+                scratch.resize(numFrames);
+                for (int i = 0; i < numFrames; ++i)
+                    scratch[i] = data[i * m_numChannels + ch];
+                m_stream.seekp((ch * m_totalFrames + m_framesWritten) * sizeof(float));
+                m_stream.write((const char *)scratch.data(), numFrames * sizeof(float));
+            }
+        }
+        else
+        {
+            m_stream.write((const char *)data, (size_t)numFrames * m_numChannels * sizeof(float));
+        }
+        if (!m_stream)
+            throw std::runtime_error(std::format("Writing to {} failed", m_path));
+        m_framesWritten += numFrames;
+    }
+
+    // finalizes the headers, called by the destructor if not called before that
+    void close()
+    {
+        if (m_closed)
+            return;
+        m_closed = true;
+        if (m_format == Format::WAV || m_format == Format::RF64)
+            finishWavHeader();
+        if (m_format == Format::W64)
+            finishW64Header();
+        m_stream.close();
+        if (m_stream.fail())
+            throw std::runtime_error(std::format("Finishing {} failed", m_path));
+    }
+
+  private:
+    std::string m_path;
+    Format m_format;
+    int m_numChannels = 0;
+    double m_sampleRate = 0.0;
+    uint64_t m_totalFrames = 0;
+    uint64_t m_framesWritten = 0;
+    std::ofstream m_stream;
+    std::streamoff m_dataStart = 0;
+    bool m_closed = false;
+    std::vector<std::vector<float>> m_planarScratch;
+
+    static constexpr uint32_t riffJunkSize = 28;
+    static constexpr std::streamoff junkChunkPos = 12;
+    static constexpr uint8_t w64RiffGuid[16] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11,
+                                                0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+    static constexpr uint8_t w64WaveGuid[16] = {0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11,
+                                                0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+    static constexpr uint8_t w64FmtGuid[16] = {0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11,
+                                               0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+    static constexpr uint8_t w64DataGuid[16] = {0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11,
+                                                0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+    template <typename T> void writeLE(T value)
+    {
+        uint8_t bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i)
+            bytes[i] = (uint8_t)((uint64_t)value >> (8 * i));
+        m_stream.write((const char *)bytes, sizeof(T));
+    }
+    void writeTag(const char *tag) { m_stream.write(tag, 4); }
+
+    // WAVE_FORMAT_EXTENSIBLE with IEEE float samples, 40 bytes
+    void writeFmtData()
+    {
+        static constexpr uint8_t floatSubFormat[16] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                                       0x10, 0x00, 0x80, 0x00, 0x00, 0xAA,
+                                                       0x00, 0x38, 0x9B, 0x71};
+        writeLE<uint16_t>(0xFFFE);
+        writeLE<uint16_t>(m_numChannels);
+        writeLE<uint32_t>((uint32_t)m_sampleRate);
+        writeLE<uint32_t>((uint32_t)m_sampleRate * m_numChannels * 4);
+        writeLE<uint16_t>(m_numChannels * 4);
+        writeLE<uint16_t>(32);
+        writeLE<uint16_t>(22);
+        writeLE<uint16_t>(32);
+        writeLE<uint32_t>(0);
+        m_stream.write((const char *)floatSubFormat, 16);
+    }
+
+    void writeWavHeader()
+    {
+        writeTag(m_format == Format::RF64 ? "RF64" : "RIFF");
+        writeLE<uint32_t>(0xFFFFFFFF);
+        writeTag("WAVE");
+        // reserves the space for the ds64 chunk
+        writeTag(m_format == Format::RF64 ? "ds64" : "JUNK");
+        writeLE<uint32_t>(riffJunkSize);
+        for (uint32_t i = 0; i < riffJunkSize; ++i)
+            writeLE<uint8_t>(0);
+        writeTag("fmt ");
+        writeLE<uint32_t>(40);
+        writeFmtData();
+        writeTag("data");
+        writeLE<uint32_t>(0xFFFFFFFF);
+    }
+
+    void finishWavHeader()
+    {
+        uint64_t dataBytes = m_framesWritten * m_numChannels * sizeof(float);
+        if (dataBytes % 2 == 1)
+            writeLE<uint8_t>(0);
+        uint64_t riffSize = (uint64_t)m_stream.tellp() - 8;
+        bool needsRF64 = m_format == Format::RF64 || riffSize >= 0xFFFFFFFFull;
+        m_stream.seekp(0);
+        writeTag(needsRF64 ? "RF64" : "RIFF");
+        writeLE<uint32_t>(needsRF64 ? 0xFFFFFFFF : (uint32_t)riffSize);
+        if (needsRF64)
+        {
+            m_stream.seekp(junkChunkPos);
+            writeTag("ds64");
+            writeLE<uint32_t>(riffJunkSize);
+            writeLE<uint64_t>(riffSize);
+            writeLE<uint64_t>(dataBytes);
+            writeLE<uint64_t>(m_framesWritten);
+            writeLE<uint32_t>(0);
+        }
+        m_stream.seekp(m_dataStart - 4);
+        writeLE<uint32_t>(needsRF64 ? 0xFFFFFFFF : (uint32_t)dataBytes);
+    }
+
+    void writeW64Header()
+    {
+        m_stream.write((const char *)w64RiffGuid, 16);
+        writeLE<uint64_t>(0);
+        m_stream.write((const char *)w64WaveGuid, 16);
+        m_stream.write((const char *)w64FmtGuid, 16);
+        writeLE<uint64_t>(24 + 40);
+        writeFmtData();
+        m_stream.write((const char *)w64DataGuid, 16);
+        writeLE<uint64_t>(0);
+    }
+
+    void finishW64Header()
+    {
+        uint64_t dataBytes = m_framesWritten * m_numChannels * sizeof(float);
+        // chunks are aligned to 8 bytes
+        while (((uint64_t)m_stream.tellp()) % 8 != 0)
+            writeLE<uint8_t>(0);
+        uint64_t fileSize = m_stream.tellp();
+        m_stream.seekp(16);
+        writeLE<uint64_t>(fileSize);
+        m_stream.seekp(m_dataStart - 8);
+        writeLE<uint64_t>(24 + dataBytes);
+    }
+};
+
+class BackgroundAudioFileWriter
+{
+  public:
+    BackgroundAudioFileWriter(std::unique_ptr<StreamingAudioFileWriter> writer,
+                              int blockFrames = 4096, int numBlocks = 8)
+        : m_writer(std::move(writer)), m_blockFrames(blockFrames)
+    {
+        int numChannels = m_writer->getNumChannels();
+        m_blocks.resize(numBlocks);
+        for (auto &b : m_blocks)
+            b.data.resize((size_t)blockFrames * numChannels);
+        m_thread = std::thread{[this]() { threadRun(); }};
+    }
+    ~BackgroundAudioFileWriter()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+    }
+    BackgroundAudioFileWriter(const BackgroundAudioFileWriter &) = delete;
+    BackgroundAudioFileWriter &operator=(const BackgroundAudioFileWriter &) = delete;
+
+    // copies interleaved frames into the current block, waits for a free block if needed.
+    // rethrows errors that happened in the writer thread.
+    void write(const float *interleaved, int numFrames)
+    {
+        const int numChannels = m_writer->getNumChannels();
+        while (numFrames > 0)
+        {
+            auto &block = m_blocks[m_produceIndex];
+            int framesToCopy = std::min(numFrames, m_blockFrames - block.numFrames);
+            std::copy(interleaved, interleaved + framesToCopy * numChannels,
+                      block.data.begin() + block.numFrames * numChannels);
+            block.numFrames += framesToCopy;
+            interleaved += framesToCopy * numChannels;
+            numFrames -= framesToCopy;
+            if (block.numFrames == m_blockFrames)
+                submitBlock();
+        }
+    }
+
+    // writes the remaining frames, waits for the writer thread and finalizes the file
+    void finish()
+    {
+        if (m_finished)
+            return;
+        m_finished = true;
+        std::exception_ptr submitError;
+        try
+        {
+            if (m_blocks[m_produceIndex].numFrames > 0)
+                submitBlock();
+        }
+        catch (...)
+        {
+            submitError = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_stopRequested = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+        if (m_error)
+            std::rethrow_exception(m_error);
+        if (submitError)
+            std::rethrow_exception(submitError);
+        m_writer->close();
+    }
+
+  private:
+    struct Block
+    {
+        std::vector<float> data;
+        int numFrames = 0;
+    };
+    std::unique_ptr<StreamingAudioFileWriter> m_writer;
+    int m_blockFrames = 0;
+    std::vector<Block> m_blocks;
+    int m_produceIndex = 0;
+    int m_consumeIndex = 0;
+    int m_numFilled = 0;
+    bool m_stopRequested = false;
+    bool m_finished = false;
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+
+    void submitBlock()
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+        ++m_numFilled;
+        m_cv.notify_all();
+        m_produceIndex = (m_produceIndex + 1) % m_blocks.size();
+        m_cv.wait(locker, [this]() { return m_numFilled < (int)m_blocks.size() || m_error; });
+        if (m_error)
+            std::rethrow_exception(m_error);
+        m_blocks[m_produceIndex].numFrames = 0;
+    }
+
+    void threadRun()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            m_cv.wait(locker, [this]() { return m_numFilled > 0 || m_stopRequested; });
+            if (m_numFilled == 0 && m_stopRequested)
+                return;
+            auto &block = m_blocks[m_consumeIndex];
+            locker.unlock();
+            try
+            {
+                m_writer->writeInterleaved(block.data.data(), block.numFrames);
+            }
+            catch (...)
+            {
+                locker.lock();
+                m_error = std::current_exception();
+                m_cv.notify_all();
+                return;
+            }
+            locker.lock();
+            m_consumeIndex = (m_consumeIndex + 1) % m_blocks.size();
+            --m_numFilled;
+            m_cv.notify_all();
+        }
+    }
+};
+} // namespace xenakios
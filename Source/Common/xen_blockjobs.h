@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace xenakios
+{
+/*
+Runs a fixed set of jobs once per audio block on persistent worker threads and returns when all
+of them have finished, so the results can be combined after it like after a barrier. The calling
+thread works on the jobs too.
+
+Unpinned jobs are taken from a shared atomic counter by whichever thread gets to them first, so
+the load balances itself when the jobs take different amounts of time. Pinned jobs always run on
+their own dedicated thread, for plugins that expect to always be processed on the same thread.
+
+Running the jobs doesn't lock or allocate, the threads wait on atomics. Changing the jobs
+restarts the threads and must not be done while run is executing.
+*/
+class BlockJobRunner
+{
+  public:
+    using Job = std::function<void()>;
+    // numWorkers threads share the unpinned jobs with the thread calling run
+    explicit BlockJobRunner(int numWorkers) : m_numWorkers(std::max(numWorkers, 0)) {}
+    ~BlockJobRunner() { stopThreads(); }
+    BlockJobRunner(const BlockJobRunner &) = delete;
+    BlockJobRunner &operator=(const BlockJobRunner &) = delete;
+
+    void setJobs(std::vector<Job> jobs, const std::vector<bool> &pinned)
+    {
+        stopThreads();
+        m_sharedJobs.clear();
+        m_pinnedJobs.clear();
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            if (i < pinned.size() && pinned[i])
+                m_pinnedJobs.push_back(std::move(jobs[i]));
+            else
+                m_sharedJobs.push_back(std::move(jobs[i]));
+        }
+        m_numJobs = m_sharedJobs.size() + m_pinnedJobs.size();
+        m_nextJob = m_sharedJobs.size();
+        m_quit = false;
+        uint64_t generation = m_generation.load();
+        // no point having more workers than there are jobs left for them by the calling thread
+        size_t numShared =
+            std::min<size_t>(m_numWorkers, std::max<size_t>(m_sharedJobs.size(), 1) - 1);
+        for (size_t i = 0; i < numShared; ++i)
+        {
+            m_threads.emplace_back([this, generation] {
+                uint64_t seen = generation;
+                while (waitForBlock(seen))
+                    runSharedJobs();
+            });
+        }
+        for (auto &job : m_pinnedJobs)
+        {
+            m_threads.emplace_back([this, generation, &job] {
+                uint64_t seen = generation;
+                while (waitForBlock(seen))
+                {
+                    job();
+                    jobFinished();
+                }
+            });
+        }
+    }
+    size_t getNumJobs() const { return m_numJobs; }
+    size_t getNumThreads() const { return m_threads.size(); }
+
+    void run()
+    {
+        if (m_numJobs == 0)
+            return;
+        m_numDone.store(0);
+        m_nextJob.store(0);
+        m_generation.fetch_add(1);
+        m_generation.notify_all();
+        runSharedJobs();
+        size_t done = m_numDone.load();
+        while (done < m_numJobs)
+        {
+            m_numDone.wait(done);
+            done = m_numDone.load();
+        }
+    }
+
+  private:
+    // returns false when the thread should quit
+    bool waitForBlock(uint64_t &seen)
+    {
+        m_generation.wait(seen);
+        seen = m_generation.load();
+        return !m_quit.load();
+    }
+    void runSharedJobs()
+    {
+        size_t index = m_nextJob.fetch_add(1);
+        while (index < m_sharedJobs.size())
+        {
+            m_sharedJobs[index]();
+            jobFinished();
+            index = m_nextJob.fetch_add(1);
+        }
+    }
+    void jobFinished()
+    {
+        m_numDone.fetch_add(1);
+        m_numDone.notify_one();
+    }
+    void stopThreads()
+    {
+        m_quit = true;
+        m_generation.fetch_add(1);
+        m_generation.notify_all();
+        for (auto &th : m_threads)
+            th.join();
+        m_threads.clear();
+    }
+    int m_numWorkers = 0;
+    std::vector<Job> m_sharedJobs;
+    // not reallocated while the threads are running, the pinned threads refer to the elements
+    std::vector<Job> m_pinnedJobs;
+    size_t m_numJobs = 0;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<size_t> m_nextJob{0};
+    std::atomic<size_t> m_numDone{0};
+    std::atomic<bool> m_quit{false};
+};
+} // namespace xenakios
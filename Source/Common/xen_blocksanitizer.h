@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+
+/*
+Post-processing for rendered interleaved audio blocks : replaces NaNs, infinities and denormals
+with zeros, optionally limits the output and keeps diagnostics of what it found, so that a
+misbehaving DSP stage doesn't have to abort a long render.
+
+The checks are done with AVX compares on the block as a flat array, the per sample work is
+only done for the (hopefully rare) vectors that have invalid samples in them. The per channel
+peaks are accumulated over a period of lcm(stride, 8) samples, so that each vector lane always
+maps to the same channel and no scalar work is needed for them either.
+*/
+
+namespace xenakios
+{
+
+class BlockSanitizer
+{
+  public:
+    enum class Limiter
+    {
+        None,
+        // clamps to -1..1
+        Hard,
+        // passes signals below the knee unchanged and smoothly approaches 1 above it
+        Soft
+    };
+    struct Diagnostics
+    {
+        uint64_t numNaNs = 0;
+        uint64_t numInfs = 0;
+        uint64_t numDenormals = 0;
+        int64_t firstBadFrame = -1;
+        int firstBadChannel = -1;
+        // samples that were over 1.0 in magnitude before limiting
+        uint64_t numOvers = 0;
+        // per channel peak magnitudes of the valid samples before limiting
+        std::vector<float> peaks;
+        uint64_t getNumBadSamples() const { return numNaNs + numInfs + numDenormals; }
+    };
+    static Limiter limiterFromName(const std::string &name)
+    {
+        if (name == "none")
+            return Limiter::None;
+        if (name == "hard")
+            return Limiter::Hard;
+        if (name == "soft")
+            return Limiter::Soft;
+        throw std::runtime_error(
+            std::format("unknown limiter {}, must be none, hard or soft", name));
+    }
+
+    BlockSanitizer(int numChannels, Limiter limiter = Limiter::Hard, float softKnee = 0.75f)
+        : m_limiter(limiter), m_knee(std::clamp(softKnee, 0.0f, 0.99f))
+    {
+        m_diag.peaks.resize(numChannels);
+    }
+
+    // Processes numFrames frames in place. stride is the distance between frames, of which the
+    // first numChannels channels are diagnosed (all are sanitized). framePos is the position
+    // of the block in the whole output, for the diagnostics.
+    void process(float *block, int stride, int numFrames, int64_t framePos)
+    {
+        if (stride != m_stride)
+            setStride(stride);
+        const size_t numSamples = (size_t)numFrames * stride;
+        const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        const __m256 minnormal = _mm256_set1_ps(std::numeric_limits<float>::min());
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        size_t i = 0;
+        size_t periodpos = 0;
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(block + i);
+            __m256 ax = _mm256_and_ps(x, absmask);
+            // false for NaNs too
+            __m256 finite = _mm256_cmp_ps(ax, inf, _CMP_LT_OQ);
+            __m256 denormal = _mm256_and_ps(_mm256_cmp_ps(ax, minnormal, _CMP_LT_OQ),
+                                            _mm256_cmp_ps(ax, zero, _CMP_NEQ_OQ));
+            __m256 valid = _mm256_andnot_ps(denormal, finite);
+            if (_mm256_movemask_ps(valid) != 0xff)
+            {
+                handleBadSamples(block, i, 8, framePos);
+                x = _mm256_loadu_ps(block + i);
+                ax = _mm256_and_ps(x, absmask);
+            }
+            float *acc = m_peakAcc.data() + periodpos;
+            _mm256_storeu_ps(acc, _mm256_max_ps(_mm256_loadu_ps(acc), ax));
+            m_diag.numOvers += std::popcount(
+                (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(ax, one, _CMP_GT_OQ)));
+            _mm256_storeu_ps(block + i, limit(x));
+            periodpos += 8;
+            if (periodpos == m_peakAcc.size())
+                periodpos = 0;
+        }
+        if (i < numSamples)
+        {
+            handleBadSamples(block, i, numSamples - i, framePos);
+            for (; i < numSamples; ++i)
+            {
+                float ax = std::abs(block[i]);
+                m_peakAcc[periodpos] = std::max(m_peakAcc[periodpos], ax);
+                if (ax > 1.0f)
+                    ++m_diag.numOvers;
+                block[i] = limitScalar(block[i]);
+                ++periodpos;
+            }
+        }
+    }
+
+    const Diagnostics &getDiagnostics()
+    {
+        foldPeaks();
+        return m_diag;
+    }
+
+  private:
+    void setStride(int stride)
+    {
+        foldPeaks();
+        m_stride = stride;
+        m_peakAcc.assign(std::lcm(stride, 8), 0.0f);
+    }
+    void foldPeaks()
+    {
+        for (size_t i = 0; i < m_peakAcc.size(); ++i)
+        {
+            size_t ch = i % m_stride;
+            if (ch < m_diag.peaks.size())
+                m_diag.peaks[ch] = std::max(m_diag.peaks[ch], m_peakAcc[i]);
+            m_peakAcc[i] = 0.0f;
+        }
+    }
+    void handleBadSamples(float *block, size_t start, size_t count, int64_t framePos)
+    {
+        for (size_t i = start; i < start + count; ++i)
+        {
+            float x = block[i];
+            bool nan = std::isnan(x);
+            bool inf = std::isinf(x);
+            bool denormal = std::fpclassify(x) == FP_SUBNORMAL;
+            if (!nan && !inf && !denormal)
+                continue;
+            block[i] = 0.0f;
+            size_t ch = i % m_stride;
+            if (ch >= m_diag.peaks.size())
+                continue;
+            m_diag.numNaNs += nan;
+            m_diag.numInfs += inf;
+            m_diag.numDenormals += denormal;
+            if (m_diag.firstBadFrame < 0)
+            {
+                m_diag.firstBadFrame = framePos + i / m_stride;
+                m_diag.firstBadChannel = ch;
+            }
+        }
+    }
+    __m256 limit(__m256 x) const
+    {
+        if (m_limiter == Limiter::Hard)
+            return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+        if (m_limiter == Limiter::None)
+            return x;
+        // above the knee k : k + (1 - k) * t / (1 + t), with t = (|x| - k) / (1 - k)
+        const __m256 signmask = _mm256_set1_ps(-0.0f);
+        const __m256 k = _mm256_set1_ps(m_knee);
+        const __m256 range = _mm256_set1_ps(1.0f - m_knee);
+        __m256 sign = _mm256_and_ps(x, signmask);
+        __m256 ax = _mm256_andnot_ps(signmask, x);
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(ax, k), range);
+        __m256 soft = _mm256_fmadd_ps(
+            range, _mm256_div_ps(t, _mm256_add_ps(_mm256_set1_ps(1.0f), t)), k);
+        __m256 y = _mm256_blendv_ps(ax, soft, _mm256_cmp_ps(ax, k, _CMP_GT_OQ));
+        return _mm256_or_ps(y, sign);
+    }
+    float limitScalar(float x) const
+    {
+        if (m_limiter == Limiter::Hard)
+            return std::clamp(x, -1.0f, 1.0f);
+        float ax = std::abs(x);
+        if (m_limiter == Limiter::None || ax <= m_knee)
+            return x;
+        float t = (ax - m_knee) / (1.0f - m_knee);
+        return std::copysign(m_knee + (1.0f - m_knee) * t / (1.0f + t), x);
+    }
+
+    Limiter m_limiter = Limiter::Hard;
+    float m_knee = 0.75f;
+    int m_stride = 0;
+    std::vector<float> m_peakAcc;
+    Diagnostics m_diag;
+};
+
+} // namespace xenakios
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace xenakios
+{
+/*
+Integer sample frame positions for the timestamps of a sorted event list, shared by the sample
+time iterators of the sequence classes. An event at time t belongs to frame floor(t * sampleRate),
+which gives exactly the same results as comparing t * sampleRate against the integer frame
+positions, like the iterators used to do for every event they looked at.
+
+Seeks search outwards from the previous position, doubling the step, so reading consecutive
+blocks stays constant time and jumping around in a long sequence is logarithmic.
+
+The index is built once, when the iterator is created, because building it allocates. It
+remembers the modification count of the sequence it was built from, so that the iterators can
+tell when the sequence has changed under them.
+*/
+// Modification count of a sequence. Assigning another sequence over one is a modification too,
+// so assignments increment the count instead of copying the other sequence's count, which
+// could happen to be the count an iterator of this sequence was built for.
+class ModificationCounter
+{
+  public:
+    ModificationCounter() = default;
+    ModificationCounter(const ModificationCounter &) {}
+    ModificationCounter &operator=(const ModificationCounter &)
+    {
+        ++m_count;
+        return *this;
+    }
+    void increment() { ++m_count; }
+    uint64_t get() const { return m_count; }
+
+  private:
+    uint64_t m_count = 0;
+};
+
+class SampleFrameIndex
+{
+  public:
+    static int64_t toFrame(double timestamp, double sampleRate)
+    {
+        double frame = std::floor(timestamp * sampleRate);
+        if (frame >= 9.2e18)
+            return std::numeric_limits<int64_t>::max();
+        // also catches NaNs
+        if (!(frame > -9.2e18))
+            return std::numeric_limits<int64_t>::min();
+        return (int64_t)frame;
+    }
+    template <typename Event, typename GetTime>
+    void build(const Event *events, size_t numEvents, double sampleRate, uint64_t modificationCount,
+               GetTime getTime)
+    {
+        m_frames.resize(numEvents);
+        for (size_t i = 0; i < numEvents; ++i)
+            m_frames[i] = toFrame(getTime(events[i]), sampleRate);
+        m_modificationCount = modificationCount;
+    }
+    bool isValidFor(uint64_t modificationCount) const
+    {
+        return modificationCount == m_modificationCount;
+    }
+    size_t size() const { return m_frames.size(); }
+    // index of the first event at or after the frame, searching from hint
+    size_t findFirstAtOrAfter(int64_t frame, size_t hint) const
+    {
+        const size_t n = m_frames.size();
+        hint = std::min(hint, n);
+        size_t lo = 0;
+        size_t hi = 0;
+        size_t step = 1;
+        if (hint < n && m_frames[hint] < frame)
+        {
+            lo = hint + 1;
+            hi = lo;
+            while (hi < n && m_frames[hi] < frame)
+            {
+                lo = hi + 1;
+                step *= 2;
+                hi = std::min(n, lo + step);
+            }
+        }
+        else if (hint > 0 && m_frames[hint - 1] >= frame)
+        {
+            hi = hint - 1;
+            lo = hi;
+            while (lo > 0 && m_frames[lo - 1] >= frame)
+            {
+                hi = lo - 1;
+                step *= 2;
+                lo = hi >= step ? hi - step : 0;
+            }
+        }
+        else
+            return hint;
+        return std::lower_bound(m_frames.begin() + lo, m_frames.begin() + hi, frame) -
+               m_frames.begin();
+    }
+
+  private:
+    std::vector<int64_t> m_frames;
+    uint64_t m_modificationCount = 0;
+};
+} // namespace xenakios
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <xmmintrin.h>
+
+namespace xenakios
+{
+/*
+Conversions between the planar buffers the engine processes and the interleaved buffers of the
+audio devices, for any number of channels. Groups of 4 channels are moved 4 frames at a time with
+SSE transposes, the remaining channels and frames one sample at a time.
+*/
+
+// Writes numChannels interleaved channels from the planar sources, clamped to -1..1. A source
+// can be the same silent buffer for several device channels.
+inline void interleaveClamped(const float *const *sources, uint32_t numChannels, float *dest,
+                              uint32_t numFrames)
+{
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    auto clamp4 = [&](const float *src) {
+        return _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), lo), hi);
+    };
+    uint32_t ch = 0;
+    const uint32_t vecFrames = numFrames & ~3u;
+    for (; ch + 4 <= numChannels; ch += 4)
+    {
+        for (uint32_t i = 0; i < vecFrames; i += 4)
+        {
+            __m128 r0 = clamp4(sources[ch] + i);
+            __m128 r1 = clamp4(sources[ch + 1] + i);
+            __m128 r2 = clamp4(sources[ch + 2] + i);
+            __m128 r3 = clamp4(sources[ch + 3] + i);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dest + (i + 0) * numChannels + ch, r0);
+            _mm_storeu_ps(dest + (i + 1) * numChannels + ch, r1);
+            _mm_storeu_ps(dest + (i + 2) * numChannels + ch, r2);
+            _mm_storeu_ps(dest + (i + 3) * numChannels + ch, r3);
+        }
+    }
+    if (ch + 2 <= numChannels)
+    {
+        for (uint32_t i = 0; i < vecFrames; i += 4)
+        {
+            __m128 left = clamp4(sources[ch] + i);
+            __m128 right = clamp4(sources[ch + 1] + i);
+            if (numChannels == 2)
+            {
+                _mm_storeu_ps(dest + i * 2, _mm_unpacklo_ps(left, right));
+                _mm_storeu_ps(dest + i * 2 + 4, _mm_unpackhi_ps(left, right));
+                continue;
+            }
+            float pairs[8];
+            _mm_storeu_ps(pairs, _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(pairs + 4, _mm_unpackhi_ps(left, right));
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                dest[(i + j) * numChannels + ch] = pairs[j * 2];
+                dest[(i + j) * numChannels + ch + 1] = pairs[j * 2 + 1];
+            }
+        }
+        ch += 2;
+    }
+    for (; ch < numChannels; ++ch)
+    {
+        for (uint32_t i = 0; i < vecFrames; ++i)
+            dest[i * numChannels + ch] = std::clamp(sources[ch][i], -1.0f, 1.0f);
+    }
+    for (uint32_t i = vecFrames; i < numFrames; ++i)
+    {
+        for (uint32_t c = 0; c < numChannels; ++c)
+            dest[i * numChannels + c] = std::clamp(sources[c][i], -1.0f, 1.0f);
+    }
+}
+
+// Splits numChannels interleaved channels into the planar destinations.
+inline void deinterleave(const float *src, uint32_t numChannels, float *const *dests,
+                         uint32_t numFrames)
+{
+    uint32_t ch = 0;
+    const uint32_t vecFrames = numFrames & ~3u;
+    for (; ch + 4 <= numChannels; ch += 4)
+    {
+        for (uint32_t i = 0; i < vecFrames; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(src + (i + 0) * numChannels + ch);
+            __m128 r1 = _mm_loadu_ps(src + (i + 1) * numChannels + ch);
+            __m128 r2 = _mm_loadu_ps(src + (i + 2) * numChannels + ch);
+            __m128 r3 = _mm_loadu_ps(src + (i + 3) * numChannels + ch);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dests[ch] + i, r0);
+            _mm_storeu_ps(dests[ch + 1] + i, r1);
+            _mm_storeu_ps(dests[ch + 2] + i, r2);
+            _mm_storeu_ps(dests[ch + 3] + i, r3);
+        }
+    }
+    for (; ch < numChannels; ++ch)
+    {
+        for (uint32_t i = 0; i < vecFrames; ++i)
+            dests[ch][i] = src[i * numChannels + ch];
+    }
+    for (uint32_t i = vecFrames; i < numFrames; ++i)
+    {
+        for (uint32_t c = 0; c < numChannels; ++c)
+            dests[c][i] = src[i * numChannels + c];
+    }
+}
+} // namespace xenakios
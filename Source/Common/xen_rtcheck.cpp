@@ -0,0 +1,312 @@
+#include "xen_rtcheck.h"
+
+#ifdef XEN_RTCHECK
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <version>
+#ifdef __cpp_lib_stacktrace
+#include <stacktrace>
+#endif
+#ifdef __linux__
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace xenakios::rtcheck
+{
+namespace
+{
+thread_local int t_audioDepth = 0;
+thread_local int t_allowDepth = 0;
+// set while a violation is being recorded, the recording itself allocates and locks
+thread_local bool t_inReport = false;
+
+struct State
+{
+    std::mutex mutex;
+    std::unordered_map<std::string, ViolationInfo> violations;
+    std::atomic<uint64_t> numViolations{0};
+    std::atomic<bool> abortOnViolation{false};
+    State()
+    {
+        if (auto env = std::getenv("XEN_RTCHECK_ABORT"); env && env[0] == '1')
+            abortOnViolation = true;
+    }
+};
+
+// intentionally leaked so that it stays valid during static destruction
+State &getState()
+{
+    static State *state = new State;
+    return *state;
+}
+
+const char *violationTypeName(ViolationType t)
+{
+    switch (t)
+    {
+    case ViolationType::Allocation:
+        return "allocation";
+    case ViolationType::Deallocation:
+        return "deallocation";
+    case ViolationType::MutexLock:
+        return "mutex lock";
+    case ViolationType::BlockingCall:
+        return "blocking call";
+    }
+    return "unknown";
+}
+
+struct ShutdownReporter
+{
+    ~ShutdownReporter()
+    {
+        if (getNumViolations() > 0)
+            std::fputs(getReport().c_str(), stderr);
+    }
+};
+ShutdownReporter g_shutdownReporter;
+} // namespace
+
+ScopedAudioThread::ScopedAudioThread() { ++t_audioDepth; }
+ScopedAudioThread::~ScopedAudioThread() { --t_audioDepth; }
+ScopedAllowUnsafe::ScopedAllowUnsafe() { ++t_allowDepth; }
+ScopedAllowUnsafe::~ScopedAllowUnsafe() { --t_allowDepth; }
+
+bool isAudioThread() { return t_audioDepth > 0; }
+
+void reportViolation(ViolationType type, const char *description)
+{
+    if (t_audioDepth == 0 || t_allowDepth > 0 || t_inReport)
+        return;
+    t_inReport = true;
+    auto &state = getState();
+    std::string trace;
+#ifdef __cpp_lib_stacktrace
+    // skip this function itself
+    trace = std::to_string(std::stacktrace::current(1));
+#else
+    trace = "<stack traces not supported by the standard library>";
+#endif
+    ++state.numViolations;
+    {
+        std::lock_guard<std::mutex> locker(state.mutex);
+        auto key = std::format("{}|{}|{}", (int)type, description, trace);
+        auto &info = state.violations[key];
+        if (info.count == 0)
+        {
+            info.type = type;
+            info.description = description;
+            info.stacktrace = trace;
+        }
+        ++info.count;
+    }
+    if (state.abortOnViolation)
+    {
+        std::fputs(std::format("realtime violation ({}) : {}\n{}\n", violationTypeName(type),
+                               description, trace)
+                       .c_str(),
+                   stderr);
+        std::abort();
+    }
+    t_inReport = false;
+}
+
+void setAbortOnViolation(bool b) { getState().abortOnViolation = b; }
+
+uint64_t getNumViolations() { return getState().numViolations.load(); }
+
+std::vector<ViolationInfo> getViolations()
+{
+    auto &state = getState();
+    std::lock_guard<std::mutex> locker(state.mutex);
+    std::vector<ViolationInfo> result;
+    result.reserve(state.violations.size());
+    for (auto &e : state.violations)
+        result.push_back(e.second);
+    std::sort(result.begin(), result.end(),
+              [](const auto &lhs, const auto &rhs) { return lhs.count > rhs.count; });
+    return result;
+}
+
+std::string getReport()
+{
+    auto violations = getViolations();
+    std::string result = std::format("realtime safety check : {} violations at {} call sites\n",
+                                     getNumViolations(), violations.size());
+    for (auto &v : violations)
+    {
+        result += std::format("--- {} : {} ({} times)\n{}\n", violationTypeName(v.type),
+                              v.description, v.count, v.stacktrace);
+    }
+    return result;
+}
+
+void clearViolations()
+{
+    auto &state = getState();
+    std::lock_guard<std::mutex> locker(state.mutex);
+    state.violations.clear();
+    state.numViolations = 0;
+}
+} // namespace xenakios::rtcheck
+
+using xenakios::rtcheck::reportViolation;
+using xenakios::rtcheck::ViolationType;
+
+namespace
+{
+void *rtcheck_alloc(std::size_t sz, std::size_t alignment)
+{
+    reportViolation(ViolationType::Allocation, "operator new");
+    if (sz == 0)
+        sz = 1;
+    void *result = nullptr;
+    if (alignment <= alignof(std::max_align_t))
+        result = std::malloc(sz);
+    else
+    {
+#ifdef _WIN32
+        result = _aligned_malloc(sz, alignment);
+#else
+        if (posix_memalign(&result, alignment, sz) != 0)
+            result = nullptr;
+#endif
+    }
+    return result;
+}
+
+void rtcheck_free(void *ptr, std::size_t alignment)
+{
+    if (!ptr)
+        return;
+    reportViolation(ViolationType::Deallocation, "operator delete");
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t))
+    {
+        _aligned_free(ptr);
+        return;
+    }
+#endif
+    std::free(ptr);
+}
+} // namespace
+
+void *operator new(std::size_t sz)
+{
+    if (auto p = rtcheck_alloc(sz, 0))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t sz)
+{
+    if (auto p = rtcheck_alloc(sz, 0))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new(std::size_t sz, std::align_val_t al)
+{
+    if (auto p = rtcheck_alloc(sz, (std::size_t)al))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t sz, std::align_val_t al)
+{
+    if (auto p = rtcheck_alloc(sz, (std::size_t)al))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new(std::size_t sz, const std::nothrow_t &) noexcept
+{
+    return rtcheck_alloc(sz, 0);
+}
+void *operator new[](std::size_t sz, const std::nothrow_t &) noexcept
+{
+    return rtcheck_alloc(sz, 0);
+}
+void *operator new(std::size_t sz, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    return rtcheck_alloc(sz, (std::size_t)al);
+}
+void *operator new[](std::size_t sz, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+    return rtcheck_alloc(sz, (std::size_t)al);
+}
+void operator delete(void *p) noexcept { rtcheck_free(p, 0); }
+void operator delete[](void *p) noexcept { rtcheck_free(p, 0); }
+void operator delete(void *p, std::size_t) noexcept { rtcheck_free(p, 0); }
+void operator delete[](void *p, std::size_t) noexcept { rtcheck_free(p, 0); }
+void operator delete(void *p, std::align_val_t al) noexcept { rtcheck_free(p, (std::size_t)al); }
+void operator delete[](void *p, std::align_val_t al) noexcept
+{
+    rtcheck_free(p, (std::size_t)al);
+}
+void operator delete(void *p, std::size_t, std::align_val_t al) noexcept
+{
+    rtcheck_free(p, (std::size_t)al);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t al) noexcept
+{
+    rtcheck_free(p, (std::size_t)al);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept { rtcheck_free(p, 0); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { rtcheck_free(p, 0); }
+
+#ifdef __linux__
+// interpose some libc/libpthread functions, the real implementations are looked up lazily
+template <typename F> F rtcheck_next(F &cached, const char *name)
+{
+    if (!cached)
+        cached = (F)dlsym(RTLD_NEXT, name);
+    return cached;
+}
+
+extern "C"
+{
+    int pthread_mutex_lock(pthread_mutex_t *m)
+    {
+        static int (*real)(pthread_mutex_t *) = nullptr;
+        reportViolation(ViolationType::MutexLock, "pthread_mutex_lock");
+        return rtcheck_next(real, "pthread_mutex_lock")(m);
+    }
+    int nanosleep(const struct timespec *req, struct timespec *rem)
+    {
+        static int (*real)(const struct timespec *, struct timespec *) = nullptr;
+        reportViolation(ViolationType::BlockingCall, "nanosleep");
+        return rtcheck_next(real, "nanosleep")(req, rem);
+    }
+    int usleep(useconds_t usec)
+    {
+        static int (*real)(useconds_t) = nullptr;
+        reportViolation(ViolationType::BlockingCall, "usleep");
+        return rtcheck_next(real, "usleep")(usec);
+    }
+    ssize_t read(int fd, void *buf, size_t count)
+    {
+        static ssize_t (*real)(int, void *, size_t) = nullptr;
+        reportViolation(ViolationType::BlockingCall, "read");
+        return rtcheck_next(real, "read")(fd, buf, count);
+    }
+    ssize_t write(int fd, const void *buf, size_t count)
+    {
+        static ssize_t (*real)(int, const void *, size_t) = nullptr;
+        reportViolation(ViolationType::BlockingCall, "write");
+        return rtcheck_next(real, "write")(fd, buf, count);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Realtime safety checking for the audio threads.
+
+Only active when building with XEN_RTCHECK defined (the CMake option XEN_RTCHECK), otherwise
+all the macros below expand to nothing and there is no cost.
+
+While an XEN_RTCHECK_AUDIO_SCOPE is alive on a thread, heap allocations/deallocations via
+operator new/delete, mutex locks and some blocking system calls made from that thread are
+recorded as violations with a stack trace (where the standard library supports that).
+Identical violations are only stored once with a hit count. A report is printed at program
+shutdown and can also be requested with xenakios::rtcheck::getReport.
+
+Operator new/delete are intercepted on all platforms. On Linux pthread_mutex_lock, the sleep
+functions and file read/write are also interposed. XEN_RTCHECK_BLOCKING is only for blocking
+calls that aren't intercepted, like the calls of a platform API. Marking an intercepted call,
+for example a std::mutex lock, would report it twice on Linux.
+
+Setting the environment variable XEN_RTCHECK_ABORT=1 or calling setAbortOnViolation(true)
+makes the first violation abort the program, which is handy for tests.
+*/
+
+namespace xenakios::rtcheck
+{
+enum class ViolationType
+{
+    Allocation,
+    Deallocation,
+    MutexLock,
+    BlockingCall
+};
+
+struct ViolationInfo
+{
+    ViolationType type = ViolationType::Allocation;
+    std::string description;
+    std::string stacktrace;
+    uint64_t count = 0;
+};
+
+#ifdef XEN_RTCHECK
+// marks the current thread as an audio thread for the lifetime of the object, can be nested
+struct ScopedAudioThread
+{
+    ScopedAudioThread();
+    ~ScopedAudioThread();
+    ScopedAudioThread(const ScopedAudioThread &) = delete;
+    ScopedAudioThread &operator=(const ScopedAudioThread &) = delete;
+};
+
+// suspends the checking on the current thread, for code paths known to be unsafe that
+// haven't been fixed yet
+struct ScopedAllowUnsafe
+{
+    ScopedAllowUnsafe();
+    ~ScopedAllowUnsafe();
+    ScopedAllowUnsafe(const ScopedAllowUnsafe &) = delete;
+    ScopedAllowUnsafe &operator=(const ScopedAllowUnsafe &) = delete;
+};
+
+bool isAudioThread();
+void reportViolation(ViolationType type, const char *description);
+void setAbortOnViolation(bool b);
+uint64_t getNumViolations();
+std::vector<ViolationInfo> getViolations();
+std::string getReport();
+void clearViolations();
+
+#define XEN_RTCHECK_CONCAT_IMPL(a, b) a##b
+#define XEN_RTCHECK_CONCAT(a, b) XEN_RTCHECK_CONCAT_IMPL(a, b)
+#define XEN_RTCHECK_AUDIO_SCOPE                                                                   \
+    xenakios::rtcheck::ScopedAudioThread XEN_RTCHECK_CONCAT(rtcheck_scope_, __LINE__)
+#define XEN_RTCHECK_ALLOW_UNSAFE                                                                  \
+    xenakios::rtcheck::ScopedAllowUnsafe XEN_RTCHECK_CONCAT(rtcheck_allow_, __LINE__)
+#define XEN_RTCHECK_BLOCKING(description)                                                         \
+    xenakios::rtcheck::reportViolation(xenakios::rtcheck::ViolationType::BlockingCall,           \
+                                       description)
+#else
+#define XEN_RTCHECK_AUDIO_SCOPE
+#define XEN_RTCHECK_ALLOW_UNSAFE
+#define XEN_RTCHECK_BLOCKING(description)
+#endif
+} // namespace xenakios::rtcheck
@@ -528,7 +528,7 @@ inline void generateSequenceFromScore(const choc::value::ValueView &score,
 {
     using clock = std::chrono::system_clock;
     const auto start_time = clock::now();
-    sequence.m_evlist.clear();
+    sequence.clearEvents();
     int noteid = 0;
     double curvestart = 0.0;
     double curve_end = 0.0;
@@ -1286,7 +1286,7 @@ inline void test_seq_to_json()
     }
 }
 
-void run_tests();
+bool run_tests(bool regenerate_golden);
 
 inline void test_mts_esp_wrapper()
 {
@@ -1989,6 +1989,11 @@ inline void test_choc_execute()
 
 int main(int argc, char **argv)
 {
+    if (argc >= 2 && std::string(argv[1]) == "--run-tests")
+    {
+        // non-zero on failures, so that CI sees them
+        return run_tests(argc >= 3 && std::string(argv[2]) == "--regenerate-golden") ? 0 : 1;
+    }
     test_choc_execute();
     // if (argc >= 2)
     //     return test_choc_subprocess(atoi(argv[1]));
@@ -2010,7 +2015,6 @@ int main(int argc, char **argv)
     // test_clap_engine_multichain();
     // test_vec();
     // test_mts_esp_wrapper();
-    // run_tests();
     // test_seq_to_json();
     // test_param_origin();
 
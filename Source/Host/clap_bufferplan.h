@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+#include "clap/audio-buffer.h"
+#include "clap/id.h"
+
+/*
+Buffer layout for processing a chain of plugins in series, computed when the chain is activated
+so that processing a block only hands out pointers that already exist.
+
+The main ports (index 0) are fed through two buffers the processors ping-pong between, so the
+output of a processor is the input of the next one without copying. A plugin that declares its
+main output as the in-place pair of its main input gets the same memory for both, and the signal
+stays in the buffer it was in. Input ports above 0 read the chain input routed to them. Output
+ports above 0 share scratch memory, only the extra outputs of the last processor can be routed
+out of the chain.
+
+Nothing is cleared every block except the main input channels that the previous stage didn't
+write, the processors overwrite everything else. The chain outputs are routed so that the first
+connection into a channel copies and the following ones add, so they don't need clearing either.
+*/
+class ChainBufferPlan
+{
+  public:
+    struct Port
+    {
+        uint32_t channels = 0;
+        clap_id id = CLAP_INVALID_ID;
+        // for outputs, the id of the input port the plugin can process in place with
+        clap_id inPlacePair = CLAP_INVALID_ID;
+    };
+    struct ProcessorPorts
+    {
+        std::vector<Port> inputs;
+        std::vector<Port> outputs;
+    };
+    // (source channel, destination port, destination channel) for the chain input and
+    // (source port, source channel, destination channel) for the chain output
+    using Routing = std::vector<std::tuple<int, int, int>>;
+
+    struct Step
+    {
+        std::vector<clap_audio_buffer> inputs;
+        std::vector<clap_audio_buffer> outputs;
+        std::vector<float *> inputChannels;
+        std::vector<float *> outputChannels;
+        std::vector<float *> clearBeforeProcess;
+        int mainInputBuffer = -1;
+        int mainOutputBuffer = -1;
+        bool inPlace = false;
+    };
+    struct OutputConnection
+    {
+        // nullptr when the routed channel doesn't exist, the destination then gets silence
+        const float *source = nullptr;
+        int destChannel = 0;
+        bool add = false;
+    };
+
+    void build(const std::vector<ProcessorPorts> &processors, const Routing &inputRouting,
+               const Routing &outputRouting, uint32_t maxFrames)
+    {
+        m_maxFrames = maxFrames;
+        m_steps.clear();
+        m_routedInputs.clear();
+        m_outputConnections.clear();
+
+        uint32_t mainChannels = 2;
+        std::vector<uint32_t> auxInChannels;
+        std::vector<uint32_t> auxOutChannels;
+        auto growPorts = [](std::vector<uint32_t> &sizes, size_t port, uint32_t channels) {
+            if (port == 0)
+                return;
+            if (sizes.size() < port)
+                sizes.resize(port, 0);
+            sizes[port - 1] = std::max(sizes[port - 1], channels);
+        };
+        for (auto &proc : processors)
+        {
+            for (size_t i = 0; i < proc.inputs.size(); ++i)
+            {
+                if (i == 0)
+                    mainChannels = std::max(mainChannels, proc.inputs[0].channels);
+                growPorts(auxInChannels, i, proc.inputs[i].channels);
+            }
+            for (size_t i = 0; i < proc.outputs.size(); ++i)
+            {
+                if (i == 0)
+                    mainChannels = std::max(mainChannels, proc.outputs[0].channels);
+                growPorts(auxOutChannels, i, proc.outputs[i].channels);
+            }
+        }
+        for (auto &conn : inputRouting)
+        {
+            auto [srcChan, destPort, destChan] = conn;
+            if (destPort < 0 || destChan < 0)
+                continue;
+            if (destPort == 0)
+                mainChannels = std::max<uint32_t>(mainChannels, destChan + 1);
+            growPorts(auxInChannels, destPort, destChan + 1);
+        }
+
+        // all the channels live in one allocation, laid out main 0, main 1, aux ins, aux outs
+        m_mainChannels = mainChannels;
+        m_auxInOffsets.assign(auxInChannels.size() + 1, 0);
+        for (size_t i = 0; i < auxInChannels.size(); ++i)
+            m_auxInOffsets[i + 1] = m_auxInOffsets[i] + auxInChannels[i];
+        m_auxOutOffsets.assign(auxOutChannels.size() + 1, 0);
+        for (size_t i = 0; i < auxOutChannels.size(); ++i)
+            m_auxOutOffsets[i + 1] = m_auxOutOffsets[i] + auxOutChannels[i];
+        size_t totalChannels =
+            2 * mainChannels + m_auxInOffsets.back() + m_auxOutOffsets.back();
+        m_data.assign(totalChannels * maxFrames, 0.0f);
+
+        std::vector<bool> valid(mainChannels, false);
+        for (auto &conn : inputRouting)
+        {
+            auto [srcChan, destPort, destChan] = conn;
+            float *dest = nullptr;
+            if (destPort == 0 && destChan >= 0)
+            {
+                dest = getMainChannel(0, destChan);
+                valid[destChan] = true;
+            }
+            else if (destPort > 0 && destChan >= 0)
+                dest = getAuxInChannel(destPort, destChan);
+            m_routedInputs.push_back(dest);
+        }
+
+        int current = 0;
+        for (auto &proc : processors)
+        {
+            Step step;
+            for (size_t i = 0; i < proc.inputs.size(); ++i)
+            {
+                for (uint32_t ch = 0; ch < proc.inputs[i].channels; ++ch)
+                {
+                    if (i == 0)
+                    {
+                        step.inputChannels.push_back(getMainChannel(current, ch));
+                        if (!valid[ch])
+                            step.clearBeforeProcess.push_back(getMainChannel(current, ch));
+                    }
+                    else
+                        step.inputChannels.push_back(getAuxInChannel(i, ch));
+                }
+            }
+            if (!proc.inputs.empty())
+                step.mainInputBuffer = current;
+            if (!proc.outputs.empty())
+            {
+                const auto &mainOut = proc.outputs[0];
+                step.inPlace = !proc.inputs.empty() && mainOut.inPlacePair != CLAP_INVALID_ID &&
+                               mainOut.inPlacePair == proc.inputs[0].id &&
+                               mainOut.channels == proc.inputs[0].channels;
+                step.mainOutputBuffer = step.inPlace ? current : 1 - current;
+                current = step.mainOutputBuffer;
+                for (uint32_t ch = 0; ch < m_mainChannels; ++ch)
+                    valid[ch] = ch < mainOut.channels;
+            }
+            for (size_t i = 0; i < proc.outputs.size(); ++i)
+            {
+                for (uint32_t ch = 0; ch < proc.outputs[i].channels; ++ch)
+                {
+                    if (i == 0)
+                        step.outputChannels.push_back(getMainChannel(current, ch));
+                    else
+                        step.outputChannels.push_back(getAuxOutChannel(i, ch));
+                }
+            }
+            // the channel pointer vectors are complete, so the port structs can point into them
+            step.inputs = makePorts(proc.inputs, step.inputChannels);
+            step.outputs = makePorts(proc.outputs, step.outputChannels);
+            m_steps.push_back(std::move(step));
+        }
+
+        // without processors, or after processors without outputs, the chain input passes through
+        std::vector<bool> written;
+        for (auto &conn : outputRouting)
+        {
+            auto [srcPort, srcChan, destChan] = conn;
+            if (destChan < 0)
+                continue;
+            OutputConnection oc;
+            oc.destChannel = destChan;
+            if (srcPort == 0 && srcChan >= 0 && srcChan < (int)m_mainChannels && valid[srcChan])
+                oc.source = getMainChannel(current, srcChan);
+            else if (srcPort > 0 && srcChan >= 0 && !processors.empty())
+            {
+                const auto &outs = processors.back().outputs;
+                if (srcPort < (int)outs.size() && srcChan < (int)outs[srcPort].channels)
+                    oc.source = getAuxOutChannel(srcPort, srcChan);
+            }
+            if (written.size() <= (size_t)destChan)
+                written.resize(destChan + 1, false);
+            oc.add = written[destChan];
+            written[destChan] = true;
+            // adding silence does nothing
+            if (oc.add && !oc.source)
+                continue;
+            m_outputConnections.push_back(oc);
+        }
+    }
+
+    size_t getNumSteps() const { return m_steps.size(); }
+    Step &getStep(size_t index) { return m_steps[index]; }
+    uint32_t getMaxFrames() const { return m_maxFrames; }
+    // where each chain input routing entry writes, nullptr for invalid entries
+    const std::vector<float *> &getRoutedInputs() const { return m_routedInputs; }
+    const std::vector<OutputConnection> &getOutputConnections() const
+    {
+        return m_outputConnections;
+    }
+
+  private:
+    float *getMainChannel(int buffer, uint32_t channel)
+    {
+        return &m_data[(buffer * m_mainChannels + channel) * m_maxFrames];
+    }
+    float *getAuxInChannel(size_t port, uint32_t channel)
+    {
+        size_t index = 2 * m_mainChannels + m_auxInOffsets[port - 1] + channel;
+        return &m_data[index * m_maxFrames];
+    }
+    float *getAuxOutChannel(size_t port, uint32_t channel)
+    {
+        size_t index =
+            2 * m_mainChannels + m_auxInOffsets.back() + m_auxOutOffsets[port - 1] + channel;
+        return &m_data[index * m_maxFrames];
+    }
+    static std::vector<clap_audio_buffer> makePorts(const std::vector<Port> &ports,
+                                                    std::vector<float *> &channels)
+    {
+        std::vector<clap_audio_buffer> result;
+        size_t offset = 0;
+        for (auto &port : ports)
+        {
+            clap_audio_buffer buf;
+            buf.data32 = channels.data() + offset;
+            buf.data64 = nullptr;
+            buf.channel_count = port.channels;
+            buf.latency = 0;
+            buf.constant_mask = 0;
+            result.push_back(buf);
+            offset += port.channels;
+        }
+        return result;
+    }
+    uint32_t m_maxFrames = 0;
+    uint32_t m_mainChannels = 0;
+    std::vector<size_t> m_auxInOffsets;
+    std::vector<size_t> m_auxOutOffsets;
+    std::vector<float> m_data;
+    std::vector<Step> m_steps;
+    std::vector<float *> m_routedInputs;
+    std::vector<OutputConnection> m_outputConnections;
+};
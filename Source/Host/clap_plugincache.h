@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "containers/choc_Value.h"
+#include "../Common/xaudioprocessor.h"
+
+/*
+Scan results of CLAP plugin files, kept in a JSON file between runs so that the plugin
+descriptors, audio port layouts and parameter infos can be queried without loading the plugins.
+A file is scanned again when its size or modification time changes. Bundles that are directories
+are compared by the total size and the latest modification time of the files in them.
+
+For each plugin file the cache has an array of objects for the plugins in it, in factory order,
+with the members of ClapProcessingEngine::scanPluginFile and "audio_inputs", "audio_outputs" and
+"parameters". The parameters are in the format of ClapProcessingEngine::getParametersAsJSON.
+*/
+class ClapScanCache
+{
+  public:
+    explicit ClapScanCache(std::filesystem::path cacheFile);
+    // XENAKIOS_CLAP_SCAN_CACHE if set, otherwise a file in the user's cache directory
+    static std::filesystem::path getDefaultCacheFile();
+
+    // scans the file if it's not in the cache or has changed since it was scanned
+    choc::value::Value getPluginFileInfo(const std::filesystem::path &pluginFile);
+    choc::value::Value getPluginInfo(const std::filesystem::path &pluginFile, int pluginIndex);
+    void clear();
+    void save();
+    // the number of plugin files actually scanned, not served from the cache
+    int getNumScans() const { return m_numScans; }
+
+  private:
+    struct FileStamp
+    {
+        int64_t size = 0;
+        int64_t modified = 0;
+    };
+    static FileStamp getFileStamp(const std::filesystem::path &pluginFile);
+    static choc::value::Value scanPluginFile(const std::filesystem::path &pluginFile);
+    void load();
+    std::filesystem::path m_cacheFile;
+    std::map<std::string, choc::value::Value> m_entries;
+    bool m_loaded = false;
+    int m_numScans = 0;
+    std::mutex m_mutex;
+};
+
+/*
+Instantiated plugins kept for reuse within the process, so that rendering with the same
+plugins again doesn't need to load the plugin files and create the plugins again. Only plugins
+loaded from files are pooled. The processors are released deactivated, and the state a plugin
+had when it was created is loaded back into it before it's handed out again. Plugins that can't
+save or load their state can't be reset that way, so they are destroyed instead of pooled.
+*/
+class ClapInstancePool
+{
+  public:
+    struct Instance
+    {
+        std::unique_ptr<xenakios::XAudioProcessor> proc;
+        // empty if the plugin can't save its state, such instances aren't pooled
+        std::vector<char> initialState;
+    };
+    // a pooled instance if there is one, otherwise a new one
+    Instance acquire(const std::string &pluginFile, int pluginIndex);
+    void release(const std::string &pluginFile, int pluginIndex, Instance instance);
+    void clear();
+    size_t getNumPooled();
+    size_t getNumReused() const { return m_numReused; }
+
+  private:
+    using Key = std::pair<std::string, int>;
+    std::map<Key, std::vector<Instance>> m_instances;
+    size_t m_numReused = 0;
+    std::mutex m_mutex;
+};
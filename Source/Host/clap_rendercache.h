@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "audio/choc_AudioFileFormat_WAV.h"
+#include "audio/choc_SampleBuffers.h"
+#include "memory/choc_xxHash.h"
+#include "../Common/xap_utils.h"
+#include "../Common/xen_audiofilewriter.h"
+
+/*
+Rendered audio stored on disk under the hash of everything that went into rendering it, so a
+render whose inputs haven't changed can be loaded instead of rendered again. The files are
+float WAVs named by the key in hex. They are written under a temporary name and renamed, so an
+interrupted write never leaves a truncated file under a valid key. Long renders can be streamed
+into the cache with a Writer while they're rendered and read back block by block with
+openReader, so they never need to fit in memory.
+
+Nothing is ever evicted, the directory can be deleted whenever the space is needed.
+*/
+class RenderCache
+{
+  public:
+    // Builds a key from values added one at a time, so no padding bytes of structs end up
+    // hashed. Strings and byte blocks are prefixed with their size, so that the boundaries
+    // between them are part of the key.
+    class KeyBuilder
+    {
+      public:
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        KeyBuilder &add(T value)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+                if (value == 0)
+                    value = 0;
+            m_hash.addInput(&value, sizeof(value));
+            return *this;
+        }
+        KeyBuilder &add(std::string_view str) { return addBytes(str.data(), str.size()); }
+        KeyBuilder &addBytes(const void *data, size_t size)
+        {
+            add((uint64_t)size);
+            m_hash.addInput(data, size);
+            return *this;
+        }
+        uint64_t getKey() { return m_hash.getHash(); }
+
+      private:
+        choc::hash::xxHash64 m_hash;
+    };
+
+    explicit RenderCache(std::filesystem::path directory) : m_directory(std::move(directory)) {}
+    // XENAKIOS_RENDER_CACHE if set, otherwise a directory in the user's cache directory
+    static std::filesystem::path getDefaultDirectory()
+    {
+        if (auto env = std::getenv("XENAKIOS_RENDER_CACHE"))
+            return env;
+        std::filesystem::path dir;
+#ifdef _WIN32
+        if (auto appdata = std::getenv("LOCALAPPDATA"))
+            dir = appdata;
+#else
+        if (auto xdg = std::getenv("XDG_CACHE_HOME"))
+            dir = xdg;
+        else if (auto home = std::getenv("HOME"))
+            dir = std::filesystem::path(home) / ".cache";
+#endif
+        if (dir.empty())
+            dir = std::filesystem::temp_directory_path();
+        return dir / "xenakios" / "render_cache";
+    }
+    const std::filesystem::path &getDirectory() const { return m_directory; }
+    std::filesystem::path getFile(uint64_t key) const
+    {
+        return m_directory / std::format("{:016x}.wav", key);
+    }
+
+    // Opens the audio stored under key for reading, if it has the given size. Returns nullptr if
+    // there's nothing stored or it doesn't match the size.
+    std::unique_ptr<choc::audio::AudioFileReader> openReader(uint64_t key, uint32_t numChannels,
+                                                             uint64_t numFrames)
+    {
+        auto file = getFile(key);
+        if (!std::filesystem::exists(file))
+        {
+            ++m_numMisses;
+            return nullptr;
+        }
+        choc::audio::WAVAudioFileFormat<false> format;
+        auto reader = format.createReader(file.string());
+        if (!reader || reader->getProperties().numChannels != numChannels ||
+            reader->getProperties().numFrames != numFrames)
+        {
+            ++m_numMisses;
+            return nullptr;
+        }
+        ++m_numHits;
+        return reader;
+    }
+    // Reads the audio stored under key into dest, which must have the size of the stored audio.
+    // Returns false if there's nothing stored or it doesn't match the size.
+    bool load(uint64_t key, choc::buffer::ChannelArrayView<float> dest)
+    {
+        auto reader = openReader(key, dest.getNumChannels(), dest.getNumFrames());
+        return reader && reader->readFrames(0, dest);
+    }
+
+    // Streams audio into the cache through a background writer thread. The audio is stored
+    // under the key by commit(), a Writer destroyed without committing removes its temporary
+    // file.
+    class Writer
+    {
+      public:
+        Writer(std::filesystem::path file, int numChannels, double sampleRate)
+            : m_file(std::move(file)), m_tempFile(m_file)
+        {
+            m_tempFile += ".tmp";
+            m_writer = std::make_unique<xenakios::BackgroundAudioFileWriter>(
+                std::make_unique<xenakios::StreamingAudioFileWriter>(
+                    m_tempFile.string(), xenakios::StreamingAudioFileWriter::Format::WAV,
+                    numChannels, sampleRate));
+        }
+        ~Writer()
+        {
+            if (m_committed)
+                return;
+            // finishes the writer thread, the errors don't matter anymore
+            m_writer.reset();
+            std::error_code ec;
+            std::filesystem::remove(m_tempFile, ec);
+        }
+        Writer(const Writer &) = delete;
+        Writer &operator=(const Writer &) = delete;
+        void write(const float *interleaved, int numFrames)
+        {
+            m_writer->write(interleaved, numFrames);
+        }
+        void commit()
+        {
+            m_writer->finish();
+            std::filesystem::rename(m_tempFile, m_file);
+            m_committed = true;
+        }
+
+      private:
+        std::filesystem::path m_file;
+        std::filesystem::path m_tempFile;
+        std::unique_ptr<xenakios::BackgroundAudioFileWriter> m_writer;
+        bool m_committed = false;
+    };
+    std::unique_ptr<Writer> createWriter(uint64_t key, int numChannels, double sampleRate)
+    {
+        std::filesystem::create_directories(m_directory);
+        return std::make_unique<Writer>(getFile(key), numChannels, sampleRate);
+    }
+    void store(uint64_t key, choc::buffer::ChannelArrayView<float> audio, double sampleRate)
+    {
+        std::filesystem::create_directories(m_directory);
+        auto file = getFile(key);
+        auto tempFile = file;
+        tempFile += ".tmp";
+        {
+            auto writer = xenakios::createWavWriter(tempFile.string(), audio.getNumChannels(),
+                                                    sampleRate);
+            if (!writer || !writer->appendFrames(audio) || !writer->flush())
+                throw std::runtime_error("Could not write render cache file " + tempFile.string());
+        }
+        std::filesystem::rename(tempFile, file);
+    }
+    int getNumHits() const { return m_numHits; }
+    int getNumMisses() const { return m_numMisses; }
+
+  private:
+    std::filesystem::path m_directory;
+    int m_numHits = 0;
+    int m_numMisses = 0;
+};
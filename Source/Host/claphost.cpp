@@ -17,8 +17,10 @@
 #include "../Xaps/xap_memorybufferplayer.h"
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <format>
@@ -29,6 +31,8 @@
 #include <unordered_map>
 #include <vector>
 #include "../Xaps/clap_xaudioprocessor.h"
+#include "../Common/xen_rtcheck.h"
+#include "../Common/xen_interleave.h"
 #include "text/choc_StringUtilities.h"
 
 using namespace std::chrono_literals;
@@ -72,6 +76,13 @@ ClapProcessingEngine::~ClapProcessingEngine()
     {
         std::cout << numUnhandled << " unhandled main thread call requests from Clap plugins\n";
     }
+    for (auto &ce : m_chain)
+    {
+        if (!ce->pooledInitialState || ce->guiWindow)
+            continue;
+        getInstancePool().release(ce->pluginFile, ce->pluginIndex,
+                                  {std::move(ce->m_proc), std::move(*ce->pooledInitialState)});
+    }
 }
 
 std::set<ClapProcessingEngine *> &ClapProcessingEngine::getEngines() { return g_engineinstances; }
@@ -79,10 +90,17 @@ std::set<ClapProcessingEngine *> &ClapProcessingEngine::getEngines() { return g_
 void ClapProcessingEngine::addProcessorToChain(std::string plugfilename, int pluginindex)
 {
     std::unique_ptr<xenakios::XAudioProcessor> plug;
+    std::optional<std::vector<char>> pooledInitialState;
     if (plugfilename == "XenakiosMemoryBufferPlayer")
     {
         plug = std::make_unique<XapMemoryBufferPlayer>();
     }
+    else if (m_useInstancePool)
+    {
+        auto instance = getInstancePool().acquire(plugfilename, pluginindex);
+        plug = std::move(instance.proc);
+        pooledInitialState = std::move(instance.initialState);
+    }
     else
     {
         plug = std::make_unique<ClapPluginFormatProcessor>(plugfilename, pluginindex);
@@ -90,6 +108,12 @@ void ClapProcessingEngine::addProcessorToChain(std::string plugfilename, int plu
     if (plug)
     {
         auto chainEntry = std::make_unique<ProcessorEntry>();
+        if (plugfilename != "XenakiosMemoryBufferPlayer")
+        {
+            chainEntry->pluginFile = plugfilename;
+            chainEntry->pluginIndex = pluginindex;
+        }
+        chainEntry->pooledInitialState = std::move(pooledInitialState);
         clap_plugin_descriptor desc;
         if (plug->getDescriptor(&desc))
         {
@@ -102,7 +126,15 @@ void ClapProcessingEngine::addProcessorToChain(std::string plugfilename, int plu
                       << std::endl;
         plug->runMainThreadTasks();
         chainEntry->m_proc = std::move(plug);
+        if (m_isPrepared)
+        {
+            // added while playing, the audio thread starts the processor when it first sees it
+            if (!chainEntry->m_proc->activate(m_samplerate, m_maxBlockSize, m_maxBlockSize))
+                std::cout << "could not activate " << chainEntry->name << "\n";
+            chainEntry->prepareEventIterator(m_samplerate);
+        }
         m_chain.push_back(std::move(chainEntry));
+        publishChain();
     }
     else
     {
@@ -114,7 +146,10 @@ void ClapProcessingEngine::removeProcessorFromChain(int index)
 {
     if (index >= 0 && index < m_chain.size())
     {
+        std::vector<std::unique_ptr<ProcessorEntry>> retired;
+        retired.push_back(std::move(m_chain[index]));
         m_chain.erase(m_chain.begin() + index);
+        publishChain(std::move(retired));
     }
     else
     {
@@ -122,6 +157,32 @@ void ClapProcessingEngine::removeProcessorFromChain(int index)
     }
 }
 
+ClapScanCache &ClapProcessingEngine::getScanCache()
+{
+    static ClapScanCache cache{ClapScanCache::getDefaultCacheFile()};
+    return cache;
+}
+
+std::string ClapProcessingEngine::getCachedPluginInfo(std::filesystem::path plugfilename)
+{
+    return choc::json::toString(getScanCache().getPluginFileInfo(plugfilename), true);
+}
+
+std::string ClapProcessingEngine::getCachedParametersJSON(std::filesystem::path plugfilename,
+                                                          int pluginIndex)
+{
+    auto info = getScanCache().getPluginInfo(plugfilename, pluginIndex);
+    if (!info.hasObjectMember("parameters"))
+        return "[]";
+    return choc::json::toString(info["parameters"], true);
+}
+
+ClapInstancePool &ClapProcessingEngine::getInstancePool()
+{
+    static ClapInstancePool pool;
+    return pool;
+}
+
 std::vector<std::filesystem::path> ClapProcessingEngine::scanPluginDirectories()
 {
     std::vector<std::filesystem::path> result;
@@ -216,6 +277,304 @@ std::string ClapProcessingEngine::scanPluginFile(std::filesystem::path plugfilep
     return choc::json::toString(pluginfoarray, true);
 }
 
+// the parameter infos of a plugin in the format of getParametersAsJSON, the plugin must be
+// activated for the plugins that fill in the up to date infos only after activation
+static choc::value::Value getParameterInfos(xenakios::XAudioProcessor *plug)
+{
+    auto paramsarray = choc::value::createEmptyArray();
+    for (int i = 0; i < plug->paramsCount(); ++i)
+    {
+        clap_param_info info;
+        if (plug->paramsInfo(i, &info))
+        {
+            auto infoobject = choc::value::createObject("info");
+            infoobject.setMember("name", std::string(info.name));
+            infoobject.setMember("id", (int64_t)info.id);
+            infoobject.setMember("defaultval", info.default_value);
+            infoobject.setMember("minval", info.min_value);
+            infoobject.setMember("maxval", info.max_value);
+            double origin = 0.0;
+            if (plug->paramsOrigin(info.id, &origin))
+            {
+                infoobject.setMember("origin", origin);
+            }
+            infoobject.setMember("module", std::string(info.module));
+            // Can do the needed bit checks in Python, but I suppose would be nice
+            // to have some kind of string from the flags too
+            infoobject.setMember("flags", (int64_t)info.flags);
+            paramsarray.addArrayElement(infoobject);
+        }
+    }
+    return paramsarray;
+}
+
+static choc::value::Value getAudioPortInfos(xenakios::XAudioProcessor *plug, bool isInput)
+{
+    auto portsarray = choc::value::createEmptyArray();
+    for (uint32_t i = 0; i < plug->audioPortsCount(isInput); ++i)
+    {
+        clap_audio_port_info info;
+        if (plug->audioPortsInfo(i, isInput, &info))
+        {
+            auto portobject = choc::value::createObject("port");
+            portobject.setMember("id", (int64_t)info.id);
+            portobject.setMember("name", std::string(info.name));
+            portobject.setMember("channels", (int64_t)info.channel_count);
+            portobject.setMember("flags", (int64_t)info.flags);
+            portobject.setMember("port_type", std::string(info.port_type ? info.port_type : ""));
+            portobject.setMember("in_place_pair", (int64_t)info.in_place_pair);
+            portsarray.addArrayElement(portobject);
+        }
+    }
+    return portsarray;
+}
+
+ClapScanCache::ClapScanCache(std::filesystem::path cacheFile) : m_cacheFile(std::move(cacheFile))
+{
+}
+
+std::filesystem::path ClapScanCache::getDefaultCacheFile()
+{
+    if (auto env = std::getenv("XENAKIOS_CLAP_SCAN_CACHE"))
+        return env;
+    std::filesystem::path dir;
+#ifdef _WIN32
+    if (auto appdata = std::getenv("LOCALAPPDATA"))
+        dir = appdata;
+#else
+    if (auto xdg = std::getenv("XDG_CACHE_HOME"))
+        dir = xdg;
+    else if (auto home = std::getenv("HOME"))
+        dir = std::filesystem::path(home) / ".cache";
+#endif
+    if (dir.empty())
+        dir = std::filesystem::temp_directory_path();
+    return dir / "xenakios" / "clap_scan_cache.json";
+}
+
+ClapScanCache::FileStamp ClapScanCache::getFileStamp(const std::filesystem::path &pluginFile)
+{
+    auto stampOf = [](const std::filesystem::path &path, FileStamp &stamp) {
+        stamp.size += (int64_t)std::filesystem::file_size(path);
+        stamp.modified = std::max<int64_t>(
+            stamp.modified, std::filesystem::last_write_time(path).time_since_epoch().count());
+    };
+    FileStamp stamp;
+    if (std::filesystem::is_directory(pluginFile))
+    {
+        for (auto &f : std::filesystem::recursive_directory_iterator(pluginFile))
+        {
+            if (f.is_regular_file())
+                stampOf(f.path(), stamp);
+        }
+    }
+    else
+        stampOf(pluginFile, stamp);
+    return stamp;
+}
+
+choc::value::Value ClapScanCache::scanPluginFile(const std::filesystem::path &pluginFile)
+{
+    auto descriptors = choc::json::parseValue(ClapProcessingEngine::scanPluginFile(pluginFile));
+    auto plugins = choc::value::createEmptyArray();
+    for (uint32_t i = 0; i < descriptors.size(); ++i)
+    {
+        choc::value::Value info{descriptors[i]};
+        ClapPluginFormatProcessor plug{pluginFile.generic_string(), (int)i};
+        plug.runMainThreadTasks();
+        if (plug.activate(44100.0, 512, 512))
+        {
+            info.setMember("audio_inputs", getAudioPortInfos(&plug, true));
+            info.setMember("audio_outputs", getAudioPortInfos(&plug, false));
+            info.setMember("parameters", getParameterInfos(&plug));
+            plug.deactivate();
+        }
+        else
+            throw std::runtime_error(std::format("Could not activate plugin {} of {} for scanning",
+                                                 i, pluginFile.generic_string()));
+        plugins.addArrayElement(info);
+    }
+    return plugins;
+}
+
+void ClapScanCache::load()
+{
+    m_loaded = true;
+    if (!std::filesystem::exists(m_cacheFile))
+        return;
+    try
+    {
+        auto root = choc::json::parseValue(choc::file::loadFileAsString(m_cacheFile.string()));
+        if (root["version"].getWithDefault(0) != 1)
+            return;
+        auto files = root["files"];
+        for (uint32_t i = 0; i < files.size(); ++i)
+        {
+            auto path = std::string(files[i]["path"].getString());
+            m_entries[path] = choc::value::Value{files[i]};
+        }
+    }
+    catch (std::exception &ex)
+    {
+        // a broken cache only means scanning again
+        std::cout << "could not read CLAP scan cache " << m_cacheFile << " : " << ex.what() << "\n";
+        m_entries.clear();
+    }
+}
+
+void ClapScanCache::save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto files = choc::value::createEmptyArray();
+    for (auto &e : m_entries)
+        files.addArrayElement(e.second);
+    auto root = choc::value::createObject("clapscancache");
+    root.setMember("version", 1);
+    root.setMember("files", files);
+    std::filesystem::create_directories(m_cacheFile.parent_path());
+    choc::file::replaceFileWithContent(m_cacheFile.string(), choc::json::toString(root, true));
+}
+
+void ClapScanCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_loaded = true;
+}
+
+choc::value::Value ClapScanCache::getPluginFileInfo(const std::filesystem::path &pluginFile)
+{
+    if (!std::filesystem::exists(pluginFile))
+        throw std::runtime_error("Plugin file does not exist " + pluginFile.generic_string());
+    auto path = std::filesystem::absolute(pluginFile).generic_string();
+    auto stamp = getFileStamp(pluginFile);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_loaded)
+            load();
+        auto it = m_entries.find(path);
+        if (it != m_entries.end() && it->second["size"].getWithDefault((int64_t)-1) == stamp.size &&
+            it->second["modified"].getWithDefault((int64_t)-1) == stamp.modified)
+            return choc::value::Value{it->second["plugins"]};
+    }
+    // scanning can take long, so it's done without holding the lock
+    auto plugins = scanPluginFile(pluginFile);
+    auto entry = choc::value::createObject("clapfile");
+    entry.setMember("path", path);
+    entry.setMember("size", stamp.size);
+    entry.setMember("modified", stamp.modified);
+    entry.setMember("plugins", plugins);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[path] = entry;
+        ++m_numScans;
+    }
+    try
+    {
+        save();
+    }
+    catch (std::exception &ex)
+    {
+        std::cout << "could not write CLAP scan cache " << m_cacheFile << " : " << ex.what()
+                  << "\n";
+    }
+    return plugins;
+}
+
+choc::value::Value ClapScanCache::getPluginInfo(const std::filesystem::path &pluginFile,
+                                                int pluginIndex)
+{
+    auto plugins = getPluginFileInfo(pluginFile);
+    if (pluginIndex < 0 || pluginIndex >= (int)plugins.size())
+        throw std::runtime_error(std::format("Plugin index {} out of allowed range 0..{}",
+                                             pluginIndex, (int)plugins.size() - 1));
+    return choc::value::Value{plugins[pluginIndex]};
+}
+
+ClapInstancePool::Instance ClapInstancePool::acquire(const std::string &pluginFile,
+                                                     int pluginIndex)
+{
+    std::optional<Instance> pooled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_instances.find({pluginFile, pluginIndex});
+        if (it != m_instances.end() && !it->second.empty())
+        {
+            pooled = std::move(it->second.back());
+            it->second.pop_back();
+        }
+    }
+    if (pooled)
+    {
+        std::pair<const std::vector<char> *, size_t> reader{&pooled->initialState, 0};
+        clap_istream is;
+        is.ctx = &reader;
+        is.read = [](const clap_istream *stream, void *buffer, uint64_t size) {
+            auto &rd = *(std::pair<const std::vector<char> *, size_t> *)stream->ctx;
+            auto num = std::min<uint64_t>(size, rd.first->size() - rd.second);
+            std::copy(rd.first->begin() + rd.second, rd.first->begin() + rd.second + num,
+                      (char *)buffer);
+            rd.second += num;
+            return int64_t(num);
+        };
+        if (pooled->proc->stateLoad(&is))
+        {
+            pooled->proc->runMainThreadTasks();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_numReused;
+            return std::move(*pooled);
+        }
+        // the instance couldn't be reset, so it's dropped and a new one is created instead
+        pooled.reset();
+    }
+    auto plug = std::make_unique<ClapPluginFormatProcessor>(pluginFile, pluginIndex);
+    plug->runMainThreadTasks();
+    Instance instance;
+    // the state extension is only available after activation
+    if (plug->activate(44100.0, 512, 512))
+    {
+        clap_ostream os;
+        os.ctx = &instance.initialState;
+        os.write = [](const clap_ostream *stream, const void *buffer, uint64_t size) {
+            auto &data = *(std::vector<char> *)stream->ctx;
+            data.insert(data.end(), (const char *)buffer, (const char *)buffer + size);
+            return int64_t(size);
+        };
+        if (!plug->stateSave(&os))
+            instance.initialState.clear();
+        plug->deactivate();
+    }
+    instance.proc = std::move(plug);
+    return instance;
+}
+
+void ClapInstancePool::release(const std::string &pluginFile, int pluginIndex, Instance instance)
+{
+    // an instance without a restorable initial state can't be reset for reuse, so it's destroyed
+    if (!instance.proc || instance.initialState.empty())
+        return;
+    auto clapProc = dynamic_cast<ClapPluginFormatProcessor *>(instance.proc.get());
+    if (clapProc && clapProc->isActivated())
+        clapProc->deactivate();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_instances[{pluginFile, pluginIndex}].push_back(std::move(instance));
+}
+
+void ClapInstancePool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_instances.clear();
+}
+
+size_t ClapInstancePool::getNumPooled()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t result = 0;
+    for (auto &e : m_instances)
+        result += e.second.size();
+    return result;
+}
+
 template <typename BufType> inline void sanityCheckBuffer(BufType &buf)
 {
     for (int j = 0; j < buf.getNumFrames(); ++j)
@@ -236,16 +595,46 @@ template <typename BufType> inline void sanityCheckBuffer(BufType &buf)
 void ClapProcessingEngine::processToFile2(std::string filename, double duration, double samplerate,
                                           int numoutchans)
 {
-    size_t blockSize = 64;
-    for (auto &e : m_chains)
-    {
-        e->activate(samplerate, blockSize);
+    size_t blockSize = std::clamp(m_offlineOptions.blockSize, 16, 8192);
+    int64_t outlen = duration * samplerate;
+    // whole blocks are rendered, so the chains render past the end to the end of the last block
+    int64_t renderFrames = (outlen + blockSize - 1) / blockSize * blockSize;
+    std::optional<RenderCache> cache;
+    // the cached chains are read from the cache and the others written into it block by block
+    // while rendering, so the memory used doesn't depend on the render length
+    std::vector<std::unique_ptr<choc::audio::AudioFileReader>> stemReaders;
+    std::vector<std::unique_ptr<RenderCache::Writer>> stemWriters;
+    std::vector<bool> cachedChains;
+    if (m_useRenderCache)
+    {
+        cache.emplace(m_renderCacheDirectory.empty()
+                          ? RenderCache::getDefaultDirectory()
+                          : std::filesystem::path(m_renderCacheDirectory));
+        for (auto &chain : m_chains)
+        {
+            chain->activate(samplerate, blockSize);
+            auto key = chain->getRenderKey(renderFrames);
+            int numChans = chain->highestOutputChannel + 1;
+            stemReaders.push_back(cache->openReader(key, numChans, renderFrames));
+            cachedChains.push_back(stemReaders.back() != nullptr);
+            stemWriters.emplace_back();
+            if (cachedChains.back())
+                continue;
+            try
+            {
+                stemWriters.back() = cache->createWriter(key, numChans, samplerate);
+            }
+            catch (std::exception &ex)
+            {
+                // the chain can still be rendered, it just can't be reused
+                std::cout << ex.what() << "\n";
+            }
+        }
     }
+    prepareChains(samplerate, blockSize, cachedChains);
+    for (auto &chain : m_chains)
+        chain->rewind();
     std::thread th([&]() {
-        choc::buffer::ChannelArrayBuffer<float> inbuf{2, (unsigned int)blockSize};
-        inbuf.clear();
-        choc::buffer::ChannelArrayBuffer<float> outbuf{2, (unsigned int)blockSize};
-        outbuf.clear();
         choc::buffer::ChannelArrayBuffer<float> mixbuf{2, (unsigned int)blockSize};
         mixbuf.clear();
         choc::audio::WAVAudioFileFormat<true> format;
@@ -254,20 +643,56 @@ void ClapProcessingEngine::processToFile2(std::string filename, double duration,
         props.numChannels = 2;
         props.sampleRate = samplerate;
         auto writer = format.createWriter(filename, props);
-        int outlen = duration * samplerate;
-        int outcounter = 0;
+        // one block of a stem, read from the cache or interleaved for writing into it
+        std::vector<choc::buffer::ChannelArrayBuffer<float>> stemBlocks;
+        std::vector<std::vector<float>> interleaved;
+        for (size_t i = 0; i < stemReaders.size(); ++i)
+        {
+            unsigned int numChans = m_chains[i]->highestOutputChannel + 1;
+            stemBlocks.emplace_back(cachedChains[i] ? numChans : 0, (unsigned int)blockSize);
+            interleaved.emplace_back(cachedChains[i] ? 0 : numChans * blockSize);
+        }
+        int64_t outcounter = 0;
         while (outcounter < outlen)
         {
             mixbuf.clear();
-            for (auto &e : m_chains)
+            processChains({}, mixbuf.getView());
+            for (size_t i = 0; i < stemReaders.size(); ++i)
             {
-                e->processAudio(inbuf.getView(), outbuf.getView());
-                for (int i = 0; i < blockSize; ++i)
+                if (!cachedChains[i])
                 {
-                    for (int j = 0; j < 2; ++j)
+                    if (!stemWriters[i])
+                        continue;
+                    auto stem = m_chainOutputs[i].getView();
+                    auto numChans = stem.getNumChannels();
+                    for (uint32_t ch = 0; ch < numChans; ++ch)
+                    {
+                        const float *src = stem.data.channels[ch] + stem.data.offset;
+                        for (uint32_t j = 0; j < blockSize; ++j)
+                            interleaved[i][j * numChans + ch] = src[j];
+                    }
+                    try
+                    {
+                        stemWriters[i]->write(interleaved[i].data(), blockSize);
+                    }
+                    catch (std::exception &ex)
                     {
-                        mixbuf.getSample(j, i) += outbuf.getSample(j, i);
+                        // the render itself goes on, it just can't be reused
+                        std::cout << ex.what() << "\n";
+                        stemWriters[i].reset();
                     }
+                    continue;
+                }
+                auto stem = stemBlocks[i].getView();
+                if (!stemReaders[i]->readFrames(outcounter, stem))
+                    stem.clear();
+                auto numChans = std::min(mixbuf.getNumChannels(), stem.getNumChannels());
+                for (uint32_t ch = 0; ch < numChans; ++ch)
+                {
+                    float *dest = mixbuf.getView().data.channels[ch];
+                    const float *src = stem.data.channels[ch] + stem.data.offset;
+                    for (uint32_t j = 0; j < blockSize; ++j)
+                        dest[j] += src[j];
                 }
             }
             writer->appendFrames(mixbuf.getView());
@@ -279,6 +704,88 @@ void ClapProcessingEngine::processToFile2(std::string filename, double duration,
         }
     });
     th.join();
+    if (!cache)
+        return;
+    for (auto &stemWriter : stemWriters)
+    {
+        if (!stemWriter)
+            continue;
+        try
+        {
+            stemWriter->commit();
+        }
+        catch (std::exception &ex)
+        {
+            // the render itself succeeded, it just can't be reused
+            std::cout << ex.what() << "\n";
+        }
+    }
+    m_renderCacheHits = cache->getNumHits();
+    m_renderCacheMisses = cache->getNumMisses();
+}
+
+void ClapProcessingEngine::prepareChains(double sampleRate, int maxBlockSize,
+                                         const std::vector<bool> &skipChains)
+{
+    int numWorkers = m_numChainWorkers;
+    if (numWorkers < 0)
+        numWorkers = std::max<int>(std::thread::hardware_concurrency(), 1) - 1;
+    m_chainRunner = std::make_unique<xenakios::BlockJobRunner>(numWorkers);
+    m_chainInput = choc::buffer::ChannelArrayBuffer<float>{
+        (unsigned int)std::max(m_numStreamInputs, 2), (unsigned int)maxBlockSize};
+    m_chainInput.clear();
+    m_chainOutputs.clear();
+    std::vector<xenakios::BlockJobRunner::Job> jobs;
+    std::vector<bool> pinned;
+    for (size_t i = 0; i < m_chains.size(); ++i)
+    {
+        auto chain = m_chains[i].get();
+        chain->activate(sampleRate, maxBlockSize);
+        if (i < skipChains.size() && skipChains[i])
+        {
+            // no channels, so there's nothing to mix from it
+            m_chainOutputs.emplace_back(0u, (unsigned int)maxBlockSize);
+            continue;
+        }
+        m_chainOutputs.emplace_back((unsigned int)(chain->highestOutputChannel + 1),
+                                    (unsigned int)maxBlockSize);
+        m_chainOutputs.back().clear();
+        jobs.push_back([this, chain, i] {
+            chain->processAudio(m_chainInput.getView().getStart(m_chainBlockFrames),
+                                m_chainOutputs[i].getView().getStart(m_chainBlockFrames));
+        });
+        pinned.push_back(chain->pinnedThread);
+    }
+    m_chainRunner->setJobs(std::move(jobs), pinned);
+}
+
+void ClapProcessingEngine::processChains(choc::buffer::ChannelArrayView<float> input,
+                                         choc::buffer::ChannelArrayView<float> mixOutput)
+{
+    if (!m_chainRunner || m_chainRunner->getNumJobs() == 0)
+        return;
+    m_chainBlockFrames = mixOutput.getNumFrames();
+    // the channels of m_chainInput that no input channel goes into stay silent
+    auto chainInput = m_chainInput.getView();
+    auto numInChans = std::min(input.getNumChannels(), chainInput.getNumChannels());
+    for (uint32_t ch = 0; ch < numInChans; ++ch)
+    {
+        const float *src = input.data.channels[ch] + input.data.offset;
+        std::copy(src, src + m_chainBlockFrames, chainInput.data.channels[ch]);
+    }
+    m_chainRunner->run();
+    for (auto &chainOutput : m_chainOutputs)
+    {
+        auto chainView = chainOutput.getView();
+        auto numChans = std::min(mixOutput.getNumChannels(), chainView.getNumChannels());
+        for (uint32_t ch = 0; ch < numChans; ++ch)
+        {
+            float *dest = mixOutput.data.channels[ch] + mixOutput.data.offset;
+            const float *src = chainView.data.channels[ch] + chainView.data.offset;
+            for (uint32_t i = 0; i < m_chainBlockFrames; ++i)
+                dest[i] += src[i];
+        }
+    }
 }
 
 int ClapProcessingEngine::processToFile(std::string outfilename, double duration,
@@ -288,16 +795,19 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
 
     if (m_chain.size() == 0)
         throw std::runtime_error("There are no plugins in the chain to process");
-    int procblocksize = 64;
+    const auto options = m_offlineOptions;
+    int procblocksize = std::clamp(options.blockSize, 16, 8192);
     // 0 not started, 1 running, 2 finished ok, 3 cancel requested, 4 cancelled
     std::atomic<int> thread_status{0};
-    double maxTailSeconds = 0.0;
+    double lastEventTime = 0.0;
     size_t chainIndex = 0;
+    // the blocks split at automation are shorter than the block size
+    uint32_t minFrames = options.automationSplitFrames > 0 ? 1 : procblocksize;
 
     for (auto &c : m_chain)
     {
         c->m_seq.sortEvents();
-        if (!c->m_proc->activate(samplerate, procblocksize, procblocksize))
+        if (!c->m_proc->activate(samplerate, minFrames, procblocksize))
             std::cout << "could not activate " << c->name << "\n";
         std::cout << std::format("{} has {} audio output ports\n", c->name,
                                  c->m_proc->audioPortsCount(false));
@@ -314,25 +824,27 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
         }
         ++chainIndex;
 
-        // if (!c->m_proc->renderSetMode(CLAP_RENDER_OFFLINE))
-        //     std::cout << "was not able to set offline render mode for " << c->name << "\n";
-        auto tail = c->m_proc->tailGet() / samplerate;
-        maxTailSeconds = std::max(tail, maxTailSeconds);
+        if (options.offlineMode && !c->m_proc->renderSetMode(CLAP_RENDER_OFFLINE))
+            std::cout << "was not able to set offline render mode for " << c->name << "\n";
+        if (c->m_seq.getNumEvents() > 0)
+            lastEventTime = std::max(lastEventTime, c->m_seq.m_evlist.back().timestamp);
         c->m_proc->runMainThreadTasks();
     }
-    // if more than 15 seconds, it's likely infinite
-    maxTailSeconds = std::min(maxTailSeconds, 15.0);
 
     //  even offline, do the processing in another another thread because things
     //  can get complicated with plugins like Surge XT because of the thread checks
     std::thread th([&] {
         thread_status = 1;
-        std::vector<ClapEventSequence::IteratorSampleTime> eviters;
+        // the compact copies are iterated, for fewer cache misses with large sequences
+        std::vector<CompactClapEventSequence> compactseqs;
+        std::vector<CompactClapEventSequence::IteratorSampleTime> eviters;
         int events_in_seqs = 0;
+        compactseqs.reserve(m_chain.size());
         for (auto &p : m_chain)
         {
             events_in_seqs += p->m_seq.getNumEvents();
-            eviters.emplace_back(p->m_seq, samplerate);
+            compactseqs.emplace_back(p->m_seq);
+            eviters.emplace_back(compactseqs.back(), samplerate);
         }
         numoutchans = std::clamp(numoutchans, 1, 256);
         clap_process cp;
@@ -357,7 +869,7 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
 
         for (int i = 0; i < numports; ++i)
         {
-            outputbuffers[i] = choc::buffer::ChannelArrayBuffer<float>((unsigned int)2,
+            outputbuffers[i] = choc::buffer::ChannelArrayBuffer<float>((unsigned int)numoutchans,
                                                                        (unsigned int)procblocksize);
             outputbuffers[i].clear();
             m_clap_outbufs[i].channel_count = numoutchans;
@@ -393,8 +905,16 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
             p->m_proc->startProcessing();
         }
 
-        int outcounter = 0;
-        int outlensamples = duration * samplerate;
+        int64_t outcounter = 0;
+        int64_t lastEventFrame = std::ceil(lastEventTime * samplerate);
+        int64_t outlensamples = duration > 0.0
+                                    ? int64_t(duration * samplerate)
+                                    : lastEventFrame + int64_t(options.maxTailSeconds * samplerate);
+        const float silenceGain = std::pow(10.0, options.silenceThresholdDecibels / 20.0);
+        const int64_t silenceHoldFrames = options.silenceHoldSeconds * samplerate;
+        int64_t silentFrames = 0;
+        // a positive duration is the length of the render, silence only ends open-ended renders
+        const bool stopOnSilence = options.stopOnSilence && duration <= 0.0;
 
         outfileprops.formatName = "WAV";
         outfileprops.bitDepth = choc::audio::BitDepth::float32;
@@ -404,9 +924,7 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
         auto writer = wavformat.createWriter(outfilename, outfileprops);
         if (!writer)
             throw std::runtime_error("Could not create audio file for writing: " + outfilename);
-        int blockcount = 0;
-        int wakeup_blocks = 10;
-        for (int j = 0; j < wakeup_blocks; ++j)
+        for (int j = 0; j < options.warmupBlocks; ++j)
         {
             for (size_t i = 0; i < m_chain.size(); ++i)
             {
@@ -418,6 +936,21 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
         using ms = std::chrono::duration<double, std::milli>;
         const auto start_time = clock::now();
         int eventssent = 0;
+        std::vector<CompactClapEventSequence::EventRange> blockevents(m_chain.size());
+        std::vector<uint32_t> splitpoints;
+        std::vector<uint32_t> subblocks;
+        std::vector<float *> inchans(numoutchans);
+        std::vector<float *> outchans(numoutchans);
+        // the processors ping-pong between the buffers like in processChainSnapshot, so the last
+        // processor writes into outputbuffers[0]
+        auto &firstInput = m_chain.size() % 2 == 0 ? outputbuffers[0] : inputbuffer;
+        auto &firstOutput = m_chain.size() % 2 == 0 ? inputbuffer : outputbuffers[0];
+        auto eventFrameInBlock = [&](const CompactClapEventSequence::EventView &e) {
+            // events should not be outside the block but in case they are, place them at the
+            // first or last buffer sample position
+            auto frame = xenakios::SampleFrameIndex::toFrame(e.timestamp, samplerate) - outcounter;
+            return (uint32_t)std::clamp<int64_t>(frame, 0, procblocksize - 1);
+        };
         while (outcounter < outlensamples)
         {
             if (thread_status == 3)
@@ -425,49 +958,78 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
             list_in.clear();
             list_out.clear();
             double pos_seconds = outcounter / samplerate;
+            splitpoints.clear();
             for (size_t i = 0; i < m_chain.size(); ++i)
             {
-                auto blockevts = eviters[i].readNextEvents(procblocksize);
-                for (auto &e : blockevts)
+                blockevents[i] = eviters[i].readNextEvents(procblocksize);
+                if (options.automationSplitFrames <= 0)
+                    continue;
+                for (auto e : blockevents[i])
                 {
-                    auto ecopy = e.event;
-                    ecopy.header.time = (e.timestamp * samplerate) - outcounter;
-                    if (ecopy.header.time >= cp.frames_count)
-                    {
-                        // this should not happen but in case it does, place the event at the last
-                        // buffer sample position
-                        ecopy.header.time = cp.frames_count - 1;
-                    }
-                    if (ecopy.header.type == CLAP_EVENT_PARAM_VALUE)
-                    {
-                        auto aev = (clap_event_param_value *)&ecopy;
-                    }
-                    if (ecopy.header.type == CLAP_EVENT_TRANSPORT)
+                    if (e.header->type == CLAP_EVENT_PARAM_VALUE ||
+                        e.header->type == CLAP_EVENT_PARAM_MOD)
+                        splitpoints.push_back(eventFrameInBlock(e));
+                }
+            }
+            std::sort(splitpoints.begin(), splitpoints.end());
+            subblocks.clear();
+            subblocks.push_back(0);
+            for (auto point : splitpoints)
+            {
+                if (point >= subblocks.back() + options.automationSplitFrames &&
+                    point + options.automationSplitFrames <= procblocksize)
+                    subblocks.push_back(point);
+            }
+            subblocks.push_back(procblocksize);
+            for (size_t sb = 0; sb + 1 < subblocks.size(); ++sb)
+            {
+                uint32_t subStart = subblocks[sb];
+                uint32_t subEnd = subblocks[sb + 1];
+                cp.frames_count = subEnd - subStart;
+                cp.steady_time = outcounter + subStart;
+                for (int ch = 0; ch < numoutchans; ++ch)
+                {
+                    inchans[ch] = firstInput.getView().data.channels[ch] + subStart;
+                    std::fill(inchans[ch], inchans[ch] + cp.frames_count, 0.0f);
+                    outchans[ch] = firstOutput.getView().data.channels[ch] + subStart;
+                }
+                inbufs[0].data32 = inchans.data();
+                m_clap_outbufs[0].data32 = outchans.data();
+                for (size_t i = 0; i < m_chain.size(); ++i)
+                {
+                    for (auto e : blockevents[i])
                     {
-                        auto tev = (clap_event_transport *)&ecopy;
-                        if (tev->flags & CLAP_TRANSPORT_HAS_TEMPO)
-                        {
-                            std::cout << pos_seconds << " transport event with tempo " << tev->tempo
-                                      << "\n";
-                        }
-                        else
+                        auto frame = eventFrameInBlock(e);
+                        if (frame < subStart || frame >= subEnd)
+                            continue;
+                        auto ecopy = e.copyEvent();
+                        ecopy.header.time = frame - subStart;
+                        if (ecopy.header.type == CLAP_EVENT_TRANSPORT)
                         {
-                            std::cout << pos_seconds
-                                      << " transport event with unsupported properties\n";
+                            auto tev = (clap_event_transport *)&ecopy;
+                            if (tev->flags & CLAP_TRANSPORT_HAS_TEMPO)
+                            {
+                                std::cout << pos_seconds << " transport event with tempo "
+                                          << tev->tempo << "\n";
+                            }
+                            else
+                            {
+                                std::cout << pos_seconds
+                                          << " transport event with unsupported properties\n";
+                            }
                         }
+                        list_in.push((const clap_event_header *)&ecopy);
+                        ++eventssent;
                     }
-                    list_in.push((const clap_event_header *)&ecopy);
-                    ++eventssent;
+                    auto status = m_chain[i]->m_proc->process(&cp);
+                    if (status == CLAP_PROCESS_ERROR)
+                        throw std::runtime_error("Clap processing failed");
+                    list_in.clear();
+                    list_out.clear();
+                    std::swap(inbufs[0].data32, m_clap_outbufs[0].data32);
                 }
-                auto proc = m_chain[i]->m_proc.get();
-                auto status = m_chain[i]->m_proc->process(&cp);
-                if (status == CLAP_PROCESS_ERROR)
-                    throw std::runtime_error("Clap processing failed");
-                list_in.clear();
-                list_out.clear();
-                choc::buffer::copy(inputbuffer, outputbuffers[0]);
             }
-            uint32_t framesToWrite = std::min(int(outlensamples - outcounter), procblocksize);
+            uint32_t framesToWrite = std::min<int64_t>(outlensamples - outcounter, procblocksize);
             auto writeSectionView = outputbuffers[0].getSection(
                 choc::buffer::ChannelRange{0, (unsigned int)numoutchans}, {0, framesToWrite});
             if (!writer->appendFrames(writeSectionView))
@@ -476,12 +1038,38 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
                     std::format("Writing to output file {} failed", outfilename));
             }
 
-            cp.steady_time = outcounter;
-
+            bool pastLastEvent = outcounter >= lastEventFrame;
             outcounter += procblocksize;
+            // without any events, the plugins may not have started producing sound yet
+            if (stopOnSilence && pastLastEvent && eventssent > 0)
+            {
+                // the silent frames at the end of a block that isn't silent all the way count
+                // towards the hold too, so the render ends at most a block after the hold time
+                int64_t lastLoudFrame = -1;
+                for (uint32_t ch = 0; ch < writeSectionView.getNumChannels(); ++ch)
+                {
+                    const float *data =
+                        writeSectionView.data.channels[ch] + writeSectionView.data.offset;
+                    for (int64_t i = framesToWrite - 1; i > lastLoudFrame; --i)
+                    {
+                        if (std::abs(data[i]) >= silenceGain)
+                        {
+                            lastLoudFrame = i;
+                            break;
+                        }
+                    }
+                }
+                if (lastLoudFrame < 0)
+                    silentFrames += framesToWrite;
+                else
+                    silentFrames = framesToWrite - 1 - lastLoudFrame;
+                if (silentFrames >= silenceHoldFrames)
+                    break;
+            }
         }
         const ms render_duration = clock::now() - start_time;
-        double rtfactor = (duration * 1000.0) / render_duration.count();
+        double rendered_seconds = std::min(outcounter, outlensamples) / samplerate;
+        double rtfactor = (rendered_seconds * 1000.0) / render_duration.count();
         for (auto &p : m_chain)
         {
             p->m_proc->stopProcessing();
@@ -489,8 +1077,8 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
         writer->flush();
         // std::cout << events_in_seqs << " events in sequecnes, sent " << eventssent
         //          << " events to plugin\n";
-        std::cout << std::format("finished in {} seconds, {}x realtime\n",
-                                 render_duration.count() / 1000.0, rtfactor);
+        std::cout << std::format("rendered {} seconds in {} seconds, {}x realtime\n",
+                                 rendered_seconds, render_duration.count() / 1000.0, rtfactor);
 
         if (thread_status == 1)
             thread_status = 2;
@@ -519,6 +1107,8 @@ int ClapProcessingEngine::processToFile(std::string outfilename, double duration
     for (auto &p : m_chain)
     {
         p->m_proc->deactivate();
+        if (options.offlineMode)
+            p->m_proc->renderSetMode(CLAP_RENDER_REALTIME);
     }
     if (thread_status == 4)
     {
@@ -546,42 +1136,114 @@ std::vector<std::string> ClapProcessingEngine::getDeviceNames()
     return result;
 }
 
-void ClapProcessingEngine::setSuspended(bool b)
+void ClapProcessingEngine::setSuspended(bool b) { m_isSuspended = b; }
+
+uint64_t ClapProcessingEngine::publishSnapshot(std::vector<ProcessorEntry *> retired)
 {
-    std::lock_guard<std::mutex> locker(m_mutex);
-    m_isSuspended = b;
+    auto snapshot = std::make_unique<ProcessorChainSnapshot>();
+    snapshot->generation = m_chainSnapshot ? m_chainSnapshot->generation + 1 : 1;
+    for (auto &e : m_chain)
+        snapshot->processors.push_back(e.get());
+    snapshot->retired = std::move(retired);
+    auto old = m_activeChain.exchange(snapshot.get());
+    // the audio thread may still be processing a block with the old snapshot, but it will pick
+    // up the new one for the next block
+    while (old && m_chainInUse.load() == old)
+        std::this_thread::sleep_for(1ms);
+    uint64_t generation = snapshot->generation;
+    m_chainSnapshot = std::move(snapshot);
+    return generation;
+}
+
+void ClapProcessingEngine::publishChain(std::vector<std::unique_ptr<ProcessorEntry>> retired)
+{
+    publishSnapshot({});
+    // the audio thread can't start the removed processors anymore, so the ones that weren't
+    // started by now can be destroyed right away. the started ones must be stopped by the audio
+    // thread first, and if it doesn't get around to it, they are kept until the stream has been
+    // closed
+    std::vector<ProcessorEntry *> started;
+    for (auto &e : retired)
+        if (e->isProcessingStarted.load())
+            started.push_back(e.get());
+    if (started.empty())
+        return;
+    auto generation = publishSnapshot(std::move(started));
+    auto waitStart = std::chrono::steady_clock::now();
+    while (m_audioChainGeneration.load() < generation)
+    {
+        if (std::chrono::steady_clock::now() - waitStart > 200ms)
+        {
+            for (auto &e : retired)
+                m_retiredProcessors.push_back(std::move(e));
+            return;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
 }
 
 // note that this method should always be run in a non-main thread, to keep
-// Clap plugins happy with their thread checks etc
+// Clap plugins happy with their thread checks etc. it doesn't lock anything, the control
+// methods communicate with it via atomics, FIFOs and the published chain snapshot.
 void ClapProcessingEngine::processAudio(choc::buffer::ChannelArrayView<float> inputBuffer,
                                         choc::buffer::ChannelArrayView<float> outputBuffer)
 {
     // assert(m_isPrepared);
     assert(inputBuffer.getNumFrames() == outputBuffer.getNumFrames());
-    std::lock_guard<std::mutex> locker(m_mutex);
-    if (m_processorsState == ProcState::Idle || m_isSuspended)
+    ProcessorChainSnapshot *chain = nullptr;
+    do
+    {
+        chain = m_activeChain.load();
+        m_chainInUse.store(chain);
+    } while (chain != m_activeChain.load());
+    if (chain)
+        processChainSnapshot(*chain, inputBuffer, outputBuffer);
+    else
+        outputBuffer.clear();
+    m_chainInUse.store(nullptr);
+}
+
+void ClapProcessingEngine::processChainSnapshot(ProcessorChainSnapshot &chain,
+                                                choc::buffer::ChannelArrayView<float> inputBuffer,
+                                                choc::buffer::ChannelArrayView<float> outputBuffer)
+{
+    if (chain.generation != m_audioChainGeneration)
+    {
+        for (auto e : chain.retired)
+        {
+            if (e->isProcessingStarted.exchange(false))
+                e->m_proc->stopProcessing();
+        }
+        m_audioChainGeneration.store(chain.generation);
+    }
+    auto state = m_processorsState.load();
+    if (state == ProcState::Idle || m_isSuspended)
     {
         outputBuffer.clear();
         return;
     }
-    if (m_processorsState == ProcState::NeedsStopping)
+    if (state == ProcState::NeedsStopping)
     {
-        for (auto &c : m_chain)
+        for (auto c : chain.processors)
         {
-            c->m_proc->stopProcessing();
+            if (c->isProcessingStarted.exchange(false))
+                c->m_proc->stopProcessing();
         }
         outputBuffer.clear();
-        m_processorsState = ProcState::Idle;
+        // unless the main thread has meanwhile asked to start again
+        m_processorsState.compare_exchange_strong(state, ProcState::Idle);
         return;
     }
-    if (m_processorsState == ProcState::NeedsStarting)
+    if (state == ProcState::NeedsStarting)
+        m_processorsState.compare_exchange_strong(state, ProcState::Started);
+    // also starts the processors added while playing
+    for (auto c : chain.processors)
     {
-        for (auto &c : m_chain)
+        if (!c->isProcessingStarted.load())
         {
             c->m_proc->startProcessing();
+            c->isProcessingStarted = true;
         }
-        m_processorsState = ProcState::Started;
     }
     list_in.clear();
     list_out.clear();
@@ -608,9 +1270,40 @@ void ClapProcessingEngine::processAudio(choc::buffer::ChannelArrayView<float> in
     {
         ClapEventSequence::Event msgcopy{msg};
         msgcopy.timestamp = msg.timestamp + m_samplePlayPos;
-        m_delayed_messages.push_back(msgcopy);
+        m_delayed_messages.schedule(msgcopy);
+    }
+    m_due_messages.clear();
+    while (m_due_messages.size() < m_due_messages.capacity() &&
+           m_delayed_messages.popDue(m_samplePlayPos + procblocksize, msg))
+    {
+        // late messages are sent at the start of the block
+        msg.event.header.time = std::clamp<int64_t>((int64_t)msg.timestamp - m_samplePlayPos,
+                                                    0, procblocksize - 1);
+        m_due_messages.push_back(msg);
+    }
+    auto &processors = chain.processors;
+    // the processors ping-pong between the two buffers instead of the output being copied into
+    // the input after each of them. the starting side is chosen so that the last processor
+    // writes into outputbuffers[0], the first processor gets the start of the engine input.
+    m_clap_inbufs[0].data32 = (float **)inputbuffers[0].getView().data.channels;
+    m_clap_outbufs[0].data32 = (float **)outputbuffers[0].getView().data.channels;
+    if (processors.size() % 2 == 0)
+        std::swap(m_clap_inbufs[0].data32, m_clap_outbufs[0].data32);
+    // without processors the input would be copied straight into the output, so an engine with
+    // only the independent chains skips the legacy chain and gets just the chains' mix
+    uint32_t numLegacyChannels = processors.empty() ? 0 : m_clap_inbufs[0].channel_count;
+    for (uint32_t ch = 0; ch < numLegacyChannels; ++ch)
+    {
+        float *dest = m_clap_inbufs[0].data32[ch];
+        if (ch < inputBuffer.getNumChannels())
+        {
+            const float *src = inputBuffer.data.channels[ch] + inputBuffer.data.offset;
+            std::copy(src, src + procblocksize, dest);
+        }
+        else
+            std::fill(dest, dest + procblocksize, 0.0f);
     }
-    for (size_t i = 0; i < m_chain.size(); ++i)
+    for (size_t i = 0; i < processors.size(); ++i)
     {
         if (sendAllNotesOff)
         {
@@ -624,22 +1317,16 @@ void ClapProcessingEngine::processAudio(choc::buffer::ChannelArrayView<float> in
                 }
             }
         }
-        // need to optimize this
-        for (auto &dm : m_delayed_messages)
+        for (auto &dm : m_due_messages)
         {
-            if (dm.extdata0 == i && NumericRange<int64_t>(m_samplePlayPos)
-                                        .withLength(procblocksize)
-                                        .contains(dm.timestamp))
-            {
-                dm.timestamp = -1.0;
+            if (dm.extdata0 == i)
                 list_in.push((clap_event_header_t *)&dm.event);
-            }
         }
 
-        auto blockevts = m_chain[i]->m_eviter->readNextEvents(procblocksize);
-        for (auto &e : blockevts)
+        auto blockevts = processors[i]->m_eviter->readNextEvents(procblocksize);
+        for (auto e : blockevts)
         {
-            auto ecopy = e.event;
+            auto ecopy = e.copyEvent();
             ecopy.header.time = (e.timestamp * m_samplerate) - m_transportposSamples;
             if (ecopy.header.time >= m_clap_process.frames_count)
             {
@@ -671,17 +1358,28 @@ void ClapProcessingEngine::processAudio(choc::buffer::ChannelArrayView<float> in
             // ++eventssent;
         }
 
-        auto status = m_chain[i]->m_proc->process(&m_clap_process);
+        auto status = processors[i]->m_proc->process(&m_clap_process);
         // if (status == CLAP_PROCESS_ERROR)
         //     throw std::runtime_error("Clap processing failed");
         list_in.clear();
         list_out.clear();
-        choc::buffer::copy(inputbuffers[0], outputbuffers[0]);
+        std::swap(m_clap_inbufs[0].data32, m_clap_outbufs[0].data32);
+    }
+    auto legacyOutput = outputbuffers[0].getView();
+    for (uint32_t ch = 0; ch < outputBuffer.getNumChannels(); ++ch)
+    {
+        float *dest = outputBuffer.data.channels[ch] + outputBuffer.data.offset;
+        if (ch < legacyOutput.getNumChannels() && ch < numLegacyChannels)
+        {
+            const float *src = legacyOutput.data.channels[ch];
+            std::copy(src, src + procblocksize, dest);
+        }
+        else
+            std::fill(dest, dest + procblocksize, 0.0f);
     }
-    choc::buffer::copy(outputBuffer, outputbuffers[0]);
+    processChains(inputBuffer, outputBuffer);
     choc::buffer::applyGain(outputBuffer, m_mainGain);
     m_samplePlayPos += procblocksize;
-    std::erase_if(m_delayed_messages, [](auto &&dm) { return dm.timestamp < 0.0; });
 }
 
 int CPECallback(void *outputBuffer, void *inputBuffer, unsigned int nFrames, double streamTime,
@@ -689,15 +1387,15 @@ int CPECallback(void *outputBuffer, void *inputBuffer, unsigned int nFrames, dou
 {
     float *fobuf = (float *)outputBuffer;
     float *fibuf = (float *)inputBuffer;
+    XEN_RTCHECK_AUDIO_SCOPE;
     ClapProcessingEngine &cpe = *(ClapProcessingEngine *)userData;
-    cpe.processAudio(cpe.inputConversionBuffer, cpe.outputConversionBuffer);
-    for (unsigned int i = 0; i < nFrames; ++i)
-    {
-        fobuf[i * 2 + 0] = cpe.outputConversionBuffer.getSample(0, i);
-        fobuf[i * 2 + 1] = cpe.outputConversionBuffer.getSample(1, i);
-        fobuf[i * 2 + 0] = std::clamp(fobuf[i * 2 + 0], -1.0f, 1.0f);
-        fobuf[i * 2 + 1] = std::clamp(fobuf[i * 2 + 1], -1.0f, 1.0f);
-    }
+    auto inView = cpe.inputConversionBuffer.getView().getStart(nFrames);
+    auto outView = cpe.outputConversionBuffer.getView().getStart(nFrames);
+    if (fibuf && cpe.m_numStreamInputs > 0)
+        xenakios::deinterleave(fibuf, cpe.m_numStreamInputs, inView.data.channels, nFrames);
+    cpe.processAudio(inView, outView);
+    xenakios::interleaveClamped(cpe.m_deviceOutputSources.data(), cpe.m_numStreamOutputs, fobuf,
+                                nFrames);
     cpe.m_timerPosSamples += nFrames;
     if (cpe.m_timerPosSamples >= 44100)
     {
@@ -717,10 +1415,15 @@ void ClapProcessingEngine::runMainThreadTasks()
 // prepare the processing chain here, must be called from main thread
 void ClapProcessingEngine::prepareToPlay(double sampleRate, int maxBufferSize)
 {
-    if (m_chain.size() == 0)
+    if (m_chain.size() == 0 && m_chains.size() == 0)
         throw std::runtime_error("There are no plugins in the chain to process");
     int procblocksize = maxBufferSize;
     m_samplerate = sampleRate;
+    m_maxBlockSize = maxBufferSize;
+    m_delayed_messages.reset(8192);
+    m_due_messages.clear();
+    m_due_messages.reserve(1024);
+    m_realtime_messages_to_plugins.reset(4096);
     m_transportposSamples = 0;
     double maxTailSeconds = 0.0;
     size_t chainIndex = 0;
@@ -758,8 +1461,14 @@ void ClapProcessingEngine::prepareToPlay(double sampleRate, int maxBufferSize)
 
     for (auto &p : m_chain)
     {
-        p->m_eviter.emplace(p->m_seq, sampleRate);
+        p->prepareEventIterator(sampleRate);
     }
+    if (!m_chains.empty())
+        prepareChains(sampleRate, maxBufferSize);
+    // the snapshots are otherwise only published when the chain changes, but the audio thread
+    // needs one to process the independent chains too
+    if (!m_chainSnapshot)
+        publishChain();
     m_processorsState = ProcState::NeedsStarting;
     m_isPrepared = true;
     m_clap_process.audio_inputs_count = 1;
@@ -788,28 +1497,47 @@ void ClapProcessingEngine::prepareToPlay(double sampleRate, int maxBufferSize)
 void ClapProcessingEngine::startStreaming(std::optional<unsigned int> id, double sampleRate,
                                           int preferredBufferSize, bool blockExecution)
 {
-    m_delayed_messages.reserve(512);
-    m_delayed_messages.clear();
-
-    m_realtime_messages_to_plugins.reset(512);
     RtAudio::StreamParameters outpars;
     if (id)
         outpars.deviceId = *id;
     else
         outpars.deviceId = m_rtaudio->getDefaultOutputDevice();
     outpars.firstChannel = 0;
-    outpars.nChannels = 2;
+    outpars.nChannels = m_numStreamOutputs;
+    // duplex streams use the output device for the input too, a single stream can't
+    // synchronize two separate devices
+    RtAudio::StreamParameters inpars;
+    inpars.deviceId = outpars.deviceId;
+    inpars.firstChannel = 0;
+    inpars.nChannels = m_numStreamInputs;
     unsigned int bframes = preferredBufferSize;
-    auto err = m_rtaudio->openStream(&outpars, nullptr, RTAUDIO_FLOAT32, sampleRate, &bframes,
-                                     CPECallback, this, nullptr);
+    auto err = m_rtaudio->openStream(&outpars, m_numStreamInputs > 0 ? &inpars : nullptr,
+                                     RTAUDIO_FLOAT32, sampleRate, &bframes, CPECallback, this,
+                                     nullptr);
+    if (err != RTAUDIO_NO_ERROR)
+    {
+        throw std::runtime_error(std::format("Error opening RTAudio stream with {} inputs and {} "
+                                             "outputs",
+                                             m_numStreamInputs, m_numStreamOutputs));
+    }
     prepareToPlay(sampleRate, bframes);
-    outputConversionBuffer = choc::buffer::ChannelArrayBuffer<float>{2, bframes};
+    unsigned int numEngineOutputs =
+        m_outputChannelMap.empty() ? m_numStreamOutputs : m_outputChannelMap.size();
+    outputConversionBuffer = choc::buffer::ChannelArrayBuffer<float>{numEngineOutputs, bframes};
     outputConversionBuffer.clear();
-    inputConversionBuffer = choc::buffer::ChannelArrayBuffer<float>{2, bframes};
+    inputConversionBuffer = choc::buffer::ChannelArrayBuffer<float>{
+        (unsigned int)std::max(m_numStreamInputs, 2), bframes};
     inputConversionBuffer.clear();
-    if (err != RTAUDIO_NO_ERROR)
+    m_silentChannel.assign(bframes, 0.0f);
+    m_deviceOutputSources.assign(m_numStreamOutputs, m_silentChannel.data());
+    auto engineOutputs = outputConversionBuffer.getView();
+    for (unsigned int i = 0; i < numEngineOutputs; ++i)
     {
-        throw std::runtime_error("Error opening RTAudio stream");
+        int deviceChannel = m_outputChannelMap.empty() ? i : m_outputChannelMap[i];
+        // the first engine channel mapped to a device channel wins
+        if (deviceChannel >= 0 && deviceChannel < m_numStreamOutputs &&
+            m_deviceOutputSources[deviceChannel] == m_silentChannel.data())
+            m_deviceOutputSources[deviceChannel] = engineOutputs.data.channels[i];
     }
     err = m_rtaudio->startStream();
     if (err != RTAUDIO_NO_ERROR)
@@ -824,6 +1552,55 @@ void ClapProcessingEngine::startStreaming(std::optional<unsigned int> id, double
     }
 }
 
+void ClapProcessingEngine::startNullStreaming(double sampleRate, int bufferSize,
+                                              std::string recordFile)
+{
+    if (m_rtaudio->isStreamOpen() || (m_nullDriver && m_nullDriver->isRunning()))
+        throw std::runtime_error("Already streaming");
+    if (bufferSize < 1 || bufferSize > 65536)
+        throw std::runtime_error(std::format("Invalid null device buffer size {}", bufferSize));
+    prepareToPlay(sampleRate, bufferSize);
+    unsigned int numEngineOutputs =
+        m_outputChannelMap.empty() ? m_numStreamOutputs : m_outputChannelMap.size();
+    if (!m_nullDriver)
+        m_nullDriver = std::make_unique<NullAudioDriver>();
+    m_nullDriver->start(
+        sampleRate, bufferSize, std::max(m_numStreamInputs, 2), numEngineOutputs,
+        [this](choc::buffer::ChannelArrayView<float> input,
+               choc::buffer::ChannelArrayView<float> output) {
+            XEN_RTCHECK_AUDIO_SCOPE;
+            processAudio(input, output);
+        },
+        recordFile);
+}
+
+NullAudioDriver::Stats ClapProcessingEngine::getNullStreamingStats() const
+{
+    if (!m_nullDriver)
+        return {};
+    return m_nullDriver->getStats();
+}
+
+void ClapProcessingEngine::setStreamChannels(int numInputs, int numOutputs,
+                                             std::vector<int> outputChannelMap)
+{
+    if (m_rtaudio->isStreamOpen() || (m_nullDriver && m_nullDriver->isRunning()))
+        throw std::runtime_error("Stream channels can't be changed while streaming");
+    if (numInputs < 0 || numInputs > 256 || numOutputs < 1 || numOutputs > 256)
+        throw std::runtime_error(std::format("Invalid stream channel counts {} inputs {} outputs",
+                                             numInputs, numOutputs));
+    for (int deviceChannel : outputChannelMap)
+    {
+        if (deviceChannel >= numOutputs)
+            throw std::runtime_error(std::format(
+                "Output channel map refers to channel {} of {} output channels", deviceChannel,
+                numOutputs));
+    }
+    m_numStreamInputs = numInputs;
+    m_numStreamOutputs = numOutputs;
+    m_outputChannelMap = std::move(outputChannelMap);
+}
+
 void ClapProcessingEngine::setMainVolume(double decibels)
 {
     decibels = std::clamp(decibels, -100.0, 12.0);
@@ -864,8 +1641,31 @@ void ClapProcessingEngine::stopStreaming()
         m_rtaudio->stopStream();
     if (m_rtaudio->isStreamOpen())
         m_rtaudio->closeStream();
+    if (m_nullDriver)
+        m_nullDriver->stop();
+    // in case the stream stopped running before the audio thread could stop the processors
+    for (auto &c : m_chain)
+    {
+        if (c->isProcessingStarted.exchange(false))
+            c->m_proc->stopProcessing();
+    }
+    for (auto &c : m_retiredProcessors)
+    {
+        if (c->isProcessingStarted.exchange(false))
+            c->m_proc->stopProcessing();
+    }
+    m_retiredProcessors.clear();
+    // the current snapshot may still list the processors destroyed above as retired
+    if (m_chainSnapshot)
+        m_audioChainGeneration.store(m_chainSnapshot->generation);
+    for (auto &c : m_chains)
+        c->stopProcessing();
+    m_processorsState = ProcState::Idle;
     if (m_delayed_messages.size() > 0)
         std::cout << m_delayed_messages.size() << " delayed messages left\n";
+    if (m_delayed_messages.getNumDropped() > 0)
+        std::cout << m_delayed_messages.getNumDropped()
+                  << " delayed messages dropped because the queue was full\n";
     m_gui_tasks_timer.clear();
 }
 
@@ -1122,35 +1922,12 @@ std::string ClapProcessingEngine::getParametersAsJSON(size_t chainIndex)
 {
     if (chainIndex >= m_chain.size())
         throw std::runtime_error("Chain index out of bounds");
-    auto paramsarray = choc::value::createEmptyArray();
     auto plug = m_chain[chainIndex]->m_proc.get();
     // Should not activate if already activated...but we don't have a consistent way to track that
     // yet. But we do need to activate for plugins that fill in the up to date parameter info
     // only after activation.
     plug->activate(44100.0, 512, 512);
-    for (int i = 0; i < plug->paramsCount(); ++i)
-    {
-        clap_param_info info;
-        if (plug->paramsInfo(i, &info))
-        {
-            auto infoobject = choc::value::createObject("info");
-            infoobject.setMember("name", std::string(info.name));
-            infoobject.setMember("id", (int64_t)info.id);
-            infoobject.setMember("defaultval", info.default_value);
-            infoobject.setMember("minval", info.min_value);
-            infoobject.setMember("maxval", info.max_value);
-            double origin = 0.0;
-            if (plug->paramsOrigin(info.id, &origin))
-            {
-                infoobject.setMember("origin", origin);
-            }
-            infoobject.setMember("module", std::string(info.module));
-            // Can do the needed bit checks in Python, but I suppose would be nice
-            // to have some kind of string from the flags too
-            infoobject.setMember("flags", (int64_t)info.flags);
-            paramsarray.addArrayElement(infoobject);
-        }
-    }
+    auto paramsarray = getParameterInfos(plug);
     // Should not deactivate if already deactivated...
     plug->deactivate();
     return choc::json::toString(paramsarray, true);
@@ -1305,68 +2082,28 @@ void ProcessorChain::activate(double sampleRate, int maxBlockSize)
             e->m_proc->deactivate();
         }
     }
-    inputBuffers.resize(32);
-    outputBuffers.resize(32);
-    inChannelPointers.resize(64);
-    outChannelPointers.resize(64);
-    int maxInBuffersNeeded = 0;
-    int maxOutBuffersNeeded = 0;
-    int maxInPortsNeeded = 0;
-    int maxOutPortsNeeded = 0;
+    portLayouts.clear();
     for (auto &e : m_processors)
     {
-        e->m_eviter.emplace(e->m_seq, sampleRate);
         e->m_proc->activate(sampleRate, maxBlockSize, maxBlockSize);
-        int inChans = 0;
-        int numInports = e->m_proc->audioPortsCount(true);
-        // if (numInports > inputBuffers.size())
-        //    inputBuffers.resize(numInports);
-        maxInPortsNeeded = std::max<int>(maxInPortsNeeded, numInports);
-        for (int i = 0; i < numInports; ++i)
-        {
-            clap_audio_port_info pinfo;
-            e->m_proc->audioPortsInfo(i, true, &pinfo);
-            inChans += pinfo.channel_count;
-        }
-        maxInBuffersNeeded = std::max<int>(inChans, maxInBuffersNeeded);
-        int outChans = 0;
-        int numOutports = e->m_proc->audioPortsCount(false);
-        // if (numOutports > outputBuffers.size())
-        //     outputBuffers.resize(numOutports);
-        maxOutPortsNeeded = std::max<int>(maxOutPortsNeeded, numOutports);
-        for (int i = 0; i < numOutports; ++i)
-        {
-            clap_audio_port_info pinfo;
-            e->m_proc->audioPortsInfo(i, false, &pinfo);
-            outChans += pinfo.channel_count;
-        }
-        maxOutBuffersNeeded = std::max<int>(outChans, maxOutBuffersNeeded);
-    }
-    // std::cout << "chain " << id << " needs " << maxInBuffersNeeded << " input buffers" << "\n";
-    audioInputData.resize(64 * maxBlockSize);
-
-    int i = 0;
-    for (auto &e : inputBuffers)
-    {
-        e.channel_count = 0;
-        e.constant_mask = 0;
-        e.data32 = nullptr;
-        e.data64 = nullptr;
-        e.latency = 0;
-    }
-    for (auto &e : outputBuffers)
-    {
-        e.channel_count = 0;
-        e.constant_mask = 0;
-        e.data32 = nullptr;
-        e.data64 = nullptr;
-        e.latency = 0;
-    }
-    // std::cout << "chain " << id << " needs " << maxOutBuffersNeeded << " output buffers" << "\n";
-    audioOutputData.resize(64 * maxBlockSize);
+        ChainBufferPlan::ProcessorPorts ports;
+        for (int isInput = 1; isInput >= 0; --isInput)
+        {
+            auto &dest = isInput ? ports.inputs : ports.outputs;
+            for (uint32_t i = 0; i < e->m_proc->audioPortsCount(isInput); ++i)
+            {
+                clap_audio_port_info pinfo;
+                if (!e->m_proc->audioPortsInfo(i, isInput, &pinfo))
+                    break;
+                dest.push_back({pinfo.channel_count, pinfo.id, pinfo.in_place_pair});
+            }
+        }
+        portLayouts.push_back(std::move(ports));
+    }
     blockSize = maxBlockSize;
     currentSampleRate = sampleRate;
-    eventIterator.emplace(chainSequence, sampleRate);
+    buildBufferPlan();
+    prepareEventIterators();
     chainGainSmoother.setParams(1.0f, 1.0f, sampleRate);
     isActivated = true;
 }
@@ -1402,6 +2139,8 @@ void ProcessorChain::setInputRouting(std::vector<std::tuple<int, int, int>> rout
         highestInputPort = std::max(std::get<1>(e), highestInputPort);
     }
     std::cout << "highest input port " << highestInputPort << "\n";
+    if (isActivated)
+        buildBufferPlan();
 }
 
 void ProcessorChain::setOutputRouting(std::vector<std::tuple<int, int, int>> routing)
@@ -1413,12 +2152,91 @@ void ProcessorChain::setOutputRouting(std::vector<std::tuple<int, int, int>> rou
         highestOutputChannel = std::max(highestOutputChannel, std::get<2>(conn));
     }
     std::cout << "highest output channel " << highestOutputChannel << "\n";
+    if (isActivated)
+        buildBufferPlan();
+}
+
+void ProcessorChain::buildBufferPlan()
+{
+    bufferPlan.build(portLayouts, inputRouting, outputRouting, blockSize);
+    int numInPlace = 0;
+    for (size_t i = 0; i < bufferPlan.getNumSteps(); ++i)
+        numInPlace += bufferPlan.getStep(i).inPlace;
+    std::cout << std::format("chain {} processes {} of {} plugins in place\n", id, numInPlace,
+                             bufferPlan.getNumSteps());
+}
+
+void ProcessorChain::prepareEventIterators()
+{
+    for (auto &e : m_processors)
+        e->prepareEventIterator(currentSampleRate);
+    eventIterator.reset();
+    compactChainSequence = CompactClapEventSequence(chainSequence);
+    eventIterator.emplace(compactChainSequence, currentSampleRate);
+}
+
+void ProcessorChain::rewind()
+{
+    samplePosition = 0;
+    // the sequences may have been edited since the last render
+    prepareEventIterators();
+}
+
+uint64_t ProcessorChain::getRenderKey(int64_t numFrames)
+{
+    RenderCache::KeyBuilder key;
+    // changed when the rendering changes in ways that make the earlier renders invalid
+    key.add("ProcessorChain render 1");
+    key.add(currentSampleRate).add((uint64_t)blockSize).add(numFrames);
+    key.add((uint64_t)inputRouting.size());
+    for (auto &[src, port, chan] : inputRouting)
+        key.add(src).add(port).add(chan);
+    key.add((uint64_t)outputRouting.size());
+    for (auto &[port, src, chan] : outputRouting)
+        key.add(port).add(src).add(chan);
+    key.add(chainSequence.getHash());
+    key.add((uint64_t)m_processors.size());
+    for (auto &e : m_processors)
+    {
+        auto proc = e->m_proc.get();
+        clap_plugin_descriptor desc;
+        if (proc->getDescriptor(&desc))
+        {
+            key.add(desc.id ? desc.id : "");
+            key.add(desc.version ? desc.version : "");
+        }
+        key.add(e->m_seq.getHash());
+        std::vector<char> state;
+        clap_ostream os;
+        os.ctx = &state;
+        os.write = [](const clap_ostream *stream, const void *buffer, uint64_t size) {
+            auto &data = *(std::vector<char> *)stream->ctx;
+            data.insert(data.end(), (const char *)buffer, (const char *)buffer + size);
+            return int64_t(size);
+        };
+        if (proc->stateSave(&os))
+        {
+            key.add(true).addBytes(state.data(), state.size());
+            continue;
+        }
+        // without state support, the parameter values are the best there is
+        key.add(false).add((uint64_t)proc->paramsCount());
+        for (uint32_t i = 0; i < proc->paramsCount(); ++i)
+        {
+            clap_param_info info;
+            double value = 0.0;
+            if (proc->paramsInfo(i, &info) && proc->paramsValue(info.id, &value))
+                key.add((uint32_t)info.id).add(value);
+        }
+    }
+    return key.getKey();
 }
 
 int ProcessorChain::processAudio(choc::buffer::ChannelArrayView<float> inputBuffer,
                                  choc::buffer::ChannelArrayView<float> outputBuffer)
 {
-    if (!isActivated)
+    // processors added after the activation aren't activated either
+    if (!isActivated || bufferPlan.getNumSteps() != m_processors.size())
         return -1;
     if (!isProcessing)
     {
@@ -1429,57 +2247,30 @@ int ProcessorChain::processAudio(choc::buffer::ChannelArrayView<float> inputBuff
         isProcessing = true;
     }
 
+    if (inputBuffer.getNumFrames() > blockSize)
+        return -2;
     clap_process cp;
     memset(&cp, 0, sizeof(clap_process));
     cp.frames_count = inputBuffer.getNumFrames();
     cp.in_events = inEventList.clapInputEvents();
     cp.out_events = outEventList.clapOutputEvents();
-    int numChainOutChans = highestOutputChannel + 1;
-    if (chainAudioOutputData.size() < numChainOutChans * cp.frames_count)
-        chainAudioOutputData.resize(numChainOutChans * cp.frames_count);
-    std::fill(chainAudioOutputData.begin(), chainAudioOutputData.end(), 0.0f);
-
-    cp.audio_inputs_count = highestInputPort + 1;
-    int chancounter = 0;
-    for (int i = 0; i < highestInputPort + 1; ++i)
-    {
-        inputBuffers[i].channel_count = 2;
-        inputBuffers[i].data32 = &inChannelPointers[chancounter];
-        for (int j = 0; j < 2; ++j)
-        {
-            inputBuffers[i].data32[j] = getInputBuffer(chancounter);
-            ++chancounter;
-        }
-    }
-    cp.audio_inputs = inputBuffers.data();
-
-    int highestOutputPort = 0;
-    cp.audio_outputs_count = highestOutputPort + 1;
-    chancounter = 0;
-    for (int i = 0; i < highestOutputPort + 1; ++i)
-    {
-        outputBuffers[i].channel_count = 2;
-        outputBuffers[i].data32 = &outChannelPointers[chancounter];
-        for (int j = 0; j < 2; ++j)
-        {
-            outputBuffers[i].data32[j] = getOutputBuffer(chancounter);
-            ++chancounter;
-        }
-    }
-
-    cp.audio_outputs = outputBuffers.data();
 
     inEventList.clear();
     outEventList.clear();
-    for (auto &conn : inputRouting)
-    {
-        int sourchan = std::get<0>(conn);
-        int destport = std::get<1>(conn);
-        int destchan = std::get<2>(conn);
-        for (int j = 0; j < cp.frames_count; ++j)
+    const auto &routedInputs = bufferPlan.getRoutedInputs();
+    for (size_t i = 0; i < inputRouting.size(); ++i)
+    {
+        float *dest = routedInputs[i];
+        int sourchan = std::get<0>(inputRouting[i]);
+        if (!dest)
+            continue;
+        if (sourchan >= 0 && sourchan < inputBuffer.getNumChannels())
         {
-            cp.audio_inputs[destport].data32[destchan][j] = inputBuffer.getSample(sourchan, j);
+            const float *src = inputBuffer.data.channels[sourchan] + inputBuffer.data.offset;
+            std::copy(src, src + cp.frames_count, dest);
         }
+        else
+            std::fill(dest, dest + cp.frames_count, 0.0f);
     }
 
     for (size_t i = 0; i < m_processors.size(); ++i)
@@ -1498,29 +2289,34 @@ int ProcessorChain::processAudio(choc::buffer::ChannelArrayView<float> inputBuff
         }
         // handle presequenced events
         auto eventSpan = procEntry->m_eviter->readNextEvents(cp.frames_count);
-        for (auto &cev : eventSpan)
+        for (auto cev : eventSpan)
         {
-            auto evcopy = cev.event;
+            auto evcopy = cev.copyEvent();
             evcopy.header.time = (cev.timestamp * currentSampleRate) - samplePosition;
             // std::cout << samplePosition << " " << cev.timestamp << " " << evcopy.header.time
             //           << "\n";
             inEventList.push((clap_event_header *)&evcopy);
         }
+        // the plan has set things up so that the output of the previous processor is already in
+        // the input buffers
+        auto &step = bufferPlan.getStep(i);
+        for (float *chan : step.clearBeforeProcess)
+            std::fill(chan, chan + cp.frames_count, 0.0f);
+        cp.audio_inputs = step.inputs.data();
+        cp.audio_inputs_count = step.inputs.size();
+        cp.audio_outputs = step.outputs.data();
+        cp.audio_outputs_count = step.outputs.size();
         proc->process(&cp);
-        // need to fix this to deal with ports/channels properly
-        for (int j = 0; j < cp.frames_count; ++j)
-        {
-            cp.audio_inputs[0].data32[0][j] = cp.audio_outputs[0].data32[0][j];
-            cp.audio_inputs[0].data32[1][j] = cp.audio_outputs[0].data32[1][j];
-        }
+        inEventList.clear();
+        outEventList.clear();
     }
 
     auto eventSpan = eventIterator->readNextEvents(cp.frames_count);
-    for (auto &cev : eventSpan)
+    for (auto cev : eventSpan)
     {
-        if (cev.event.header.type == CLAP_EVENT_PARAM_VALUE)
+        if (cev.header->type == CLAP_EVENT_PARAM_VALUE)
         {
-            auto pev = (clap_event_param_value *)&cev.event;
+            auto pev = (const clap_event_param_value *)cev.header;
             if (pev->param_id == (clap_id)ChainParameters::Volume)
                 chainGain = xenakios::decibelsToGain(pev->value);
             if (pev->param_id == (clap_id)ChainParameters::Mute)
@@ -1530,37 +2326,40 @@ int ProcessorChain::processAudio(choc::buffer::ChannelArrayView<float> inputBuff
     float actualGain = chainGain;
     if (muted)
         actualGain = 0.0f;
-    if (outputBuffer.getNumChannels() > 0)
+    // without output channels in the view, the output goes into chainAudioOutputData with the
+    // channels one after another
+    if (outputBuffer.getNumChannels() == 0)
     {
-        // auto smoothedGain = chainGainSmoother.step(actualGain);
-        for (auto &conn : outputRouting)
+        int numChainOutChans = highestOutputChannel + 1;
+        if (chainOutputFrames != cp.frames_count ||
+            chainAudioOutputData.size() < numChainOutChans * cp.frames_count)
         {
-            int from_port = std::get<0>(conn);
-            int from_chan = std::get<1>(conn);
-            int to_chan = std::get<2>(conn);
-            if (to_chan >= 0 && to_chan < outputBuffer.getNumChannels())
-            {
-                for (int i = 0; i < cp.frames_count; ++i)
-                {
-                    outputBuffer.getSample(to_chan, i) =
-                        cp.audio_outputs[from_port].data32[from_chan][i];
-                }
-            }
+            // the layout changed, so the channels nothing is routed into have to be cleared
+            chainAudioOutputData.assign(numChainOutChans * cp.frames_count, 0.0f);
+            chainOutputFrames = cp.frames_count;
         }
     }
-    else
+    for (const auto &conn : bufferPlan.getOutputConnections())
     {
-        for (const auto &conn : outputRouting)
+        float *dest = nullptr;
+        if (outputBuffer.getNumChannels() > 0)
         {
-            int srcport = std::get<0>(conn);
-            int srchan = std::get<1>(conn);
-            int outchan = std::get<2>(conn);
-            float *optr = &chainAudioOutputData[cp.frames_count * outchan];
-            for (int i = 0; i < cp.frames_count; ++i)
-            {
-                optr[i] = cp.audio_outputs[srcport].data32[srchan][i];
-            }
+            if (conn.destChannel < outputBuffer.getNumChannels())
+                dest = outputBuffer.data.channels[conn.destChannel] + outputBuffer.data.offset;
         }
+        else if (conn.destChannel <= highestOutputChannel)
+            dest = &chainAudioOutputData[cp.frames_count * conn.destChannel];
+        if (!dest)
+            continue;
+        if (!conn.source)
+            std::fill(dest, dest + cp.frames_count, 0.0f);
+        else if (conn.add)
+        {
+            for (uint32_t i = 0; i < cp.frames_count; ++i)
+                dest[i] += conn.source[i];
+        }
+        else
+            std::copy(conn.source, conn.source + cp.frames_count, dest);
     }
 
     samplePosition += cp.frames_count;
@@ -1587,35 +2386,12 @@ std::string ProcessorChain::getParametersAsJSON(size_t chainIndex)
 {
     if (chainIndex >= m_processors.size())
         throw std::runtime_error("Chain index out of bounds");
-    auto paramsarray = choc::value::createEmptyArray();
     auto plug = m_processors[chainIndex]->m_proc.get();
     // Should not activate if already activated...but we don't have a consistent way to track that
     // yet. But we do need to activate for plugins that fill in the up to date parameter info
     // only after activation.
     plug->activate(44100.0, 512, 512);
-    for (int i = 0; i < plug->paramsCount(); ++i)
-    {
-        clap_param_info info;
-        if (plug->paramsInfo(i, &info))
-        {
-            auto infoobject = choc::value::createObject("info");
-            infoobject.setMember("name", std::string(info.name));
-            infoobject.setMember("id", (int64_t)info.id);
-            infoobject.setMember("defaultval", info.default_value);
-            infoobject.setMember("minval", info.min_value);
-            infoobject.setMember("maxval", info.max_value);
-            double origin = 0.0;
-            if (plug->paramsOrigin(info.id, &origin))
-            {
-                infoobject.setMember("origin", origin);
-            }
-            infoobject.setMember("module", std::string(info.module));
-            // Can do the needed bit checks in Python, but I suppose would be nice
-            // to have some kind of string from the flags too
-            infoobject.setMember("flags", (int64_t)info.flags);
-            paramsarray.addArrayElement(infoobject);
-        }
-    }
+    auto paramsarray = getParameterInfos(plug);
     // Should not deactivate if already deactivated...
     plug->deactivate();
     return choc::json::toString(paramsarray, true);
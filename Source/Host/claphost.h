@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <mutex>
 #include <set>
@@ -28,6 +29,11 @@
 #include "RtAudio.h"
 #include "../Common/clap_eventsequence.h"
 #include "../Common/xap_breakpoint_envelope.h"
+#include "../Common/xen_blockjobs.h"
+#include "clap_bufferplan.h"
+#include "null_audiodriver.h"
+#include "clap_plugincache.h"
+#include "clap_rendercache.h"
 #include "sst/basic-blocks/dsp/FollowSlewAndSmooth.h"
 #include "BS_thread_pool.hpp"
 
@@ -104,8 +110,22 @@ struct ProcessorEntry
 {
     std::unique_ptr<xenakios::XAudioProcessor> m_proc;
     ClapEventSequence m_seq;
-    std::optional<ClapEventSequence::IteratorSampleTime> m_eviter;
+    // compact copy of m_seq made when preparing for processing, the processing iterates it
+    // instead of m_seq for fewer cache misses and m_seq can be edited meanwhile
+    CompactClapEventSequence m_compactSeq;
+    std::optional<CompactClapEventSequence::IteratorSampleTime> m_eviter;
+    void prepareEventIterator(double sampleRate)
+    {
+        m_eviter.reset();
+        m_compactSeq = CompactClapEventSequence(m_seq);
+        m_eviter.emplace(m_compactSeq, sampleRate);
+    }
     std::string name;
+    // where the processor was created from, the file is empty for the internal processors
+    std::string pluginFile;
+    int pluginIndex = 0;
+    // set when the processor came from the instance pool, to be returned there with it
+    std::optional<std::vector<char>> pooledInitialState;
     std::unique_ptr<choc::ui::DesktopWindow> guiWindow;
     std::unordered_map<clap_id, std::string> idToStringMap;
     std::unordered_map<std::string, clap_id> stringToIdMap;
@@ -121,6 +141,20 @@ struct ProcessorEntry
         double d0 = 0.0;
     };
     choc::fifo::SingleReaderSingleWriterFIFO<Msg> from_ui_fifo;
+    // whether startProcessing has been called, changed by the audio thread and, for removed
+    // processors the audio thread didn't get to, by the main thread
+    std::atomic<bool> isProcessingStarted{false};
+};
+
+// The processors of ClapProcessingEngine::m_chain as seen by the audio thread. A new snapshot
+// is published whenever the chain changes and the old one is deleted after the audio thread has
+// stopped using it, so the audio thread never needs to lock anything to access the chain.
+struct ProcessorChainSnapshot
+{
+    uint64_t generation = 0;
+    std::vector<ProcessorEntry *> processors;
+    // removed by this change, the audio thread stops them if they were started
+    std::vector<ProcessorEntry *> retired;
 };
 
 class ProcessorChain
@@ -151,24 +185,19 @@ class ProcessorChain
     int getNumAudioPorts(size_t pluginIndex, bool isInput);
     clap_audio_port_info getAudioPortInfo(size_t pluginIndex, size_t portIndex, bool isInput);
     std::string getParametersAsJSON(size_t chainIndex);
-    std::vector<float> audioInputData;
-    float *getInputBuffer(size_t index)
-    {
-        if (audioInputData.empty())
-            return nullptr;
-        return &audioInputData[index * blockSize];
-    }
-    std::vector<clap_audio_buffer> inputBuffers;
-    std::vector<float> audioOutputData;
-    float *getOutputBuffer(size_t index)
-    {
-        if (audioOutputData.empty())
-            return nullptr;
-        return &audioOutputData[index * blockSize];
-    }
-    std::vector<clap_audio_buffer> outputBuffers;
-    std::vector<float *> inChannelPointers;
-    std::vector<float *> outChannelPointers;
+    // the audio port layouts of the processors, queried at activation
+    std::vector<ChainBufferPlan::ProcessorPorts> portLayouts;
+    // rebuilt at activation and when the routings change, which must not happen while processing
+    ChainBufferPlan bufferPlan;
+    void buildBufferPlan();
+    // back to the start of the sequences, for rendering again after the chain has been processed
+    void rewind();
+    // Key of a render of numFrames frames for the render cache, from the render settings, the
+    // routing, the sequences and the plugins with their states. The chain must be activated,
+    // plugins only provide their state after activation.
+    uint64_t getRenderKey(int64_t numFrames);
+    // the frame count chainAudioOutputData was laid out for
+    size_t chainOutputFrames = 0;
     clap::helpers::EventList inEventList;
     clap::helpers::EventList outEventList;
     size_t blockSize = 0;
@@ -179,7 +208,9 @@ class ProcessorChain
     std::thread::id main_thread_id;
     // events specific to the chain like output volume
     ClapEventSequence chainSequence;
-    std::optional<ClapEventSequence::IteratorSampleTime> eventIterator;
+    CompactClapEventSequence compactChainSequence;
+    std::optional<CompactClapEventSequence::IteratorSampleTime> eventIterator;
+    void prepareEventIterators();
     double chainGain = 1.0;
     sst::basic_blocks::dsp::SlewLimiter chainGainSmoother;
     bool muted = false;
@@ -189,6 +220,66 @@ class ProcessorChain
         Mute
     };
     BS::thread_pool<> thpool{1};
+    // when the engine processes several chains in parallel, always process this one on the
+    // same thread, for plugins that don't like being called from varying threads
+    bool pinnedThread = false;
+};
+
+// Messages posted to the processors from the control threads, waiting for their sample
+// position. A binary min-heap in storage allocated up front, so the audio thread can schedule
+// and dispatch messages in O(log n) without allocating. Messages with equal positions are
+// dispatched in the order they were scheduled.
+class DelayedMessageQueue
+{
+  public:
+    void reset(size_t capacity)
+    {
+        m_heap.clear();
+        m_heap.reserve(capacity);
+        m_counter = 0;
+        m_numDropped = 0;
+    }
+    // the timestamp of the event is its sample position, extdata0 the destination processor.
+    // returns false if the queue is full
+    bool schedule(const ClapEventSequence::Event &ev)
+    {
+        if (m_heap.size() == m_heap.capacity())
+        {
+            ++m_numDropped;
+            return false;
+        }
+        m_heap.push_back({ev, m_counter++});
+        std::push_heap(m_heap.begin(), m_heap.end(), Entry::later);
+        return true;
+    }
+    // pops the next message due before endPosition, messages that are already late are due too
+    bool popDue(int64_t endPosition, ClapEventSequence::Event &result)
+    {
+        if (m_heap.empty() || m_heap.front().event.timestamp >= endPosition)
+            return false;
+        std::pop_heap(m_heap.begin(), m_heap.end(), Entry::later);
+        result = m_heap.back().event;
+        m_heap.pop_back();
+        return true;
+    }
+    size_t size() const { return m_heap.size(); }
+    uint64_t getNumDropped() const { return m_numDropped; }
+
+  private:
+    struct Entry
+    {
+        ClapEventSequence::Event event;
+        uint64_t order = 0;
+        static bool later(const Entry &a, const Entry &b)
+        {
+            if (a.event.timestamp != b.event.timestamp)
+                return a.event.timestamp > b.event.timestamp;
+            return a.order > b.order;
+        }
+    };
+    std::vector<Entry> m_heap;
+    uint64_t m_counter = 0;
+    uint64_t m_numDropped = 0;
 };
 
 class ClapProcessingEngine
@@ -199,9 +290,34 @@ class ClapProcessingEngine
     std::vector<std::unique_ptr<ProcessorChain>> m_chains;
     ProcessorChain &addChain();
     ProcessorChain &getChain(size_t index);
+    // The chains in m_chains have no dependencies on each other, so they are processed in
+    // parallel, each into its own buffer, and mixed together after all of them are done.
+    // Chains added after prepareChains are only processed after the next prepare. The chains
+    // set in skipChains are activated but not processed, and they don't output anything.
+    void prepareChains(double sampleRate, int maxBlockSize,
+                       const std::vector<bool> &skipChains = {});
+    // the input is copied into the chains' input, the chains get silence if it's empty
+    void processChains(choc::buffer::ChannelArrayView<float> input,
+                       choc::buffer::ChannelArrayView<float> mixOutput);
+    // threads used in addition to the processing thread, negative uses all the cores
+    int m_numChainWorkers = -1;
+    std::unique_ptr<xenakios::BlockJobRunner> m_chainRunner;
+    std::vector<choc::buffer::ChannelArrayBuffer<float>> m_chainOutputs;
+    choc::buffer::ChannelArrayBuffer<float> m_chainInput;
+    uint32_t m_chainBlockFrames = 0;
     void setSequence(int targetProcessorIndex, ClapEventSequence seq);
     static std::vector<std::filesystem::path> scanPluginDirectories();
     static std::string scanPluginFile(std::filesystem::path plugfilename);
+    // The process wide plugin scan cache, stored in ClapScanCache::getDefaultCacheFile
+    static ClapScanCache &getScanCache();
+    // Plugin info from the scan cache as JSON, without loading the plugin when it's cached
+    static std::string getCachedPluginInfo(std::filesystem::path plugfilename);
+    static std::string getCachedParametersJSON(std::filesystem::path plugfilename,
+                                               int pluginIndex);
+    // With m_useInstancePool set, the plugins are taken from the process wide instance pool
+    // when available and returned to it when the engine is destroyed
+    static ClapInstancePool &getInstancePool();
+    bool m_useInstancePool = false;
     ClapProcessingEngine();
     ~ClapProcessingEngine();
     static std::set<ClapProcessingEngine *> &getEngines();
@@ -237,9 +353,38 @@ class ClapProcessingEngine
 
     void checkPluginIndex(size_t index);
 
+    // Settings for processToFile, processToFile2 only uses the block size. The plugins are
+    // switched into the CLAP offline render mode if they support it. A positive duration passed
+    // to processToFile is the length of the render. Otherwise the render ends after the last
+    // sequence event when the output has stayed below the silence threshold for the hold time,
+    // or when the tail reaches maxTailSeconds. Silence never ends a render without events.
+    struct OfflineRenderOptions
+    {
+        int blockSize = 512;
+        bool offlineMode = true;
+        bool stopOnSilence = true;
+        double silenceThresholdDecibels = -90.0;
+        double silenceHoldSeconds = 0.25;
+        double maxTailSeconds = 30.0;
+        // blocks processed and discarded before the render, for plugins that need them
+        int warmupBlocks = 0;
+        // splits the blocks at parameter events, for plugins that only apply parameter changes
+        // at the start of a block. the sub-blocks are at least this long, 0 disables splitting.
+        int automationSplitFrames = 0;
+    };
+    OfflineRenderOptions m_offlineOptions;
     int processToFile(std::string filename, double duration, double samplerate, int numoutchans,
                        std::function<int()> errcheckfunc);
+    // Renders the chains in m_chains. With m_useRenderCache set, the chains whose render is in
+    // the render cache are mixed in from there instead of being processed, and the renders of
+    // the others are stored into it.
     void processToFile2(std::string filename, double duration, double samplerate, int numoutchans);
+    bool m_useRenderCache = false;
+    // empty uses RenderCache::getDefaultDirectory
+    std::string m_renderCacheDirectory;
+    // of the last processToFile2 that used the render cache
+    int m_renderCacheHits = 0;
+    int m_renderCacheMisses = 0;
 
     void openPluginGUIBlocking(size_t chainIndex, bool closeImmediately);
 
@@ -251,6 +396,24 @@ class ClapProcessingEngine
     void prepareToPlay(double sampleRate, int maxBufferSize);
     void startStreaming(std::optional<unsigned int> deviceId, double sampleRate,
                         int preferredBufferSize, bool blockExecution);
+    // Device channels used by startStreaming, with 0 inputs the stream is output only, otherwise
+    // the inputs are read from the same device the outputs go to. Engine output channel n goes
+    // to device output channel outputChannelMap[n], -1 doesn't send it anywhere. An empty map
+    // sends the engine channels to the device channels in order. The device input channels go
+    // into the chains' inputs, to be routed to their plugins.
+    void setStreamChannels(int numInputs, int numOutputs, std::vector<int> outputChannelMap);
+    int m_numStreamInputs = 0;
+    int m_numStreamOutputs = 2;
+    std::vector<int> m_outputChannelMap;
+    // the engine output channel or silence for each device output channel
+    std::vector<const float *> m_deviceOutputSources;
+    std::vector<float> m_silentChannel;
+    // Streams through a virtual device running on its own clock instead of RtAudio, for testing
+    // and measuring the realtime processing on machines without audio hardware. The engine
+    // outputs are written into recordFile if it's not empty. Stopped by stopStreaming.
+    void startNullStreaming(double sampleRate, int bufferSize, std::string recordFile);
+    NullAudioDriver::Stats getNullStreamingStats() const;
+    std::unique_ptr<NullAudioDriver> m_nullDriver;
     void wait(double seconds);
     void stopStreaming();
     void allNotesOff();
@@ -259,6 +422,9 @@ class ClapProcessingEngine
     void postParameterMessage(int destination, double delay, clap_id parid, double value);
     void processAudio(choc::buffer::ChannelArrayView<float> inputBuffer,
                       choc::buffer::ChannelArrayView<float> outputBuffer);
+    void processChainSnapshot(ProcessorChainSnapshot &chain,
+                              choc::buffer::ChannelArrayView<float> inputBuffer,
+                              choc::buffer::ChannelArrayView<float> outputBuffer);
     void runMainThreadTasks();
     void setSuspended(bool b);
     choc::fifo::SingleReaderSingleWriterFIFO<ClapEventSequence::Event>
@@ -276,7 +442,9 @@ class ClapProcessingEngine
         double farg0 = 0.0;
     };
     choc::fifo::SingleReaderSingleWriterFIFO<EngineMessage> m_engineCommandFifo;
-    std::vector<ClapEventSequence::Event> m_delayed_messages;
+    DelayedMessageQueue m_delayed_messages;
+    // the delayed messages due in the current block, in dispatch order
+    std::vector<ClapEventSequence::Event> m_due_messages;
     int64_t m_samplePlayPos = 0;
     double m_mainGain = 1.0;
     choc::buffer::ChannelArrayBuffer<float> outputConversionBuffer;
@@ -293,9 +461,20 @@ class ClapProcessingEngine
     };
     std::atomic<ProcState> m_processorsState{ProcState::Idle};
     std::atomic<bool> m_isSuspended{false};
-    // lock this only when *absolutely* necessary
-    std::mutex m_mutex;
     std::atomic<bool> m_isPrepared{false};
+    int m_maxBlockSize = 0;
+    // main thread only
+    void publishChain(std::vector<std::unique_ptr<ProcessorEntry>> retired = {});
+    // returns the generation of the published snapshot
+    uint64_t publishSnapshot(std::vector<ProcessorEntry *> retired);
+    std::unique_ptr<ProcessorChainSnapshot> m_chainSnapshot;
+    std::atomic<ProcessorChainSnapshot *> m_activeChain{nullptr};
+    // hazard pointer, the snapshot the audio thread is processing or nullptr between blocks
+    std::atomic<ProcessorChainSnapshot *> m_chainInUse{nullptr};
+    // the generation of the latest snapshot the audio thread has seen
+    std::atomic<uint64_t> m_audioChainGeneration{0};
+    // removed processors the audio thread didn't stop in time, destroyed after closing the stream
+    std::vector<std::unique_ptr<ProcessorEntry>> m_retiredProcessors;
     clap_process m_clap_process;
     choc::messageloop::Timer m_gui_tasks_timer;
 };
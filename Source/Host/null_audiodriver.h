@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio/choc_SampleBuffers.h"
+#include "../Common/xen_audiofilewriter.h"
+#include "../Common/xen_interleave.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+A virtual audio device for running the realtime processing without audio hardware, for headless
+test and render machines. The callback is called from a dedicated thread with the highest
+priority the system allows for it, at the times a real device with the same sample rate and
+buffer size would call it. The thread sleeps until shortly before each deadline and spins for
+the rest, so the start times are accurate to a few microseconds.
+
+A callback that finishes after the start of the next buffer is counted as a deadline miss. When
+the processing falls more than a buffer behind, the missed buffers are skipped like a device
+would drop them, instead of the callbacks being run back to back to catch up.
+
+The output can be recorded into a WAV file. The audio thread only copies into a lock-free ring
+buffer, a separate thread writes the file.
+*/
+class NullAudioDriver
+{
+  public:
+    using Callback = std::function<void(choc::buffer::ChannelArrayView<float> input,
+                                        choc::buffer::ChannelArrayView<float> output)>;
+    struct Stats
+    {
+        int64_t numCallbacks = 0;
+        int64_t numDeadlineMisses = 0;
+        int64_t numSkippedBuffers = 0;
+        int64_t numRecordingDroppedFrames = 0;
+        double meanCallbackMs = 0.0;
+        double maxCallbackMs = 0.0;
+        // how late the callbacks started compared to the device clock
+        double meanJitterMs = 0.0;
+        double maxJitterMs = 0.0;
+        // callback duration relative to the buffer duration
+        double meanLoad = 0.0;
+        bool realtimePriority = false;
+    };
+
+    NullAudioDriver() = default;
+    ~NullAudioDriver() { stop(); }
+    NullAudioDriver(const NullAudioDriver &) = delete;
+    NullAudioDriver &operator=(const NullAudioDriver &) = delete;
+
+    void start(double sampleRate, uint32_t bufferSize, uint32_t numInputs, uint32_t numOutputs,
+               Callback callback, std::string recordFile = {})
+    {
+        stop();
+        if (sampleRate <= 0.0 || bufferSize == 0 || numOutputs == 0)
+            throw std::runtime_error(std::format("Invalid null device settings {} Hz {} frames "
+                                                 "{} outputs",
+                                                 sampleRate, bufferSize, numOutputs));
+        m_sampleRate = sampleRate;
+        m_bufferSize = bufferSize;
+        m_callback = std::move(callback);
+        m_input = choc::buffer::ChannelArrayBuffer<float>{numInputs, bufferSize};
+        m_input.clear();
+        m_output = choc::buffer::ChannelArrayBuffer<float>{numOutputs, bufferSize};
+        m_output.clear();
+        resetStats();
+        m_quit = false;
+        m_running = true;
+        if (!recordFile.empty())
+        {
+            auto writer = std::make_unique<xenakios::StreamingAudioFileWriter>(
+                recordFile, xenakios::StreamingAudioFileWriter::Format::WAV, numOutputs,
+                sampleRate);
+            // a couple of seconds, so the disk can stall for a while without losing audio
+            m_ringFrames = std::max<size_t>(sampleRate * 2.0, bufferSize * 4);
+            m_ring.assign(m_ringFrames * numOutputs, 0.0f);
+            m_interleaved.assign((size_t)bufferSize * numOutputs, 0.0f);
+            m_ringWritePos = 0;
+            m_ringReadPos = 0;
+            m_recorderThread = std::thread{[this, writer = std::move(writer)]() mutable {
+                recorderRun(*writer);
+            }};
+        }
+        m_audioThread = std::thread{[this]() { audioRun(); }};
+    }
+
+    void stop()
+    {
+        m_quit = true;
+        if (m_audioThread.joinable())
+            m_audioThread.join();
+        m_running = false;
+        // the recorder writes what is left in the ring before quitting
+        if (m_recorderThread.joinable())
+            m_recorderThread.join();
+        m_ring.clear();
+    }
+    bool isRunning() const { return m_running; }
+
+    Stats getStats() const
+    {
+        Stats result;
+        result.numCallbacks = m_numCallbacks.load();
+        result.numDeadlineMisses = m_numDeadlineMisses.load();
+        result.numSkippedBuffers = m_numSkippedBuffers.load();
+        result.numRecordingDroppedFrames = m_numRecordingDroppedFrames.load();
+        result.realtimePriority = m_realtimePriority.load();
+        result.maxCallbackMs = m_maxCallbackNs.load() / 1000000.0;
+        result.maxJitterMs = m_maxJitterNs.load() / 1000000.0;
+        if (result.numCallbacks > 0)
+        {
+            result.meanCallbackMs = m_sumCallbackNs.load() / 1000000.0 / result.numCallbacks;
+            result.meanJitterMs = m_sumJitterNs.load() / 1000000.0 / result.numCallbacks;
+            result.meanLoad = result.meanCallbackMs / (1000.0 * m_bufferSize / m_sampleRate);
+        }
+        return result;
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static bool setRealtimePriority()
+    {
+#ifdef _WIN32
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        // needs the rights for it, like CAP_SYS_NICE or an rtprio limit, otherwise the thread
+        // keeps the normal priority
+        sched_param param{};
+        param.sched_priority = std::max(sched_get_priority_max(SCHED_FIFO) - 10, 1);
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+    }
+
+    // sleeps most of the way and spins the last stretch, the sleeps can overshoot by more than
+    // the jitter we want to measure
+    static void waitUntil(clock::time_point deadline)
+    {
+        constexpr auto spinTime = std::chrono::microseconds(500);
+        if (deadline - clock::now() > spinTime)
+            std::this_thread::sleep_until(deadline - spinTime);
+        while (clock::now() < deadline)
+            std::this_thread::yield();
+    }
+
+    clock::time_point bufferStartTime(clock::time_point start, int64_t bufferIndex) const
+    {
+        // from the frame position, so the rounding of the period doesn't accumulate
+        double seconds = bufferIndex * (double)m_bufferSize / m_sampleRate;
+        return start + std::chrono::duration_cast<clock::duration>(
+                           std::chrono::duration<double>(seconds));
+    }
+
+    void audioRun()
+    {
+        m_realtimePriority = setRealtimePriority();
+        const auto start = clock::now();
+        int64_t bufferIndex = 0;
+        while (!m_quit)
+        {
+            const auto scheduled = bufferStartTime(start, bufferIndex);
+            waitUntil(scheduled);
+            const auto wakeTime = clock::now();
+            m_callback(m_input.getView(), m_output.getView());
+            const auto endTime = clock::now();
+            if (!m_ring.empty())
+                pushToRing();
+
+            using std::chrono::nanoseconds;
+            auto callbackNs = std::chrono::duration_cast<nanoseconds>(endTime - wakeTime);
+            auto jitterNs = std::chrono::duration_cast<nanoseconds>(wakeTime - scheduled);
+            m_sumCallbackNs += callbackNs.count();
+            m_maxCallbackNs = std::max<int64_t>(m_maxCallbackNs.load(), callbackNs.count());
+            m_sumJitterNs += jitterNs.count();
+            m_maxJitterNs = std::max<int64_t>(m_maxJitterNs.load(), jitterNs.count());
+            ++bufferIndex;
+            if (endTime > bufferStartTime(start, bufferIndex))
+                ++m_numDeadlineMisses;
+            // a real device wouldn't wait for us, so skip the buffers whose period has already
+            // passed and continue late from the current one
+            std::chrono::duration<double> elapsed = clock::now() - start;
+            auto current = (int64_t)std::floor(elapsed.count() * m_sampleRate / m_bufferSize);
+            if (current > bufferIndex)
+            {
+                m_numSkippedBuffers += current - bufferIndex;
+                bufferIndex = current;
+            }
+            ++m_numCallbacks;
+        }
+    }
+
+    void pushToRing()
+    {
+        const uint32_t numChans = m_output.getNumChannels();
+        auto outView = m_output.getView();
+        xenakios::interleaveClamped((const float *const *)outView.data.channels, numChans,
+                                    m_interleaved.data(), m_bufferSize);
+        size_t writePos = m_ringWritePos.load(std::memory_order_relaxed);
+        size_t readPos = m_ringReadPos.load(std::memory_order_acquire);
+        if (m_ringFrames - (writePos - readPos) < m_bufferSize)
+        {
+            m_numRecordingDroppedFrames += m_bufferSize;
+            return;
+        }
+        for (uint32_t i = 0; i < m_bufferSize; ++i)
+        {
+            size_t ringIndex = ((writePos + i) % m_ringFrames) * numChans;
+            std::copy(&m_interleaved[i * numChans], &m_interleaved[(i + 1) * numChans],
+                      &m_ring[ringIndex]);
+        }
+        m_ringWritePos.store(writePos + m_bufferSize, std::memory_order_release);
+    }
+
+    void recorderRun(xenakios::StreamingAudioFileWriter &writer)
+    {
+        const size_t numChans = m_output.getNumChannels();
+        while (true)
+        {
+            bool quitting = !m_running && m_quit;
+            size_t readPos = m_ringReadPos.load(std::memory_order_relaxed);
+            size_t writePos = m_ringWritePos.load(std::memory_order_acquire);
+            while (readPos < writePos)
+            {
+                size_t ringIndex = readPos % m_ringFrames;
+                size_t numFrames = std::min(writePos - readPos, m_ringFrames - ringIndex);
+                writer.writeInterleaved(&m_ring[ringIndex * numChans], (int)numFrames);
+                readPos += numFrames;
+                m_ringReadPos.store(readPos, std::memory_order_release);
+            }
+            if (quitting)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        writer.close();
+    }
+
+    void resetStats()
+    {
+        m_numCallbacks = 0;
+        m_numDeadlineMisses = 0;
+        m_numSkippedBuffers = 0;
+        m_numRecordingDroppedFrames = 0;
+        m_sumCallbackNs = 0;
+        m_maxCallbackNs = 0;
+        m_sumJitterNs = 0;
+        m_maxJitterNs = 0;
+    }
+
+    double m_sampleRate = 44100.0;
+    uint32_t m_bufferSize = 512;
+    Callback m_callback;
+    choc::buffer::ChannelArrayBuffer<float> m_input;
+    choc::buffer::ChannelArrayBuffer<float> m_output;
+    std::thread m_audioThread;
+    std::atomic<bool> m_quit{false};
+    std::atomic<bool> m_running{false};
+
+    std::vector<float> m_interleaved;
+    std::vector<float> m_ring;
+    size_t m_ringFrames = 0;
+    std::atomic<size_t> m_ringWritePos{0};
+    std::atomic<size_t> m_ringReadPos{0};
+    std::thread m_recorderThread;
+
+    std::atomic<int64_t> m_numCallbacks{0};
+    std::atomic<int64_t> m_numDeadlineMisses{0};
+    std::atomic<int64_t> m_numSkippedBuffers{0};
+    std::atomic<int64_t> m_numRecordingDroppedFrames{0};
+    std::atomic<int64_t> m_sumCallbackNs{0};
+    std::atomic<int64_t> m_maxCallbackNs{0};
+    std::atomic<int64_t> m_sumJitterNs{0};
+    std::atomic<int64_t> m_maxJitterNs{0};
+    std::atomic<bool> m_realtimePriority{false};
+};
@@ -123,9 +123,28 @@ static void addChainWithPlugins(ClapProcessingEngine &eng,
 }
 
 inline void clap_process_to_file_wrapper(ClapProcessingEngine &eng, std::string filename,
-                                         double duration, double samplerate, int numoutchans)
+                                         double duration, double samplerate, int numoutchans,
+                                         int blocksize, bool offline, bool stop_on_silence,
+                                         double silence_threshold_db, double silence_hold,
+                                         double max_tail, int automation_split)
 {
-    auto err = eng.processToFile(filename, duration, samplerate, numoutchans, PyErr_CheckSignals);
+    eng.m_offlineOptions.blockSize = blocksize;
+    eng.m_offlineOptions.offlineMode = offline;
+    eng.m_offlineOptions.stopOnSilence = stop_on_silence;
+    eng.m_offlineOptions.silenceThresholdDecibels = silence_threshold_db;
+    eng.m_offlineOptions.silenceHoldSeconds = silence_hold;
+    eng.m_offlineOptions.maxTailSeconds = max_tail;
+    eng.m_offlineOptions.automationSplitFrames = automation_split;
+    int err = 0;
+    {
+        // the engine runs its own message loop here while the render thread works, so the GIL
+        // only needs to be held briefly for the keyboard interrupt checks
+        py::gil_scoped_release release;
+        err = eng.processToFile(filename, duration, samplerate, numoutchans, []() {
+            py::gil_scoped_acquire acquire;
+            return PyErr_CheckSignals();
+        });
+    }
     if (err == -1)
         throw py::error_already_set();
 }
@@ -160,6 +179,23 @@ static py::list getParamsDict(ClapProcessingEngine &eng, size_t index)
     return parlist;
 }
 
+static py::dict getNullStreamingStats(ClapProcessingEngine &eng)
+{
+    auto stats = eng.getNullStreamingStats();
+    py::dict d;
+    d["callbacks"] = stats.numCallbacks;
+    d["deadline_misses"] = stats.numDeadlineMisses;
+    d["skipped_buffers"] = stats.numSkippedBuffers;
+    d["recording_dropped_frames"] = stats.numRecordingDroppedFrames;
+    d["mean_callback_ms"] = stats.meanCallbackMs;
+    d["max_callback_ms"] = stats.maxCallbackMs;
+    d["mean_jitter_ms"] = stats.meanJitterMs;
+    d["max_jitter_ms"] = stats.maxJitterMs;
+    d["mean_load"] = stats.meanLoad;
+    d["realtime_priority"] = stats.realtimePriority;
+    return d;
+}
+
 static void startStreaming(ClapProcessingEngine &eng, std::optional<unsigned int> deviceId,
                            double sampleRate, int preferredBufferSize, int blockExecution)
 {
@@ -225,6 +261,8 @@ inline py::array_t<float> processChain(ProcessorChain &chain, const py::array_t<
     auto err = fut.get();
     if (err == -1)
         throw std::runtime_error("Chain was not activated when processing called");
+    if (err == -2)
+        throw std::runtime_error("Chain was given more frames than it was activated for");
     int numoutchans = chain.highestOutputChannel + 1;
     py::buffer_info binfo(
         /* Pointer to buffer */
@@ -238,6 +276,16 @@ inline py::array_t<float> processChain(ProcessorChain &chain, const py::array_t<
     return output_audio;
 }
 
+inline py::array_t<double>
+envelope_get_values(xenakios::Envelope &env,
+                    py::array_t<double, py::array::c_style | py::array::forcecast> positions)
+{
+    py::array_t<double> result(std::vector<py::ssize_t>(positions.shape(),
+                                                        positions.shape() + positions.ndim()));
+    env.getValuesAtPositions(positions.data(), result.mutable_data(), positions.size());
+    return result;
+}
+
 double getParamAttribute(ProcessorEntry &proc, const std::string &name)
 {
     auto it = proc.stringToIdMap.find(name);
@@ -419,6 +467,9 @@ PYBIND11_MODULE(xenakios, m)
         .def("stop_processing", &ProcessorChain::stopProcessing)
         .def("set_input_routing", &ProcessorChain::setInputRouting)
         .def("set_output_routing", &ProcessorChain::setOutputRouting)
+        .def_readwrite("pinned_thread", &ProcessorChain::pinnedThread,
+                       "Always process the chain on the same thread when processing chains in "
+                       "parallel")
         .def("process", &processChain);
 
     py::class_<ClapProcessingEngine>(m, "ClapEngine")
@@ -430,6 +481,17 @@ PYBIND11_MODULE(xenakios, m)
         .def_static("scan_plugin_file", &ClapProcessingEngine::scanPluginFile,
                     "Returns plugin info as JSON formatted string")
         .def_static("scanPluginDirs", &ClapProcessingEngine::scanPluginDirectories)
+        .def_static("get_plugin_info_cached", &ClapProcessingEngine::getCachedPluginInfo,
+                    "Plugin descriptors, audio ports and parameters as JSON from the scan cache, "
+                    "the plugin file is scanned only when it's not cached or has changed")
+        .def_static("get_parameters_json_cached", &ClapProcessingEngine::getCachedParametersJSON,
+                    "Parameter infos of a plugin as JSON from the scan cache")
+        .def_static(
+            "clear_instance_pool", []() { ClapProcessingEngine::getInstancePool().clear(); },
+            "Destroy the plugin instances kept for reuse")
+        .def_readwrite("use_instance_pool", &ClapProcessingEngine::m_useInstancePool,
+                       "Take the plugins from the instance pool and return them there when the "
+                       "engine is destroyed, set before adding plugins")
         .def("set_sequence", &ClapProcessingEngine::setSequence)
         .def("getParametersJSON", &ClapProcessingEngine::getParametersAsJSON)
         .def("get_parameter_infos", getParamsDict)
@@ -447,10 +509,42 @@ PYBIND11_MODULE(xenakios, m)
         .def("set_main_volume", &ClapProcessingEngine::setMainVolume,
              "Set engine main volume in decibels")
         .def("stop_streaming", &ClapProcessingEngine::stopStreaming)
+        .def("start_null_streaming", &ClapProcessingEngine::startNullStreaming,
+             "samplerate"_a = 44100.0, "buffersize"_a = 512, "record_file"_a = "",
+             "Stream on a virtual device clocked by a high priority thread instead of an audio "
+             "device, optionally recording the output. Stopped with stop_streaming.")
+        .def("null_streaming_stats", &getNullStreamingStats,
+             "Callback count, deadline misses, callback durations and start time jitter of the "
+             "null device stream")
+        .def("set_stream_channels", &ClapProcessingEngine::setStreamChannels, "inputs"_a,
+             "outputs"_a, "output_channel_map"_a = std::vector<int>{},
+             "Set the device channels used by startStreaming. Engine output channel n goes to "
+             "device channel output_channel_map[n], -1 drops it, an empty map sends the channels "
+             "in order. The inputs go into the chains' inputs.")
+        .def_readwrite("chain_worker_threads", &ClapProcessingEngine::m_numChainWorkers,
+                       "Threads used for processing the chains in parallel, in addition to the "
+                       "processing thread. Negative uses all the cores.")
         .def("save_state_to_binary_file", &ClapProcessingEngine::saveStateToBinaryFile)
         .def("load_state_from_binary_file", &ClapProcessingEngine::loadStateFromBinaryFile)
+        .def("render_chains_to_file", &ClapProcessingEngine::processToFile2, "filename"_a,
+             "duration"_a, "samplerate"_a, "numoutchannels"_a = 2,
+             "Render the chains added with add_chain into a stereo file, in parallel",
+             py::call_guard<py::gil_scoped_release>())
+        .def_readwrite("use_render_cache", &ClapProcessingEngine::m_useRenderCache,
+                       "Mix the chains that haven't changed since they were last rendered from "
+                       "the render cache in render_chains_to_file, instead of rendering them")
+        .def_readwrite("render_cache_directory", &ClapProcessingEngine::m_renderCacheDirectory,
+                       "Directory of the render cache, empty uses the default")
+        .def_readonly("render_cache_hits", &ClapProcessingEngine::m_renderCacheHits)
+        .def_readonly("render_cache_misses", &ClapProcessingEngine::m_renderCacheMisses)
         .def("render_to_file", clap_process_to_file_wrapper, "filename"_a, "duration"_a,
-             "samplerate"_a, "numoutchannels"_a = 2);
+             "samplerate"_a, "numoutchannels"_a = 2, "blocksize"_a = 512, "offline"_a = true,
+             "stop_on_silence"_a = true, "silence_threshold_db"_a = -90.0,
+             "silence_hold"_a = 0.25, "max_tail"_a = 30.0, "automation_split"_a = 0,
+             "Render the chain offline. The render ends after the last event once the output has "
+             "stayed silent for silence_hold seconds, or after max_tail seconds. A duration "
+             "above 0 limits the length of the render. automation_split above 0 splits the "
+             "blocks at parameter events, into sub-blocks of at least that many frames.");
 
     py::class_<xenakios::EnvelopePoint>(m, "EnvelopePoint")
         .def(py::init<double, double>())
@@ -487,7 +581,10 @@ PYBIND11_MODULE(xenakios, m)
              [](xenakios::Envelope &v, int index) { return v.getPointSafePython(index); })
         .def("get_point", &xenakios::Envelope::getPointSafe)
         .def("set_point", &xenakios::Envelope::setPoint)
-        .def("get_value", &xenakios::Envelope::getValueAtPosition);
+        .def("get_value", &xenakios::Envelope::getValueAtPosition)
+        .def("get_values", envelope_get_values, "positions"_a,
+             "Evaluate the envelope at all positions of the array, returns an array of the same "
+             "shape");
     init_py4(m, m_const);
     
     init_py_ambisonics(m, m_const);
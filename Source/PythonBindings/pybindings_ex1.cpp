@@ -28,6 +28,7 @@
 #include "sst/basic-blocks/dsp/Lag.h"
 #include "text/choc_StringUtilities.h"
 #include "sst/basic-blocks/dsp/FollowSlewAndSmooth.h"
+#include "pyrenderjob.h"
 
 namespace py = pybind11;
 
@@ -313,41 +314,54 @@ inline py::array_t<float> render_signalsmith_stretch(py::array_t<float> input_au
     py::array_t<float> output_audio{binfo};
     float const *buftostretch[64];
 
-    int outsamplepos = 0;
-    while (insamplepos < inframes)
+    // the numpy arrays can't be accessed without the GIL, so get the channel pointers here
+    const float *inchans[64];
+    float *outchans[64];
+    for (int i = 0; i < numInChans && i < 64; ++i)
     {
-        auto evts = automiter.readNextEvents(blocksize);
-        for (auto &ev : evts)
-        {
-            if (ev.id == 0)
-                playrate = std::clamp(ev.value, minrate, maxrate);
-            if (ev.id == 1)
-            {
-                pitch = ev.value;
-                stretcher->setTransposeSemitones(pitch);
-            }
-        }
-        float *buf_from_stretch[64];
-        
-        for (int i = 0; i < 64; ++i)
+        inchans[i] = input_audio.data(i);
+        outchans[i] = output_audio.mutable_data(i);
+    }
+    run_interruptible([&](RenderJobControl &control) {
+        int outsamplepos = 0;
+        while (insamplepos < inframes)
         {
-            if (i < numInChans)
+            if (control.cancelRequested)
+                return;
+            auto evts = automiter.readNextEvents(blocksize);
+            for (auto &ev : evts)
             {
-                buftostretch[i] = &input_audio.data(i)[insamplepos];
-                buf_from_stretch[i] = &output_audio.mutable_data(i)[outsamplepos];
+                if (ev.id == 0)
+                    playrate = std::clamp(ev.value, minrate, maxrate);
+                if (ev.id == 1)
+                {
+                    pitch = ev.value;
+                    stretcher->setTransposeSemitones(pitch);
+                }
             }
-            else
+            float *buf_from_stretch[64];
+
+            for (int i = 0; i < 64; ++i)
             {
-                buftostretch[i] = nullptr;
-                buf_from_stretch[i] = nullptr;
+                if (i < numInChans)
+                {
+                    buftostretch[i] = &inchans[i][insamplepos];
+                    buf_from_stretch[i] = &outchans[i][outsamplepos];
+                }
+                else
+                {
+                    buftostretch[i] = nullptr;
+                    buf_from_stretch[i] = nullptr;
+                }
             }
+            int insamplestouse = std::min<int>(blocksize, inframes - insamplepos);
+            int numoutsamples = (1.0 / playrate) * insamplestouse;
+            stretcher->process(buftostretch, insamplestouse, buf_from_stretch, numoutsamples);
+            insamplepos += blocksize;
+            outsamplepos += numoutsamples;
+            control.progress = (double)insamplepos / inframes;
         }
-        int insamplestouse = std::min<int>(blocksize, inframes - insamplepos);
-        int numoutsamples = (1.0 / playrate) * insamplestouse;
-        stretcher->process(buftostretch, insamplestouse, buf_from_stretch, numoutsamples);
-        insamplepos += blocksize;
-        outsamplepos += numoutsamples;
-    }
+    });
     return output_audio;
 }
 
@@ -367,6 +381,113 @@ inline void addAudioBufferEvent(ClapEventSequence &seq, double time, int32_t tar
         numframes = arr.shape(0);
     seq.addAudioBufferEvent(time, target, ptr1, numChans, numframes, samplerate);
 }
+
+// NumPy column for the ClapSequence bulk adders, columns of length 1 (or scalars) are broadcast
+using sequence_column_t = py::array_t<double, py::array::c_style | py::array::forcecast>;
+
+struct SequenceColumn
+{
+    const double *data = nullptr;
+    size_t size = 0;
+    double operator[](size_t i) const { return size == 1 ? data[0] : data[i]; }
+};
+
+// checks the columns are of the same length (or length 1) and returns the event count
+inline size_t
+get_sequence_columns(std::initializer_list<std::pair<const char *, const sequence_column_t *>> in,
+                     std::vector<SequenceColumn> &out)
+{
+    size_t count = 1;
+    for (auto &c : in)
+    {
+        if (c.second->size() != 1)
+            count = c.second->size();
+    }
+    for (auto &c : in)
+    {
+        size_t sz = c.second->size();
+        if (sz != count && sz != 1)
+            throw std::runtime_error(
+                std::format("column {} has {} values, expected {}", c.first, sz, count));
+        out.push_back({c.second->data(), sz});
+    }
+    return count;
+}
+
+inline void add_notes_to_sequence(ClapEventSequence &seq, sequence_column_t times,
+                                  sequence_column_t durations, sequence_column_t keys,
+                                  sequence_column_t velocities, sequence_column_t ports,
+                                  sequence_column_t channels, sequence_column_t note_ids,
+                                  sequence_column_t retunes, bool presorted)
+{
+    std::vector<SequenceColumn> c;
+    size_t count = get_sequence_columns({{"times", &times},
+                                         {"durations", &durations},
+                                         {"keys", &keys},
+                                         {"velocities", &velocities},
+                                         {"ports", &ports},
+                                         {"channels", &channels},
+                                         {"note_ids", &note_ids},
+                                         {"retunes", &retunes}},
+                                        c);
+    size_t numretunes = 0;
+    for (size_t i = 0; i < count; ++i)
+        numretunes += std::abs(c[7][i]) >= 0.001;
+    size_t firstnew = seq.getNumEvents();
+    seq.reserveAdditional(count * 2 + numretunes);
+    for (size_t i = 0; i < count; ++i)
+        seq.addNote(c[0][i], c[1][i], c[4][i], c[5][i], c[2][i], c[6][i], c[3][i], c[7][i]);
+    if (presorted)
+        seq.mergeAppendedEvents(firstnew);
+}
+
+inline void add_parameter_events_to_sequence(ClapEventSequence &seq, sequence_column_t times,
+                                             sequence_column_t par_ids, sequence_column_t values,
+                                             bool ismod, sequence_column_t ports,
+                                             sequence_column_t channels, sequence_column_t keys,
+                                             sequence_column_t note_ids, bool presorted)
+{
+    std::vector<SequenceColumn> c;
+    size_t count = get_sequence_columns({{"times", &times},
+                                         {"par_ids", &par_ids},
+                                         {"values", &values},
+                                         {"ports", &ports},
+                                         {"channels", &channels},
+                                         {"keys", &keys},
+                                         {"note_ids", &note_ids}},
+                                        c);
+    size_t firstnew = seq.getNumEvents();
+    seq.reserveAdditional(count);
+    for (size_t i = 0; i < count; ++i)
+        seq.addParameterEvent(ismod, c[0][i], c[3][i], c[4][i], c[5][i], c[6][i],
+                              (uint32_t)c[1][i], c[2][i]);
+    if (presorted)
+        seq.mergeAppendedEvents(firstnew);
+}
+
+inline void add_note_expressions_to_sequence(ClapEventSequence &seq, sequence_column_t times,
+                                             sequence_column_t exp_types,
+                                             sequence_column_t values, sequence_column_t ports,
+                                             sequence_column_t channels, sequence_column_t keys,
+                                             sequence_column_t note_ids, bool presorted)
+{
+    std::vector<SequenceColumn> c;
+    size_t count = get_sequence_columns({{"times", &times},
+                                         {"exp_types", &exp_types},
+                                         {"values", &values},
+                                         {"ports", &ports},
+                                         {"channels", &channels},
+                                         {"keys", &keys},
+                                         {"note_ids", &note_ids}},
+                                        c);
+    size_t firstnew = seq.getNumEvents();
+    seq.reserveAdditional(count);
+    for (size_t i = 0; i < count; ++i)
+        seq.addNoteExpression(c[0][i], c[3][i], c[4][i], c[5][i], c[6][i], c[1][i], c[2][i]);
+    if (presorted)
+        seq.mergeAppendedEvents(firstnew);
+}
+
 #if XENPYAIRWINDOWS
 inline py::list get_aw_info()
 {
@@ -464,58 +585,65 @@ inline py::array_t<float> render_aw_to_buffer(AW_Wrapper &wrapper, double sample
     float *process_buffer_pointers[2];
     process_buffer_pointers[0] = &process_buffer[0];
     process_buffer_pointers[1] = &process_buffer[blocksize];
-    ClapEventSequence::IteratorSampleTime eviter(seq, samplerate);
-    while (inpos < (numinsamples - blocksize))
-    {
-        if (num_inchans == 1)
+    CompactClapEventSequence compactseq(seq);
+    run_interruptible([&](RenderJobControl &control) {
+        CompactClapEventSequence::IteratorSampleTime eviter(compactseq, samplerate);
+        while (inpos < (numinsamples - blocksize))
         {
-            for (int i = 0; i < blocksize; ++i)
+            if (control.cancelRequested)
+                return;
+            if (num_inchans == 1)
             {
-                process_buffer_pointers[0][i] = inchanpointers[0][i + inpos];
-                process_buffer_pointers[1][i] = inchanpointers[0][i + inpos];
+                for (int i = 0; i < blocksize; ++i)
+                {
+                    process_buffer_pointers[0][i] = inchanpointers[0][i + inpos];
+                    process_buffer_pointers[1][i] = inchanpointers[0][i + inpos];
+                }
             }
-        }
-        if (num_inchans == 2)
-        {
-            for (int i = 0; i < blocksize; ++i)
+            if (num_inchans == 2)
             {
-                process_buffer_pointers[0][i] = inchanpointers[0][i + inpos];
-                process_buffer_pointers[1][i] = inchanpointers[1][i + inpos];
+                for (int i = 0; i < blocksize; ++i)
+                {
+                    process_buffer_pointers[0][i] = inchanpointers[0][i + inpos];
+                    process_buffer_pointers[1][i] = inchanpointers[1][i + inpos];
+                }
             }
-        }
-        auto evts = eviter.readNextEvents(blocksize);
-        for (const auto &e : evts)
-        {
-            if (e.event.header.type == CLAP_EVENT_PARAM_VALUE)
+            auto evts = eviter.readNextEvents(blocksize);
+            for (auto e : evts)
             {
-                auto pev = (clap_event_param_value *)&e.event.header;
-                if (pev->param_id >= 0 && pev->param_id < wrapper.nparams)
+                if (e.header->type == CLAP_EVENT_PARAM_VALUE)
                 {
-                    wrapper.plug->setParameter(pev->param_id, pev->value);
+                    auto pev = (const clap_event_param_value *)e.header;
+                    if (pev->param_id >= 0 && pev->param_id < wrapper.nparams)
+                    {
+                        wrapper.plug->setParameter(pev->param_id, pev->value);
+                    }
                 }
             }
+            wrapper.plug->processReplacing(process_buffer_pointers, process_buffer_pointers,
+                                           blocksize);
+            for (int i = 0; i < blocksize; ++i)
+            {
+                outchanpointers[0][i + inpos] = process_buffer_pointers[0][i];
+                outchanpointers[1][i + inpos] = process_buffer_pointers[1][i];
+            }
+            inpos += blocksize;
+            control.progress = (double)inpos / numinsamples;
         }
-        wrapper.plug->processReplacing(process_buffer_pointers, process_buffer_pointers, blocksize);
-        for (int i = 0; i < blocksize; ++i)
-        {
-            outchanpointers[0][i + inpos] = process_buffer_pointers[0][i];
-            outchanpointers[1][i + inpos] = process_buffer_pointers[1][i];
-        }
-        inpos += blocksize;
-    }
+    });
     return output_audio;
 }
 
 inline void render_aw(AW_Wrapper &wrapper, ClapEventSequence &seq, std::string infile,
                       std::string outfile, double tail_len)
 {
-    seq.sortEvents();
     choc::audio::WAVAudioFileFormat<false> informat;
     auto reader = informat.createReader(infile);
     if (!reader)
         throw std::runtime_error("could not create audio file reader");
     auto &inprops = reader->getProperties();
-    ClapEventSequence::IteratorSampleTime eviter(seq, inprops.sampleRate);
+    CompactClapEventSequence compactseq(seq);
+    CompactClapEventSequence::IteratorSampleTime eviter(compactseq, inprops.sampleRate);
     unsigned int blockSize = 64;
     choc::buffer::ChannelArrayBuffer<float> inbuf{inprops.numChannels, blockSize};
     choc::buffer::ChannelArrayBuffer<float> outbuf{2, blockSize};
@@ -548,11 +676,11 @@ inline void render_aw(AW_Wrapper &wrapper, ClapEventSequence &seq, std::string i
             choc::buffer::copy(outbuf.getChannel(1), inbuf.getChannel(1));
         }
         auto evts = eviter.readNextEvents(blockSize);
-        for (const auto &e : evts)
+        for (auto e : evts)
         {
-            if (e.event.header.type == CLAP_EVENT_PARAM_VALUE)
+            if (e.header->type == CLAP_EVENT_PARAM_VALUE)
             {
-                auto pev = (clap_event_param_value *)&e.event.header;
+                auto pev = (const clap_event_param_value *)e.header;
                 if (pev->param_id >= 0 && pev->param_id < wrapper.nparams)
                 {
                     wrapper.plug->setParameter(pev->param_id, pev->value);
@@ -671,6 +799,10 @@ void init_py1(py::module_ &m)
         .def("__len__", &ClapEventSequence::getNumEvents)
         .def("clear", &ClapEventSequence::clearEvents)
         .def("get_size_in_bytes", &ClapEventSequence::getApproxSizeInBytes)
+        .def("get_compact_size_in_bytes",
+             [](const ClapEventSequence &seq) {
+                 return CompactClapEventSequence(seq).getSizeInBytes();
+             })
         .def("get_max_event_time", &ClapEventSequence::getMaximumEventTime)
         .def("add_string_to_pool", &ClapEventSequence::addString)
         .def("add_string_event", &ClapEventSequence::addStringEvent)
@@ -689,7 +821,19 @@ void init_py1(py::module_ &m)
              "port"_a = -1, "ch"_a = -1, "program"_a)
         .def("add_transport_event", &ClapEventSequence::addTransportEvent)
         .def("add_note_expression", &ClapEventSequence::addNoteExpression, "time"_a = 0.0,
-             "port"_a = -1, "ch"_a = 0, "key"_a = -1, "note_id"_a = -1, "exp_type"_a, "value"_a);
+             "port"_a = -1, "ch"_a = 0, "key"_a = -1, "note_id"_a = -1, "exp_type"_a, "value"_a)
+        // the bulk adders take NumPy arrays (or scalars, broadcast to all events). presorted
+        // puts the new events into time order among the earlier ones right away, so that the
+        // sort before rendering has nothing left to do.
+        .def("add_notes", add_notes_to_sequence, "times"_a, "durations"_a, "keys"_a,
+             "velocities"_a = 1.0, "ports"_a = 0, "channels"_a = 0, "note_ids"_a = -1,
+             "retunes"_a = 0.0, "presorted"_a = false)
+        .def("add_parameter_events", add_parameter_events_to_sequence, "times"_a, "par_ids"_a,
+             "values"_a, "ismod"_a = false, "ports"_a = -1, "channels"_a = -1, "keys"_a = -1,
+             "note_ids"_a = -1, "presorted"_a = false)
+        .def("add_note_expressions", add_note_expressions_to_sequence, "times"_a,
+             "exp_types"_a, "values"_a, "ports"_a = -1, "channels"_a = 0, "keys"_a = -1,
+             "note_ids"_a = -1, "presorted"_a = false);
 
     py::class_<AltMultiModulator>(m, "MultiLFO")
         .def(py::init<double>())
@@ -717,6 +861,7 @@ void init_py1(py::module_ &m)
             return std::string(buf);
         });
 #endif
+    init_render_job(m);
     m.def("fibonacci", &fibonacci, "n"_a, "keyboard_interrubtable"_a = true);
     m.def("signalsmith_stretch", &render_signalsmith_stretch, "input_audio"_a, "samplerate"_a,
           "automation"_a);
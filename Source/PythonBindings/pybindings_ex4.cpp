@@ -12,9 +12,15 @@
 #include <print>
 #include "sst/basic-blocks/dsp/SmoothingStrategies.h"
 #include <random>
+#include <variant>
 #include "../granularsynth/granularsynth.h"
 #include "../cli/xcli_utils.h"
 #include "../Common/xapdsp.h"
+#include "../Common/xen_ambidecoder.h"
+#include "../Common/xen_audiofilewriter.h"
+#include "../Common/xen_blocksanitizer.h"
+#include "pyrenderjob.h"
+#include "BS_thread_pool.hpp"
 
 namespace py = pybind11;
 
@@ -327,31 +333,35 @@ inline void granulator_set_param(ToneGranulator &gran, int64_t parid, float v)
         throw std::runtime_error(std::format("parameter id {} does not exist", parid));
 }
 
-inline void granulator_set_modulation(ToneGranulator &g, int modslot, int modsource, int modvia,
-                                      double depth, int modcurve, int modtarget)
+inline void granulator_check_modulation(const ToneGranulator &g, int modslot, int modtarget)
 {
-    if (modslot >= 0 && modslot < GranulatorModConfig::FixedMatrixSize)
-    {
-        auto &pmd = g.idtoparmetadata[modtarget];
-        if (!(pmd->flags & CLAP_PARAM_IS_MODULATABLE))
-            throw std::runtime_error(
-                std::format("parameter {} [id {}] is not modulatable", pmd->name, pmd->id));
-        g.modmatrix.rt.updateActiveAt(modslot, true);
-        g.modmatrix.rt.updateRoutingAt(modslot,
-                                       GranulatorModConfig::SourceIdentifier{(uint32_t)modsource},
-                                       GranulatorModConfig::SourceIdentifier{(uint32_t)modvia},
-                                       GranulatorModConfig::CurveIdentifier{modcurve},
-                                       GranulatorModConfig::TargetIdentifier{modtarget}, depth);
-        if (modvia == 0)
-        {
-            g.modmatrix.rt.routes[modslot].sourceVia = std::nullopt;
-        }
-    }
-    else
-    {
+    if (modslot < 0 || modslot >= GranulatorModConfig::FixedMatrixSize)
         throw std::runtime_error(
             std::format("invalid modulation slot index {}, must be in range 0-{}", modslot,
                         GranulatorModConfig::FixedMatrixSize - 1));
+    auto it = g.idtoparmetadata.find(modtarget);
+    if (it == g.idtoparmetadata.end())
+        throw std::runtime_error(std::format("parameter id {} does not exist", modtarget));
+    auto pmd = it->second;
+    if (!(pmd->flags & CLAP_PARAM_IS_MODULATABLE))
+        throw std::runtime_error(
+            std::format("parameter {} [id {}] is not modulatable", pmd->name, pmd->id));
+}
+
+// the routing takes effect when the granulator is prepared
+inline void granulator_set_modulation(ToneGranulator &g, int modslot, int modsource, int modvia,
+                                      double depth, int modcurve, int modtarget)
+{
+    granulator_check_modulation(g, modslot, modtarget);
+    g.modmatrix.rt.updateActiveAt(modslot, true);
+    g.modmatrix.rt.updateRoutingAt(modslot,
+                                   GranulatorModConfig::SourceIdentifier{(uint32_t)modsource},
+                                   GranulatorModConfig::SourceIdentifier{(uint32_t)modvia},
+                                   GranulatorModConfig::CurveIdentifier{modcurve},
+                                   GranulatorModConfig::TargetIdentifier{modtarget}, depth);
+    if (modvia == 0)
+    {
+        g.modmatrix.rt.routes[modslot].sourceVia = std::nullopt;
     }
 }
 
@@ -544,65 +554,249 @@ inline py::array_t<float> render_saw_bank(double samplerate, double outdur, int
     return output_audio;
 }
 
-inline py::array_t<float> render_granulator(ToneGranulator &gran, double samplerate,
-                                            events_t evlist, int ambisonic_order,
-                                            double outputduration,
-                                            xenakios::AutomationSequence *automation)
+struct GranulatorRenderSetup
+{
+    int chans = 0;
+    // int64_t::max for open ended streams, see open_ended_stream
+    int64_t frames = 0;
+    int ambisonic_order = 1;
+    // set for streamed events, when the output length is worked out once the stream ends
+    StreamingGrainEventSource *open_ended_stream = nullptr;
+    xenakios::BlockSanitizer::Limiter limiter = xenakios::BlockSanitizer::Limiter::Hard;
+};
+
+// NumPy structured array with the GrainEvent memory layout (grain_event_dtype), used in place
+using grain_event_array_t = py::array_t<GrainEvent, py::array::c_style>;
+
+// Pulls grain events from a Python iterator, which can yield GrainEvent objects or chunks of
+// events as grain_event_dtype arrays. Called from the render thread, which doesn't hold the GIL.
+struct PythonGrainEventPuller
+{
+    struct State
+    {
+        py::iterator iter;
+        std::optional<grain_event_array_t> pending;
+        size_t pendingpos = 0;
+        bool finished = false;
+        ~State()
+        {
+            py::gil_scoped_acquire acquire;
+            pending.reset();
+            iter.release().dec_ref();
+        }
+    };
+    std::shared_ptr<State> state;
+    explicit PythonGrainEventPuller(py::iterator iter) : state(std::make_shared<State>())
+    {
+        state->iter = std::move(iter);
+    }
+    size_t operator()(GrainEvent *dest, size_t max_events)
+    {
+        py::gil_scoped_acquire acquire;
+        auto &st = *state;
+        size_t count = 0;
+        while (count < max_events)
+        {
+            if (st.pending)
+            {
+                size_t n = std::min(max_events - count, (size_t)st.pending->size() - st.pendingpos);
+                std::copy_n(st.pending->data() + st.pendingpos, n, dest + count);
+                count += n;
+                st.pendingpos += n;
+                if (st.pendingpos == (size_t)st.pending->size())
+                    st.pending.reset();
+                continue;
+            }
+            if (st.finished)
+                break;
+            auto item = py::reinterpret_steal<py::object>(PyIter_Next(st.iter.ptr()));
+            if (!item)
+            {
+                st.finished = true;
+                if (PyErr_Occurred())
+                {
+                    py::error_already_set err;
+                    throw std::runtime_error(err.what());
+                }
+                break;
+            }
+            if (py::isinstance<GrainEvent>(item))
+            {
+                dest[count++] = item.cast<const GrainEvent &>();
+            }
+            else if (grain_event_array_t::check_(item))
+            {
+                auto arr = item.cast<grain_event_array_t>();
+                if (arr.ndim() != 1)
+                    throw std::runtime_error(
+                        std::format("grain event array ndim {} incompatible, must be 1",
+                                    arr.ndim()));
+                st.pending = std::move(arr);
+                st.pendingpos = 0;
+            }
+            else
+                throw std::runtime_error("grain event iterator must yield GrainEvent objects or "
+                                         "arrays with the grain_event_dtype");
+        }
+        return count;
+    }
+};
+
+// the grain events can be passed in as a list of GrainEvent objects, as a structured array, as
+// an iterator that is pulled from while rendering or as the path of a raw grain event file
+using GranulatorEventInput =
+    std::variant<events_t, grain_event_array_t, py::iterator, std::string>;
+
+// Releases the granulator's event sources when the render is left, also by an exception or a
+// keyboard interrupt, since they can refer to event data owned by Python. Dismissed when the
+// sources are handed over to a background job.
+struct ScopedEventSourceRelease
 {
-    if (evlist.empty() && (outputduration <= 0.0 || outputduration > 600.0))
+    ToneGranulator *gran = nullptr;
+    explicit ScopedEventSourceRelease(ToneGranulator &g) : gran(&g) {}
+    ~ScopedEventSourceRelease()
+    {
+        if (gran)
+            gran->release_event_sources();
+    }
+    ScopedEventSourceRelease(const ScopedEventSourceRelease &) = delete;
+    ScopedEventSourceRelease &operator=(const ScopedEventSourceRelease &) = delete;
+    void dismiss() { gran = nullptr; }
+};
+
+// prepares the granulator and works out the output size, the rendering itself doesn't need
+// the GIL. a structured event array must stay alive until the render has finished. streamed
+// events need the output duration, unless allow_open_ended is set.
+inline GranulatorRenderSetup prepare_granulator_render(ToneGranulator &gran, double samplerate,
+                                                       GranulatorEventInput evinput,
+                                                       int ambisonic_order, double outputduration,
+                                                       xenakios::AutomationSequence *automation,
+                                                       double maxduration = 600.0,
+                                                       bool allow_open_ended = false)
+{
+    auto evarray = std::get_if<grain_event_array_t>(&evinput);
+    if (evarray && evarray->ndim() != 1)
+        throw std::runtime_error(
+            std::format("grain event array ndim {} incompatible, must be 1", evarray->ndim()));
+    const bool streamed = std::holds_alternative<py::iterator>(evinput) ||
+                          std::holds_alternative<std::string>(evinput);
+    size_t numinputevents = 0;
+    if (evarray)
+        numinputevents = evarray->size();
+    else if (auto evlist = std::get_if<events_t>(&evinput))
+        numinputevents = evlist->size();
+    if (streamed && outputduration == 0.0 && !allow_open_ended)
+        throw std::runtime_error("output duration must be given for streamed grain events");
+    bool durationvalid = outputduration > 0.0 && outputduration <= maxduration;
+    if (streamed)
+        durationvalid = durationvalid || outputduration == 0.0;
+    if ((numinputevents == 0 || streamed) && !durationvalid)
         throw std::runtime_error(std::format(
-            "output duration {} invalid (should be larger than 0 and less than 600 seconds)",
-            outputduration));
-    ambisonic_order = std::clamp(ambisonic_order, 1, 7);
-    int chans = ambisonicOrderNumChannels(ambisonic_order);
-    if (chans == 0)
+            "output duration {} invalid (should be larger than 0 and less than {} seconds)",
+            outputduration, maxduration));
+    GranulatorRenderSetup setup;
+    setup.ambisonic_order = std::clamp(ambisonic_order, 1, 7);
+    setup.chans = ambisonicOrderNumChannels(setup.ambisonic_order);
+    if (setup.chans == 0)
         throw std::runtime_error("invalid audio output mode");
-    gran.prepare(samplerate, std::move(evlist), GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
-    if (gran.events_to_switch.empty() && outputduration == 0.0)
+    size_t numevents = 0;
+    double eventsend = 0.0;
+    if (streamed)
+    {
+        StreamingGrainEventSource::PullFunc pull;
+        if (auto path = std::get_if<std::string>(&evinput))
+            pull = StreamingGrainEventSource::pull_from_raw_file(*path);
+        else
+            pull = PythonGrainEventPuller{std::move(std::get<py::iterator>(evinput))};
+        auto source = std::make_unique<StreamingGrainEventSource>(std::move(pull));
+        if (outputduration == 0.0)
+            setup.open_ended_stream = source.get();
+        gran.prepare(samplerate, std::move(source), GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+    }
+    else if (evarray)
+    {
+        auto source = std::make_unique<IndexedGrainEventSource>(evarray->data(), evarray->size());
+        numevents = source->size();
+        eventsend = source->get_end_time();
+        gran.prepare(samplerate, std::move(source), GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+    }
+    else
+    {
+        gran.prepare(samplerate, std::move(std::get<events_t>(evinput)),
+                     GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+        numevents = gran.events_to_switch.size();
+        if (numevents > 0)
+            eventsend = gran.events_to_switch.back().time_position +
+                        gran.events_to_switch.back().duration;
+    }
+    if (!streamed && numevents == 0 && outputduration == 0.0)
         throw std::runtime_error("grain event list empty after events were erased");
     // we can't know the exact tail amount needed until processing...
     // 1 second is hopefully enough to not cut off the render too abruptly in most cases, but
     // maybe should make the tail length a user settable thing
-    int frames = 0;
-    if (outputduration > 0.0 && gran.events_to_switch.empty())
+    if (setup.open_ended_stream)
     {
-        frames = gran.m_sr * outputduration;
+        setup.frames = std::numeric_limits<int64_t>::max();
+    }
+    else if (outputduration > 0.0 && (numevents == 0 || streamed))
+    {
+        setup.frames = gran.m_sr * outputduration;
     }
     else
     {
-        frames = (gran.events_to_switch.back().time_position +
-                  gran.events_to_switch.back().duration + 1.0) *
-                 gran.m_sr;
+        setup.frames = (eventsend + 1.0) * gran.m_sr;
     }
+    if (automation)
+        automation->sort_events();
+    return setup;
+}
+
+inline py::array_t<float> make_render_output_array(int chans, int64_t frames)
+{
+    const py::ssize_t numchans = chans;
+    const py::ssize_t numframes = frames;
+    const py::ssize_t floatsize = sizeof(float);
     py::buffer_info binfo(
         nullptr,                                /* Pointer to buffer */
         sizeof(float),                          /* Size of one scalar */
         py::format_descriptor<float>::format(), /* Python struct-style format descriptor */
         2,                                      /* Number of dimensions */
-        {chans, frames},                        /* Buffer dimensions */
-        {sizeof(float) * frames,                /* Strides (in bytes) for each index */
-         sizeof(float)});
-    py::array_t<float> output_audio{binfo};
-    alignas(32) float *writebufs[16];
-    for (int i = 0; i < chans; ++i)
-        writebufs[i] = output_audio.mutable_data(i);
+        {numchans, numframes},                  /* Buffer dimensions */
+        {floatsize * numframes,                 /* Strides (in bytes) for each index */
+         floatsize});
+    return py::array_t<float>{binfo};
+}
+
+// Renders in granulator sized blocks, the output function gets the sanitized and limited
+// interleaved block (with the granulator's current channel count as the stride), the output
+// frame position and the number of frames to use from the block. Invalid samples are replaced
+// with zeros and reported in control.diagnostics.
+template <typename OutputFunc>
+inline void render_granulator_impl(ToneGranulator &gran, const GranulatorRenderSetup &setup,
+                                   xenakios::AutomationSequence *automation, OutputFunc &&output,
+                                   RenderJobControl &control)
+{
+    const int chans = setup.chans;
+    int64_t frames = setup.frames;
+    auto stream = setup.open_ended_stream;
+    xenakios::BlockSanitizer sanitizer{chans, setup.limiter};
     using clock = std::chrono::system_clock;
     using ms = std::chrono::duration<double, std::milli>;
     const auto start_time = clock::now();
-    int outframecount = 0;
-    float procbuf[64 * granul_block_size];
-    for (int i = 0; i < 16 * granul_block_size; ++i)
-        procbuf[i] = 0.0f;
-    *gran.idtoparvalptr[ToneGranulator::PAR_AMBORDER] = ambisonic_order - 1;
+    int64_t outframecount = 0;
+    alignas(32) float procbuf[64 * granul_block_size];
+    std::fill(std::begin(procbuf), std::end(procbuf), 0.0f);
+    *gran.idtoparvalptr[ToneGranulator::PAR_AMBORDER] = setup.ambisonic_order - 1;
     std::optional<xenakios::AutomationSequence::Iterator> aiter;
     if (automation)
     {
-        automation->sort_events();
-        aiter.emplace(xenakios::AutomationSequence::Iterator(*automation, samplerate));
+        aiter.emplace(xenakios::AutomationSequence::Iterator(*automation, gran.m_sr));
     }
     while (outframecount < frames)
     {
-        int framestooutput = std::min(granul_block_size, frames - outframecount);
+        if (control.cancelRequested)
+            break;
+        int framestooutput = std::min<int64_t>(granul_block_size, frames - outframecount);
         if (aiter)
         {
             auto aevents = aiter->readNextEvents(granul_block_size);
@@ -618,31 +812,489 @@ inline py::array_t<float> render_granulator(ToneGranulator &gran, double sampler
 
         gran.process_block(procbuf);
         int procnumchans = gran.num_out_chans;
-        for (int i = 0; i < framestooutput; ++i)
+        sanitizer.process(procbuf, procnumchans, framestooutput, outframecount);
+        output(procbuf, procnumchans, outframecount, framestooutput);
+        outframecount += granul_block_size;
+        if (stream && stream->finished())
         {
-            int pos = outframecount + i;
-            for (int j = 0; j < chans; ++j)
-            {
-                float osamp = procbuf[i * procnumchans + j];
-                if (!std::isnormal(osamp) && osamp != 0.0f)
-                {
-                    throw std::runtime_error(
-                        std::format("invalid sample in channel {} at position {}", j, pos));
-                }
-                osamp = std::clamp(osamp, -1.0f, 1.0f);
-                writebufs[j][pos] = osamp;
-            }
+            // the same 1 second tail as for the event lists
+            double endframe = (stream->get_end_time() + 1.0) * gran.m_sr;
+            frames = std::max(outframecount, (int64_t)endframe);
+            stream = nullptr;
         }
-        outframecount += granul_block_size;
+        // the length of an open ended stream isn't known until it has ended
+        if (stream)
+            control.progress = RenderJobControl::unknownProgress;
+        else
+            control.progress = std::min(1.0, (double)outframecount / frames);
     }
+    control.diagnostics = sanitizer.getDiagnostics();
+    if (control.diagnostics.getNumBadSamples() > 0)
+        std::print("replaced {} invalid samples, first in channel {} at frame {}\n",
+                   control.diagnostics.getNumBadSamples(), control.diagnostics.firstBadChannel,
+                   control.diagnostics.firstBadFrame);
+    if (control.cancelRequested)
+        return;
     const ms render_duration = clock::now() - start_time;
-    double rtfactor = (frames / gran.m_sr * 1000.0) / render_duration.count();
+    double rtfactor = (outframecount / gran.m_sr * 1000.0) / render_duration.count();
     std::print("missed playing {} grains\n", gran.missedgrains);
     std::print("render took {} milliseconds, {:.2f}x realtime\n", render_duration.count(),
                rtfactor);
+}
+
+// writes the blocks into a planar chans x frames buffer
+struct GranulatorPlanarOutput
+{
+    float *data = nullptr;
+    int chans = 0;
+    int64_t frames = 0;
+    void operator()(const float *block, int stride, int64_t pos, int numframes)
+    {
+        // channel by channel, so the writes are sequential
+        for (int j = 0; j < chans; ++j)
+        {
+            float *dest = data + j * frames + pos;
+            for (int i = 0; i < numframes; ++i)
+                dest[i] = block[i * stride + j];
+        }
+    }
+};
+
+// returns the output array, or a tuple of the array and the diagnostics dict
+inline py::object render_granulator(ToneGranulator &gran, double samplerate,
+                                    GranulatorEventInput evlist, int ambisonic_order,
+                                    double outputduration,
+                                    xenakios::AutomationSequence *automation, std::string limiter,
+                                    bool return_diagnostics)
+{
+    ScopedEventSourceRelease releaser{gran};
+    auto setup = prepare_granulator_render(gran, samplerate, std::move(evlist), ambisonic_order,
+                                           outputduration, automation);
+    setup.limiter = xenakios::BlockSanitizer::limiterFromName(limiter);
+    auto output_audio = make_render_output_array(setup.chans, setup.frames);
+    float *outputdata = output_audio.mutable_data();
+    auto diagnostics = run_interruptible([&](RenderJobControl &control) {
+        render_granulator_impl(gran, setup, automation,
+                               GranulatorPlanarOutput{outputdata, setup.chans, setup.frames},
+                               control);
+    });
+    if (return_diagnostics)
+        return py::make_tuple(output_audio, diagnostics_to_dict(diagnostics));
     return output_audio;
 }
 
+// Stereo preview of a render, where each preview frame is the average of decimation output
+// frames. When the preview is full, adjacent frames are merged and the decimation doubled, so
+// the memory used stays bounded however long the render gets.
+struct RenderPreview
+{
+    static constexpr size_t maxFrames = 1 << 20;
+    int64_t decimation = 1;
+    std::vector<float> chans[2];
+    double sums[2] = {0.0, 0.0};
+    int64_t count = 0;
+    void add(float left, float right)
+    {
+        sums[0] += left;
+        sums[1] += right;
+        if (++count < decimation)
+            return;
+        // keeps on summing up to the doubled decimation
+        if (chans[0].size() == maxFrames)
+            merge();
+        else
+            push();
+    }
+    // outputs the last, possibly partial, frame
+    void finish()
+    {
+        if (count == 0)
+            return;
+        if (chans[0].size() == maxFrames)
+            merge();
+        push();
+    }
+
+  private:
+    void push()
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            chans[k].push_back(sums[k] / count);
+            sums[k] = 0.0;
+        }
+        count = 0;
+    }
+    void merge()
+    {
+        for (auto &c : chans)
+        {
+            for (size_t i = 0; i < c.size() / 2; ++i)
+                c[i] = 0.5f * (c[2 * i] + c[2 * i + 1]);
+            c.resize(c.size() / 2);
+        }
+        decimation *= 2;
+    }
+};
+
+// Renders straight into an audio file through a background writer thread, so the memory used
+// doesn't depend on the output length. Optionally returns a mid/side stereo preview, where each
+// preview frame is the average of at least preview_decimation output frames. The decimation is
+// increased for long renders, so that the preview has at most 2^20 frames; the preview always
+// covers the whole render. With streamed events and no output duration, renders until the
+// stream ends. With return_diagnostics, returns a tuple of the preview (or None) and the
+// diagnostics dict.
+inline py::object render_granulator_to_file(ToneGranulator &gran, std::string filename,
+                                            double samplerate, GranulatorEventInput evlist,
+                                            int ambisonic_order, double outputduration,
+                                            xenakios::AutomationSequence *automation,
+                                            std::string file_format, bool preview,
+                                            int preview_decimation, std::string limiter,
+                                            bool return_diagnostics)
+{
+    ScopedEventSourceRelease releaser{gran};
+    auto setup = prepare_granulator_render(gran, samplerate, std::move(evlist), ambisonic_order,
+                                           outputduration, automation,
+                                           std::numeric_limits<double>::max(), true);
+    setup.limiter = xenakios::BlockSanitizer::limiterFromName(limiter);
+    const bool open_ended = setup.open_ended_stream != nullptr;
+    auto filewriter = std::make_unique<xenakios::StreamingAudioFileWriter>(
+        filename, xenakios::StreamingAudioFileWriter::formatFromName(file_format), setup.chans,
+        gran.m_sr, open_ended ? 0 : setup.frames);
+    // the output length isn't known in advance for streamed events, so the preview is collected
+    // here and copied into the result array afterwards
+    RenderPreview previewdata;
+    previewdata.decimation = std::max(1, preview_decimation);
+    if (preview && !open_ended)
+    {
+        const int64_t maxframes = RenderPreview::maxFrames;
+        previewdata.decimation =
+            std::max(previewdata.decimation, (setup.frames + maxframes - 1) / maxframes);
+        for (auto &pc : previewdata.chans)
+            pc.reserve((setup.frames + previewdata.decimation - 1) / previewdata.decimation);
+    }
+    bool sn3d = *gran.idtoparvalptr[ToneGranulator::PAR_AMBUSENORMALIZATION] > 0.5f;
+    auto diagnostics = run_interruptible([&](RenderJobControl &control) {
+        xenakios::BackgroundAudioFileWriter writer{std::move(filewriter)};
+        auto previewdecoder = xenakios::AmbisonicDecoder::makePreset("stereo_ms");
+        const auto &previewmatrix = previewdecoder->getMatrix(setup.ambisonic_order, sn3d);
+        const int chans = setup.chans;
+        std::vector<float> interleaved(granul_block_size * chans);
+        render_granulator_impl(
+            gran, setup, automation,
+            [&](const float *block, int stride, int64_t pos, int numframes) {
+                for (int i = 0; i < numframes; ++i)
+                    for (int j = 0; j < chans; ++j)
+                        interleaved[i * chans + j] = block[i * stride + j];
+                writer.write(interleaved.data(), numframes);
+                if (!preview)
+                    return;
+                for (int i = 0; i < numframes; ++i)
+                {
+                    float sums[2] = {0.0f, 0.0f};
+                    for (int k = 0; k < 2; ++k)
+                        for (int j = 0; j < chans; ++j)
+                            sums[k] += previewmatrix[k * chans + j] * interleaved[i * chans + j];
+                    previewdata.add(sums[0], sums[1]);
+                }
+            },
+            control);
+        if (preview)
+            previewdata.finish();
+        writer.finish();
+    });
+    py::object result = py::none();
+    if (preview)
+    {
+        int64_t previewframes = previewdata.chans[0].size();
+        auto previewarray = make_render_output_array(2, previewframes);
+        for (int k = 0; k < 2; ++k)
+            std::copy(previewdata.chans[k].begin(), previewdata.chans[k].end(),
+                      previewarray.mutable_data() + k * previewframes);
+        result = previewarray;
+    }
+    if (return_diagnostics)
+        return py::make_tuple(result, diagnostics_to_dict(diagnostics));
+    return result;
+}
+
+// The granulator and automation objects must not be used from Python while the job runs
+inline std::unique_ptr<RenderJob> render_granulator_async(py::object granob, double samplerate,
+                                                          GranulatorEventInput evlist,
+                                                          int ambisonic_order,
+                                                          double outputduration,
+                                                          py::object automationob,
+                                                          std::string limiter)
+{
+    auto &gran = granob.cast<ToneGranulator &>();
+    xenakios::AutomationSequence *automation = nullptr;
+    if (!automationob.is_none())
+        automation = automationob.cast<xenakios::AutomationSequence *>();
+    std::vector<py::object> keepalive{granob, automationob};
+    if (auto evarray = std::get_if<grain_event_array_t>(&evlist))
+        keepalive.push_back(*evarray);
+    ScopedEventSourceRelease releaser{gran};
+    auto setup = prepare_granulator_render(gran, samplerate, std::move(evlist), ambisonic_order,
+                                           outputduration, automation);
+    setup.limiter = xenakios::BlockSanitizer::limiterFromName(limiter);
+    auto output_audio = make_render_output_array(setup.chans, setup.frames);
+    float *outputdata = output_audio.mutable_data();
+    auto job = std::make_unique<RenderJob>(
+        output_audio, std::move(keepalive),
+        [&gran, setup, automation, outputdata](RenderJobControl &control) {
+            ScopedEventSourceRelease jobreleaser{gran};
+            render_granulator_impl(gran, setup, automation,
+                                   GranulatorPlanarOutput{outputdata, setup.chans, setup.frames},
+                                   control);
+        });
+    // the job releases the sources when it's done
+    releaser.dismiss();
+    return job;
+}
+
+// One variation of a batch render, parsed from the Python job dict while holding the GIL
+struct GranulatorBatchJob
+{
+    uint64_t seed = 0;
+    std::vector<std::pair<int64_t, float>> parameters;
+    struct Modulation
+    {
+        int slot = 0;
+        int source = 0;
+        int via = 0;
+        double depth = 0.0;
+        int curve = 0;
+        int target = 0;
+    };
+    std::vector<Modulation> modulations;
+    std::vector<std::pair<int, GrainInsertFX::ModeInfo>> inserts;
+    std::string filename;
+};
+
+// the parameter ids and modulations are checked against the reference granulator, so that the
+// errors are raised here instead of in the worker threads
+inline GranulatorBatchJob
+parse_granulator_batch_job(py::dict jobdict, uint64_t defaultseed,
+                           const std::vector<GrainInsertFX::ModeInfo> &insertmodes,
+                           const ToneGranulator &reference)
+{
+    GranulatorBatchJob job;
+    job.seed = defaultseed;
+    for (auto item : jobdict)
+    {
+        auto key = item.first.cast<std::string>();
+        if (key == "seed")
+            job.seed = item.second.cast<uint64_t>();
+        else if (key == "parameters")
+        {
+            for (auto par : item.second.cast<py::dict>())
+            {
+                auto id = par.first.cast<int64_t>();
+                if (!reference.idtoparvalptr.contains(id))
+                    throw std::runtime_error(std::format("parameter id {} does not exist", id));
+                job.parameters.emplace_back(id, par.second.cast<float>());
+            }
+        }
+        else if (key == "modulations")
+        {
+            // tuples with the set_modulation arguments
+            for (auto mod : item.second.cast<py::list>())
+            {
+                auto [slot, src, via, depth, curve, target] =
+                    mod.cast<std::tuple<int, int, int, double, int, int>>();
+                granulator_check_modulation(reference, slot, target);
+                job.modulations.push_back({slot, src, via, depth, curve, target});
+            }
+        }
+        else if (key == "inserts")
+        {
+            // insert index -> insert mode display name
+            for (auto ins : item.second.cast<py::dict>())
+            {
+                int which = ins.first.cast<int>();
+                auto name = ins.second.cast<std::string>();
+                if (which < 0 || which > 1)
+                    throw std::runtime_error(
+                        std::format("insert index {} out of range, must be 0 or 1", which));
+                auto it = std::find_if(insertmodes.begin(), insertmodes.end(),
+                                       [&name](auto &m) { return m.displayname == name; });
+                if (it == insertmodes.end())
+                    throw std::runtime_error(std::format("unknown insert mode {}", name));
+                job.inserts.emplace_back(which, *it);
+            }
+        }
+        else
+            throw std::runtime_error(std::format("unknown batch job key {}", key));
+    }
+    return job;
+}
+
+// Renders the variations concurrently on a worker pool, each with its own ToneGranulator. The
+// event list is sorted once and shared read only between the jobs, like the easing tables and
+// the filter registry. Returns the output arrays, or None when filenames are given, in which
+// case each job streams its output into its own file. With return_diagnostics, returns a tuple
+// of that and the list of per job diagnostics dicts.
+inline py::object render_granulator_batch(std::vector<py::dict> jobdicts, double samplerate,
+                                          GranulatorEventInput evinput, int ambisonic_order,
+                                          double outputduration,
+                                          std::vector<std::string> filenames,
+                                          std::string file_format, int num_threads,
+                                          std::string limiter, bool return_diagnostics)
+{
+    if (jobdicts.empty())
+        throw std::runtime_error("no batch jobs given");
+    if (!filenames.empty() && filenames.size() != jobdicts.size())
+        throw std::runtime_error(std::format("{} filenames given for {} jobs", filenames.size(),
+                                             jobdicts.size()));
+    if (std::holds_alternative<py::iterator>(evinput) ||
+        std::holds_alternative<std::string>(evinput))
+        throw std::runtime_error("streamed grain events can't be shared by batch jobs");
+    auto insertmodes = GrainInsertFX::getAvailableModes();
+    auto reference = std::make_unique<ToneGranulator>();
+    std::vector<GranulatorBatchJob> jobs;
+    jobs.reserve(jobdicts.size());
+    for (size_t i = 0; i < jobdicts.size(); ++i)
+    {
+        jobs.push_back(parse_granulator_batch_job(jobdicts[i], i, insertmodes, *reference));
+        if (!filenames.empty())
+            jobs.back().filename = filenames[i];
+    }
+    auto format = xenakios::StreamingAudioFileWriter::formatFromName(file_format);
+
+    const GrainEvent *evdata = nullptr;
+    size_t numevents = 0;
+    auto evarray = std::get_if<grain_event_array_t>(&evinput);
+    auto evlist = std::get_if<events_t>(&evinput);
+    if (evarray)
+    {
+        if (evarray->ndim() != 1)
+            throw std::runtime_error(std::format(
+                "grain event array ndim {} incompatible, must be 1", evarray->ndim()));
+        evdata = evarray->data();
+        numevents = evarray->size();
+    }
+    else
+    {
+        std::stable_sort(evlist->begin(), evlist->end(), [](auto &lhs, auto &rhs) {
+            return lhs.time_position < rhs.time_position;
+        });
+        evdata = evlist->data();
+        numevents = evlist->size();
+    }
+    IndexedGrainEventSource checksource{evdata, numevents};
+    GranulatorRenderSetup setup;
+    setup.ambisonic_order = std::clamp(ambisonic_order, 1, 7);
+    setup.chans = ambisonicOrderNumChannels(setup.ambisonic_order);
+    setup.limiter = xenakios::BlockSanitizer::limiterFromName(limiter);
+    if (checksource.size() == 0)
+    {
+        if (outputduration <= 0.0 || outputduration > 600.0)
+            throw std::runtime_error(std::format(
+                "output duration {} invalid (should be larger than 0 and less than {} seconds)",
+                outputduration, 600.0));
+        setup.frames = samplerate * outputduration;
+    }
+    else
+        setup.frames = (checksource.get_end_time() + 1.0) * samplerate;
+
+    std::vector<py::array_t<float>> outputs;
+    if (filenames.empty())
+    {
+        for (size_t i = 0; i < jobs.size(); ++i)
+            outputs.push_back(make_render_output_array(setup.chans, setup.frames));
+    }
+    std::vector<float *> outputdatas;
+    for (auto &o : outputs)
+        outputdatas.push_back(o.mutable_data());
+
+    auto renderjob = [&](size_t jobindex, RenderJobControl &control) {
+        const auto &job = jobs[jobindex];
+        auto gran = std::make_unique<ToneGranulator>();
+        gran->rng.seed(job.seed, job.seed + 1000);
+        gran->prepare(samplerate, std::make_unique<IndexedGrainEventSource>(evdata, numevents),
+                      GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+        for (auto &ins : job.inserts)
+            gran->set_filter(ins.first, ins.second.mainmode, ins.second.awtype,
+                             ins.second.sstmodel, ins.second.sstconfig);
+        for (auto &par : job.parameters)
+            granulator_set_param(*gran, par.first, par.second);
+        for (auto &mod : job.modulations)
+            granulator_set_modulation(*gran, mod.slot, mod.source, mod.via, mod.depth, mod.curve,
+                                      mod.target);
+        // the granulator was already prepared with the default routings
+        if (!job.modulations.empty())
+            gran->modmatrix.m.prepare(gran->modmatrix.rt, samplerate, granul_block_size);
+        if (job.filename.empty())
+        {
+            render_granulator_impl(
+                *gran, setup, nullptr,
+                GranulatorPlanarOutput{outputdatas[jobindex], setup.chans, setup.frames}, control);
+            return;
+        }
+        xenakios::StreamingAudioFileWriter writer{job.filename, format, setup.chans, samplerate,
+                                                  (uint64_t)setup.frames};
+        std::vector<float> interleaved(granul_block_size * setup.chans);
+        render_granulator_impl(
+            *gran, setup, nullptr,
+            [&](const float *block, int stride, int64_t pos, int numframes) {
+                for (int i = 0; i < numframes; ++i)
+                    for (int j = 0; j < setup.chans; ++j)
+                        interleaved[i * setup.chans + j] = block[i * stride + j];
+                writer.writeInterleaved(interleaved.data(), numframes);
+            },
+            control);
+        writer.close();
+    };
+
+    if (num_threads <= 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min<int>(num_threads, jobs.size());
+    std::vector<xenakios::BlockSanitizer::Diagnostics> jobdiagnostics(jobs.size());
+    run_interruptible([&](RenderJobControl &control) {
+        std::vector<RenderJobControl> jobcontrols(jobs.size());
+        std::vector<std::future<void>> futures;
+        BS::thread_pool<> pool(num_threads);
+        for (size_t i = 0; i < jobs.size(); ++i)
+            futures.push_back(pool.submit_task([&, i]() { renderjob(i, jobcontrols[i]); }));
+        // waits on the jobs in order, waking up at least every signal_check_interval to pass on
+        // a cancel request and to update the progress
+        size_t numfinished = 0;
+        while (numfinished < futures.size())
+        {
+            if (futures[numfinished].wait_for(signal_check_interval) == std::future_status::ready)
+                ++numfinished;
+            double progress = 0.0;
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                if (control.cancelRequested)
+                    jobcontrols[i].cancelRequested = true;
+                progress += jobcontrols[i].progress;
+            }
+            control.progress = progress / jobs.size();
+        }
+        for (size_t i = 0; i < jobs.size(); ++i)
+            jobdiagnostics[i] = jobcontrols[i].diagnostics;
+        for (auto &f : futures)
+            f.get();
+    });
+    py::object result = py::none();
+    if (filenames.empty())
+    {
+        py::list arrays;
+        for (auto &o : outputs)
+            arrays.append(o);
+        result = arrays;
+    }
+    if (return_diagnostics)
+    {
+        py::list diaglist;
+        for (auto &d : jobdiagnostics)
+            diaglist.append(diagnostics_to_dict(d));
+        return py::make_tuple(result, diaglist);
+    }
+    return result;
+}
+
 void process_airwindows(int index)
 {
     
@@ -806,6 +1458,50 @@ inline std::vector<double> test_simple_lfo(int sh, xenakios::Envelope &rate_env,
 
 inline std::vector<double> test_morphing_random() { return {}; }
 
+// events with the same defaults as GrainEvent{}, to be filled in with NumPy operations
+inline grain_event_array_t make_grain_event_array(size_t numevents)
+{
+    grain_event_array_t result(numevents);
+    std::fill(result.mutable_data(), result.mutable_data() + numevents, GrainEvent{});
+    return result;
+}
+
+// builds the structured event array from a dict of equal length columns (field name -> array
+// or scalar), the columns not given have the GrainEvent defaults
+inline grain_event_array_t grain_events_from_columns(py::dict columns)
+{
+    if (columns.empty())
+        throw std::runtime_error("no grain event columns given");
+    py::ssize_t numevents = -1;
+    for (auto item : columns)
+    {
+        auto col = py::array::ensure(item.second);
+        if (!col || col.ndim() == 0)
+            continue;
+        if (col.ndim() != 1)
+            throw std::runtime_error(std::format("column {} must be 1 dimensional",
+                                                 item.first.cast<std::string>()));
+        if (numevents >= 0 && col.shape(0) != numevents)
+            throw std::runtime_error(std::format("column {} has {} values, expected {}",
+                                                 item.first.cast<std::string>(), col.shape(0),
+                                                 numevents));
+        numevents = col.shape(0);
+    }
+    if (numevents < 0)
+        throw std::runtime_error("at least one grain event column must be an array");
+    auto result = make_grain_event_array(numevents);
+    auto fields = py::dtype::of<GrainEvent>().attr("fields");
+    for (auto item : columns)
+    {
+        if (!fields.contains(item.first))
+            throw std::runtime_error(
+                std::format("unknown grain event field {}", item.first.cast<std::string>()));
+        // numpy does the type conversion and copy per column
+        result[item.first] = item.second;
+    }
+    return result;
+}
+
 void init_py4(py::module_ &m, py::module_ &m_const)
 {
     using namespace pybind11::literals;
@@ -855,6 +1551,16 @@ void init_py4(py::module_ &m, py::module_ &m_const)
         .def_readwrite("moise_corr", &GrainEvent::noisecorr)
         .def_readwrite("volume", &GrainEvent::volume);
 
+    PYBIND11_NUMPY_DTYPE(GrainEvent, time_position, duration, pitch_semitones, generator_type,
+                         volume, auxsend, envelope_start_type, envelope_end_type, envelope_shape,
+                         auxenvtimewarp, azimuth, azimuth_spread, elevation, sync_ratio,
+                         pulse_width, fm_frequency_hz, fm_amount, fm_feedback, noisecorr,
+                         noiseimode, modamounts, insertparams);
+    m.attr("grain_event_dtype") = py::dtype::of<GrainEvent>();
+    m.def("make_grain_event_array", &make_grain_event_array, "num_events"_a,
+          "Structured array of grain events with the default values, in the GrainEvent layout");
+    m.def("grain_events_from_columns", &grain_events_from_columns, "columns"_a);
+
     py::class_<ToneGranulator>(m, "ToneGranulator")
         .def(py::init<>())
         .def("set_voice_aux_envelope", &ToneGranulator::set_voice_aux_envelope)
@@ -865,5 +1571,20 @@ void init_py4(py::module_ &m, py::module_ &m_const)
         .def("set_modulation", granulator_set_modulation, "slot"_a, "src"_a, "via"_a, "depth"_a,
              "curve"_a, "target"_a)
         .def("render", render_granulator, "samplerate"_a, "event_list"_a, "outputmode"_a,
-             "outputduration"_a = 0.0, "automation"_a = nullptr);
+             "outputduration"_a = 0.0, "automation"_a = nullptr, "limiter"_a = "hard",
+             "return_diagnostics"_a = false)
+        .def("render_async", render_granulator_async, "samplerate"_a, "event_list"_a,
+             "outputmode"_a, "outputduration"_a = 0.0, "automation"_a = py::none(),
+             "limiter"_a = "hard")
+        .def("render_to_file", render_granulator_to_file, "filename"_a, "samplerate"_a,
+             "event_list"_a, "outputmode"_a, "outputduration"_a = 0.0, "automation"_a = nullptr,
+             "file_format"_a = "wav", "preview"_a = false, "preview_decimation"_a = 1,
+             "limiter"_a = "hard", "return_diagnostics"_a = false);
+    m.def("render_granulator_batch", render_granulator_batch, "jobs"_a, "samplerate"_a,
+          "event_list"_a = events_t{}, "outputmode"_a = 1, "outputduration"_a = 0.0,
+          "filenames"_a = std::vector<std::string>{}, "file_format"_a = "wav",
+          "num_threads"_a = 0, "limiter"_a = "hard", "return_diagnostics"_a = false,
+          "Render granulator variations concurrently. Each job is a dict with the optional keys "
+          "seed, parameters (id -> value), modulations (list of set_modulation argument tuples) "
+          "and inserts (insert index -> insert mode name).");
 }
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include "../Common/xen_blocksanitizer.h"
+
+namespace py = pybind11;
+
+// Shared between a render function running without the GIL and the Python side.
+// The render loops update the progress (0..1, or unknownProgress while the render length isn't
+// known) and poll cancelRequested. Renders that sanitize their output store the diagnostics
+// before finishing.
+struct RenderJobControl
+{
+    static constexpr double unknownProgress = -1.0;
+    std::atomic<double> progress{0.0};
+    std::atomic<bool> cancelRequested{false};
+    xenakios::BlockSanitizer::Diagnostics diagnostics;
+};
+
+inline py::dict diagnostics_to_dict(const xenakios::BlockSanitizer::Diagnostics &diag)
+{
+    py::dict result;
+    result["nans"] = diag.numNaNs;
+    result["infs"] = diag.numInfs;
+    result["denormals"] = diag.numDenormals;
+    result["first_bad_frame"] = diag.firstBadFrame;
+    result["first_bad_channel"] = diag.firstBadChannel;
+    result["overs"] = diag.numOvers;
+    result["peaks"] = diag.peaks;
+    return result;
+}
+
+// How often keyboard interrupts are checked while waiting for a render. The waits return as soon
+// as the render finishes, this only limits how late an interrupt is noticed.
+inline constexpr auto signal_check_interval = std::chrono::milliseconds(10);
+
+// Runs the render function in a worker thread with the GIL released, while this thread waits for
+// it and checks for keyboard interrupts in between the waits, like the interruptible fibonacci
+// does. The render function must not touch any Python objects. Returns the render's diagnostics.
+inline xenakios::BlockSanitizer::Diagnostics
+run_interruptible(std::function<void(RenderJobControl &)> func)
+{
+    RenderJobControl control;
+    std::promise<void> promise;
+    auto finished = promise.get_future();
+    std::thread th{[&]() {
+        try
+        {
+            func(control);
+            promise.set_value();
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }};
+    while (true)
+    {
+        bool ready = false;
+        {
+            py::gil_scoped_release release;
+            ready = finished.wait_for(signal_check_interval) == std::future_status::ready;
+        }
+        if (ready)
+            break;
+        if (PyErr_CheckSignals() != 0)
+        {
+            control.cancelRequested = true;
+            {
+                py::gil_scoped_release release;
+                th.join();
+            }
+            throw py::error_already_set();
+        }
+    }
+    th.join();
+    // rethrows the render's exception
+    finished.get();
+    return control.diagnostics;
+}
+
+// Future-like handle for a render running in the background. The output array is allocated
+// before the render starts and is filled in by the worker thread, so the Python objects the
+// render uses are kept alive by the job until it's destroyed.
+class RenderJob
+{
+  public:
+    enum Status
+    {
+        Running,
+        Finished,
+        Cancelled,
+        Failed
+    };
+    RenderJob(py::array_t<float> output, std::vector<py::object> keepAlive,
+              std::function<void(RenderJobControl &)> func)
+        : m_output(std::move(output)), m_keepAlive(std::move(keepAlive)),
+          m_finished(m_finishedPromise.get_future())
+    {
+        m_thread = std::thread{[this, func = std::move(func)]() {
+            try
+            {
+                func(m_control);
+                m_status = m_control.cancelRequested ? Cancelled : Finished;
+            }
+            catch (std::exception &ex)
+            {
+                m_error = ex.what();
+                m_status = Failed;
+            }
+            m_finishedPromise.set_value();
+        }};
+    }
+    ~RenderJob()
+    {
+        m_control.cancelRequested = true;
+        if (m_thread.joinable())
+        {
+            py::gil_scoped_release release;
+            m_thread.join();
+        }
+    }
+    RenderJob(const RenderJob &) = delete;
+    RenderJob &operator=(const RenderJob &) = delete;
+
+    double progress() const { return m_control.progress.load(); }
+    bool done() const { return m_status != Running; }
+    void cancel() { m_control.cancelRequested = true; }
+    // blocks until the job has finished or the timeout (negative waits indefinitely) has
+    // passed and returns whether the job has finished. a keyboard interrupt cancels the job.
+    bool wait(double timeout_seconds)
+    {
+        using clock = std::chrono::steady_clock;
+        auto deadline = clock::time_point::max();
+        if (timeout_seconds >= 0.0)
+            deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                          std::chrono::duration<double>(timeout_seconds));
+        while (!done())
+        {
+            auto remaining = deadline - clock::now();
+            if (remaining <= clock::duration::zero())
+                break;
+            auto waittime = std::min<clock::duration>(signal_check_interval, remaining);
+            {
+                py::gil_scoped_release release;
+                m_finished.wait_for(waittime);
+            }
+            if (done())
+                break;
+            if (PyErr_CheckSignals() != 0)
+            {
+                cancel();
+                throw py::error_already_set();
+            }
+        }
+        return done();
+    }
+    py::array_t<float> result()
+    {
+        wait(-1.0);
+        if (m_status == Failed)
+            throw std::runtime_error(m_error);
+        if (m_status == Cancelled)
+            throw std::runtime_error("render was cancelled");
+        return m_output;
+    }
+    py::dict diagnostics()
+    {
+        wait(-1.0);
+        return diagnostics_to_dict(m_control.diagnostics);
+    }
+    std::string status() const
+    {
+        switch (m_status.load())
+        {
+        case Running:
+            return "running";
+        case Finished:
+            return "finished";
+        case Cancelled:
+            return "cancelled";
+        case Failed:
+            return "failed";
+        }
+        return "unknown";
+    }
+
+  private:
+    py::array_t<float> m_output;
+    std::vector<py::object> m_keepAlive;
+    RenderJobControl m_control;
+    std::atomic<Status> m_status{Running};
+    std::string m_error;
+    std::promise<void> m_finishedPromise;
+    std::future<void> m_finished;
+    std::thread m_thread;
+};
+
+inline void init_render_job(py::module_ &m)
+{
+    using namespace pybind11::literals;
+    py::class_<RenderJob>(m, "RenderJob")
+        .def("progress", &RenderJob::progress,
+             "Render progress between 0 and 1, or -1 while the render length isn't known")
+        .def("done", &RenderJob::done)
+        .def("cancel", &RenderJob::cancel)
+        .def("status", &RenderJob::status)
+        .def("wait", &RenderJob::wait, "timeout"_a = -1.0,
+             "Wait for the render to finish, returns True if it has finished")
+        .def("result", &RenderJob::result,
+             "Wait for the render to finish and return the output array")
+        .def("diagnostics", &RenderJob::diagnostics,
+             "Wait for the render to finish and return the invalid sample and peak statistics");
+}
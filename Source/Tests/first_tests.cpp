@@ -1,4 +1,5 @@
 #include "../Common/clap_eventsequence.h"
+#include "../Common/xap_breakpoint_envelope.h"
 #include "tests/choc_UnitTest.h"
 #include <random>
 
@@ -68,10 +69,210 @@ void test_clap_sequence(choc::test::TestProgress &progress)
             compareSequences(progress, seq, deserialized);
         }
     }
+    {
+        CHOC_TEST(MergeAppended)
+        ClapEventSequence merged;
+        ClapEventSequence sorted;
+        std::mt19937 rng(9001);
+        std::uniform_real_distribution<double> timedist(0.0, 10.0);
+        for (size_t batch = 0; batch < 4; ++batch)
+        {
+            size_t firstnew = merged.getNumEvents();
+            merged.reserveAdditional(100);
+            for (size_t i = 0; i < 50; ++i)
+            {
+                // also some equal timestamps, to check the merge keeps the order stable
+                double t = i % 10 == 0 ? 5.0 : timedist(rng);
+                merged.addNote(t, 0.5, 0, 0, 60 + batch, -1, 0.5, 0.0);
+                sorted.addNote(t, 0.5, 0, 0, 60 + batch, -1, 0.5, 0.0);
+            }
+            merged.mergeAppendedEvents(firstnew);
+        }
+        sorted.sortEvents();
+        CHOC_EXPECT_TRUE(std::is_sorted(merged.m_evlist.begin(), merged.m_evlist.end(),
+                                        ClapEventSequence::eventTimeLess));
+        compareSequences(progress, merged, sorted);
+    }
+    {
+        CHOC_TEST(Hash)
+        ClapEventSequence seq;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            seq.addNote(i * 0.25, 0.2, 0, 0, 48 + i % 24, -1, 0.5, 0.0);
+            seq.addParameterEvent(false, i * 0.25, -1, -1, -1, -1, i % 8, 0.1 * (i % 10));
+        }
+        // same events rebuilt in unions filled with garbage, which must not affect the hash
+        ClapEventSequence garbage = seq;
+        for (auto &e : garbage.m_evlist)
+        {
+            ClapEventSequence::clap_multi_event ev;
+            std::memset(&ev, 0xcd, sizeof(ev));
+            ev.header = e.event.header;
+            ev.header.time = 12345;
+            if (e.event.header.type == CLAP_EVENT_PARAM_VALUE)
+            {
+                ev.param.param_id = e.event.param.param_id;
+                ev.param.cookie = nullptr;
+                ev.param.note_id = e.event.param.note_id;
+                ev.param.port_index = e.event.param.port_index;
+                ev.param.channel = e.event.param.channel;
+                ev.param.key = e.event.param.key;
+                ev.param.value = e.event.param.value;
+            }
+            else
+            {
+                ev.note.note_id = e.event.note.note_id;
+                ev.note.port_index = e.event.note.port_index;
+                ev.note.channel = e.event.note.channel;
+                ev.note.key = e.event.note.key;
+                ev.note.velocity = e.event.note.velocity;
+            }
+            e.event = ev;
+        }
+        CHOC_EXPECT_TRUE(seq.getHash() == garbage.getHash());
+        garbage.m_evlist[10].event.note.velocity += 0.01;
+        CHOC_EXPECT_TRUE(seq.getHash() != garbage.getHash());
+    }
+    {
+        CHOC_TEST(Compact)
+        ClapEventSequence seq;
+        std::mt19937 rng(9002);
+        std::uniform_real_distribution<double> timedist(0.0, 10.0);
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            seq.addNote(timedist(rng), 0.1, 0, 0, i % 128, i, 0.5, i % 3 == 0 ? 0.25 : 0.0);
+            seq.addParameterEvent(false, timedist(rng), -1, -1, -1, -1, i % 8, 0.5);
+        }
+        CompactClapEventSequence compact(seq);
+        CHOC_EXPECT_TRUE(compact.getSizeInBytes() < seq.getApproxSizeInBytes());
+        seq.sortEvents();
+        CHOC_EXPECT_EQ(compact.getNumEvents(), seq.getNumEvents());
+        CompactClapEventSequence::IteratorSampleTime iter(compact, 44100.0);
+        size_t index = 0;
+        for (int64_t pos = 0; pos < 44100 * 11; pos += 512)
+        {
+            for (auto ev : iter.readNextEvents(512))
+            {
+                auto &e = seq.m_evlist[index];
+                CHOC_EXPECT_TRUE(ev.timestamp == e.timestamp);
+                CHOC_EXPECT_EQ(ev.header->type, e.event.header.type);
+                CHOC_EXPECT_TRUE(std::memcmp(ev.header, &e.event, e.event.header.size) == 0);
+                ++index;
+            }
+        }
+        CHOC_EXPECT_EQ(index, seq.getNumEvents());
+    }
+    {
+        CHOC_TEST(SampleTimeSeek)
+        ClapEventSequence seq;
+        std::mt19937 rng(9003);
+        std::uniform_real_distribution<double> timedist(0.0, 10.0);
+        for (size_t i = 0; i < 500; ++i)
+            seq.addNoteOn(i % 5 == 0 ? 2.5 : timedist(rng), 0, 0, 60, 1.0, -1);
+        seq.sortEvents();
+        const double sr = 44100.0;
+        ClapEventSequence::IteratorSampleTime iter(seq, sr);
+        std::uniform_int_distribution<int64_t> posdist(-1000, 11 * 44100);
+        for (int i = 0; i < 200; ++i)
+        {
+            int64_t pos = posdist(rng);
+            iter.setTime(pos);
+            auto evts = iter.readNextEvents(4096);
+            size_t expectedStart = 0;
+            while (expectedStart < seq.getNumEvents() &&
+                   seq.m_evlist[expectedStart].timestamp * sr < pos)
+                ++expectedStart;
+            size_t expectedEnd = expectedStart;
+            while (expectedEnd < seq.getNumEvents() &&
+                   seq.m_evlist[expectedEnd].timestamp * sr < pos + 4096)
+                ++expectedEnd;
+            CHOC_EXPECT_TRUE(evts.begin() == seq.m_evlist.data() + expectedStart);
+            CHOC_EXPECT_EQ(evts.size(), expectedEnd - expectedStart);
+        }
+        // modifications invalidate the iterator, even if they don't change the size of the
+        // sequence, and a new iterator sees them
+        CHOC_EXPECT_TRUE(iter.isValid());
+        seq.m_evlist.back().timestamp = 20.0;
+        seq.markModified();
+        CHOC_EXPECT_FALSE(iter.isValid());
+        ClapEventSequence::IteratorSampleTime iter2(seq, sr);
+        iter2.setTime(20 * 44100);
+        CHOC_EXPECT_EQ(iter2.readNextEvents(1).size(), 1);
+        ClapEventSequence other;
+        other.addNoteOn(1.0, 0, 0, 60, 1.0, -1);
+        seq = other;
+        CHOC_EXPECT_FALSE(iter2.isValid());
+    }
 }
 
-void run_tests()
+void test_envelope(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(Envelope)
+    {
+        CHOC_TEST(BulkEvaluationMatchesPointwise)
+        xenakios::Envelope env;
+        env.addPoint({0.0, 1.0});
+        env.addPoint({1.0, 5.0, xenakios::EnvelopePoint::Shape::Power, 0.5});
+        env.addPoint({2.0, -3.0, xenakios::EnvelopePoint::Shape::Power, -0.7});
+        env.addPoint({3.0, 2.0, xenakios::EnvelopePoint::Shape::Hold, 0.3});
+        env.addPoint({3.0, 4.0});
+        env.addPoint({5.0, 0.0, xenakios::EnvelopePoint::Shape::Abrupt});
+        env.addPoint({7.0, 8.0});
+        std::mt19937 rng(9001);
+        std::uniform_real_distribution<double> posdist(-1.0, 9.0);
+        std::vector<double> positions(10000);
+        for (auto &pos : positions)
+            pos = posdist(rng);
+        std::vector<double> values(positions.size());
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            // binary searched first, then merge walked
+            if (pass == 1)
+                std::sort(positions.begin(), positions.end());
+            env.getValuesAtPositions(positions.data(), values.data(), positions.size());
+            size_t mismatches = 0;
+            for (size_t i = 0; i < positions.size(); ++i)
+            {
+                // the pointwise evaluation goes through the float output block
+                if (env.getValueAtPosition(positions[i]) != (float)values[i])
+                    ++mismatches;
+            }
+            CHOC_EXPECT_EQ(mismatches, 0);
+        }
+    }
+}
+
+void test_granulator_golden(choc::test::TestProgress &progress, bool regenerate);
+void test_realtime_check(choc::test::TestProgress &progress);
+void test_engine_realtime_control(choc::test::TestProgress &progress);
+void test_delayed_message_queue(choc::test::TestProgress &progress);
+void test_block_job_runner(choc::test::TestProgress &progress);
+void test_chain_buffer_plan(choc::test::TestProgress &progress);
+void test_stream_interleave(choc::test::TestProgress &progress);
+void test_null_audio_driver(choc::test::TestProgress &progress);
+void test_render_cache(choc::test::TestProgress &progress);
+void test_offline_render(choc::test::TestProgress &progress);
+void test_instance_pool(choc::test::TestProgress &progress);
+void test_granulator_event_sources(choc::test::TestProgress &progress);
+
+// returns false if any test failed
+bool run_tests(bool regenerate_golden)
 {
     choc::test::TestProgress progress;
     test_clap_sequence(progress);
+    test_envelope(progress);
+    test_granulator_golden(progress, regenerate_golden);
+    test_granulator_event_sources(progress);
+    test_realtime_check(progress);
+    test_engine_realtime_control(progress);
+    test_delayed_message_queue(progress);
+    test_block_job_runner(progress);
+    test_chain_buffer_plan(progress);
+    test_stream_interleave(progress);
+    test_null_audio_driver(progress);
+    test_render_cache(progress);
+    test_offline_render(progress);
+    test_instance_pool(progress);
+    progress.printReport();
+    return progress.numFails == 0;
 }
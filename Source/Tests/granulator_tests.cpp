@@ -0,0 +1,375 @@
+#include "../granularsynth/granularsynth.h"
+#include "tests/choc_UnitTest.h"
+#include "audio/choc_AudioFileFormat_WAV.h"
+#include "../Common/xen_rtcheck.h"
+#include <complex>
+#include <filesystem>
+
+// Golden output tests for ToneGranulator. Fixed event lists and self generated grain clouds
+// are rendered with fixed random seeds and compared against reference renders stored as
+// float WAV files. The references are made by running the tests in regenerate mode, which
+// should be done only when a change in the sound is intended.
+
+#ifndef XEN_GOLDEN_REFERENCE_DIR
+#define XEN_GOLDEN_REFERENCE_DIR "golden"
+#endif
+
+struct GranulatorGoldenCase
+{
+    std::string name;
+    double samplerate = 44100.0;
+    double duration = 2.0;
+    int ambisonic_order = 1;
+    // empty means the granulator generates the grains itself
+    events_t events;
+    // if set, the events are played from this source instead
+    std::function<std::unique_ptr<GrainEventSource>()> make_source;
+    std::function<void(ToneGranulator &)> setup;
+    // maximum allowed per channel absolute difference, 0 means bit exact
+    float max_abs_tolerance = 1e-5f;
+    // maximum allowed relative magnitude spectrum difference of any analysis frame
+    float spectral_tolerance = 1e-3f;
+};
+
+struct GoldenComparison
+{
+    std::vector<float> max_abs_per_channel;
+    float max_abs = 0.0f;
+    float spectral_error = 0.0f;
+};
+
+inline choc::buffer::ChannelArrayBuffer<float> render_golden_case(const GranulatorGoldenCase &gc)
+{
+    auto gran = std::make_unique<ToneGranulator>();
+    gran->rng.seed(1234567, 7654321);
+    if (gc.make_source)
+        gran->prepare(gc.samplerate, gc.make_source(), GranulatorVoice::FR_ALLSERIAL, 0.002,
+                      0.002);
+    else
+        gran->prepare(gc.samplerate, gc.events, GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+    *gran->idtoparvalptr[ToneGranulator::PAR_AMBORDER] = gc.ambisonic_order - 1;
+    if (gc.setup)
+        gc.setup(*gran);
+    unsigned int chans = ambisonicOrderNumChannels(gc.ambisonic_order);
+    unsigned int frames = gc.duration * gc.samplerate;
+    choc::buffer::ChannelArrayBuffer<float> result{chans, frames};
+    result.clear();
+    alignas(32) std::array<float, 64 * granul_block_size> procbuf;
+    std::fill(procbuf.begin(), procbuf.end(), 0.0f);
+    unsigned int outframecount = 0;
+    while (outframecount < frames)
+    {
+        unsigned int framestooutput =
+            std::min<unsigned int>(granul_block_size, frames - outframecount);
+        gran->process_block(procbuf);
+        // the output channel count follows the ambisonic order only after the order change fade
+        unsigned int procnumchans = gran->num_out_chans;
+        for (unsigned int i = 0; i < framestooutput; ++i)
+        {
+            for (unsigned int j = 0; j < std::min(chans, procnumchans); ++j)
+                result.getSample(j, outframecount + i) = procbuf[i * procnumchans + j];
+        }
+        outframecount += granul_block_size;
+    }
+    return result;
+}
+
+inline void golden_fft(std::vector<std::complex<float>> &data)
+{
+    const size_t n = data.size();
+    assert((n & (n - 1)) == 0);
+    for (size_t i = 1, j = 0; i < n; ++i)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        float ang = -2.0f * M_PI / len;
+        std::complex<float> wlen{std::cos(ang), std::sin(ang)};
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<float> w{1.0f, 0.0f};
+            for (size_t j = 0; j < len / 2; ++j)
+            {
+                auto u = data[i + j];
+                auto v = data[i + j + len / 2] * w;
+                data[i + j] = u + v;
+                data[i + j + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+// Per channel max-abs difference and the worst relative magnitude spectrum error over
+// Hann windowed analysis frames. Frames where the reference is practically silent are skipped,
+// those would only measure numerical noise.
+inline GoldenComparison
+compare_golden_renders(const choc::buffer::ChannelArrayBuffer<float> &rendered,
+                       const choc::buffer::ChannelArrayBuffer<float> &reference)
+{
+    GoldenComparison result;
+    const unsigned int chans = rendered.getNumChannels();
+    const unsigned int frames = rendered.getNumFrames();
+    result.max_abs_per_channel.resize(chans);
+    for (unsigned int ch = 0; ch < chans; ++ch)
+    {
+        float chanmax = 0.0f;
+        for (unsigned int i = 0; i < frames; ++i)
+            chanmax = std::max(chanmax,
+                               std::abs(rendered.getSample(ch, i) - reference.getSample(ch, i)));
+        result.max_abs_per_channel[ch] = chanmax;
+        result.max_abs = std::max(result.max_abs, chanmax);
+    }
+    const unsigned int fftsize = 1024;
+    const unsigned int hopsize = fftsize / 2;
+    std::vector<float> window(fftsize);
+    for (unsigned int i = 0; i < fftsize; ++i)
+        window[i] = 0.5f - 0.5f * std::cos(2.0f * M_PI * i / fftsize);
+    std::vector<std::complex<float>> specrendered(fftsize);
+    std::vector<std::complex<float>> specreference(fftsize);
+    for (unsigned int ch = 0; ch < chans; ++ch)
+    {
+        for (unsigned int pos = 0; pos + fftsize <= frames; pos += hopsize)
+        {
+            for (unsigned int i = 0; i < fftsize; ++i)
+            {
+                specrendered[i] = rendered.getSample(ch, pos + i) * window[i];
+                specreference[i] = reference.getSample(ch, pos + i) * window[i];
+            }
+            golden_fft(specrendered);
+            golden_fft(specreference);
+            double errorsum = 0.0;
+            double refsum = 0.0;
+            for (unsigned int i = 0; i < fftsize / 2 + 1; ++i)
+            {
+                double refmag = std::abs(specreference[i]);
+                double diff = std::abs(specrendered[i]) - refmag;
+                errorsum += diff * diff;
+                refsum += refmag * refmag;
+            }
+            if (refsum < 1e-10)
+                continue;
+            result.spectral_error =
+                std::max<float>(result.spectral_error, std::sqrt(errorsum / refsum));
+        }
+    }
+    return result;
+}
+
+inline events_t make_golden_events(uint64_t seed, double length)
+{
+    xenakios::Xoroshiro128Plus rng{seed, seed + 1000};
+    events_t result;
+    double tpos = 0.0;
+    while (tpos < length)
+    {
+        GrainEvent ev{tpos, rng.nextFloatInRange(0.01f, 0.2f), rng.nextFloatInRange(-24.0f, 24.0f),
+                      rng.nextFloatInRange(0.2f, 0.8f)};
+        ev.azimuth = rng.nextFloatInRange(-180.0f, 180.0f);
+        ev.elevation = rng.nextFloatInRange(-45.0f, 45.0f);
+        ev.generator_type = rng.nextInt32InRange(0, 7);
+        ev.envelope_shape = rng.nextFloat();
+        result.push_back(ev);
+        tpos += rng.nextFloat64InRange(0.001, 0.05);
+    }
+    return result;
+}
+
+inline std::vector<GranulatorGoldenCase> make_golden_cases()
+{
+    std::vector<GranulatorGoldenCase> result;
+    {
+        GranulatorGoldenCase gc;
+        gc.name = "eventlist_order1";
+        gc.events = make_golden_events(5551, gc.duration - 0.25);
+        result.push_back(gc);
+    }
+    {
+        GranulatorGoldenCase gc;
+        gc.name = "eventlist_order3";
+        gc.ambisonic_order = 3;
+        gc.events = make_golden_events(777, gc.duration - 0.25);
+        result.push_back(gc);
+    }
+    {
+        GranulatorGoldenCase gc;
+        gc.name = "cloud_default";
+        result.push_back(gc);
+    }
+    {
+        GranulatorGoldenCase gc;
+        gc.name = "cloud_stacked_filtered";
+        gc.setup = [](ToneGranulator &g) {
+            *g.idtoparvalptr[ToneGranulator::PAR_DENSITY] = 5.0f;
+            *g.idtoparvalptr[ToneGranulator::PAR_STACKCOUNT] = 4.0f;
+            *g.idtoparvalptr[ToneGranulator::PAR_STACKRANDOMPITCH] = 0.5f;
+            for (auto &mode : GrainInsertFX::getAvailableModes())
+            {
+                if (mode.mainmode == GrainInsertFX::GFXSSTFILTER)
+                {
+                    g.set_filter(0, mode.mainmode, mode.awtype, mode.sstmodel, mode.sstconfig);
+                    break;
+                }
+            }
+        };
+        result.push_back(gc);
+    }
+    return result;
+}
+
+void test_granulator_golden(choc::test::TestProgress &progress, bool regenerate)
+{
+    CHOC_CATEGORY(GranulatorGolden);
+    std::filesystem::path refdir{XEN_GOLDEN_REFERENCE_DIR};
+    if (regenerate)
+        std::filesystem::create_directories(refdir);
+    for (auto &gc : make_golden_cases())
+    {
+        // CHOC_TEST would stringify the expression, not use the case name
+        choc::test::ScopedTest scopedTest{progress, gc.name};
+        auto rendered = render_golden_case(gc);
+        auto reffile = (refdir / (gc.name + ".wav")).string();
+        if (regenerate)
+        {
+            auto writer =
+                xenakios::createWavWriter(reffile, rendered.getNumChannels(), gc.samplerate);
+            CHOC_EXPECT_TRUE(writer != nullptr);
+            if (writer)
+            {
+                CHOC_EXPECT_TRUE(writer->appendFrames(rendered.getView()));
+                writer->flush();
+            }
+            progress.print(std::format("regenerated {}", reffile));
+            continue;
+        }
+        choc::audio::WAVAudioFileFormat<false> format;
+        auto reader = format.createReader(reffile);
+        if (!reader)
+        {
+            // the references have to be generated in regenerate mode on a full build first
+            progress.print(std::format("skipped, reference {} missing", reffile));
+            continue;
+        }
+        const auto &props = reader->getProperties();
+        CHOC_EXPECT_EQ(props.numChannels, rendered.getNumChannels());
+        CHOC_EXPECT_EQ(props.numFrames, rendered.getNumFrames());
+        if (props.numChannels != rendered.getNumChannels() ||
+            props.numFrames != rendered.getNumFrames())
+            continue;
+        choc::buffer::ChannelArrayBuffer<float> reference{props.numChannels,
+                                                          (unsigned int)props.numFrames};
+        reader->readFrames(0, reference.getView());
+        auto cmp = compare_golden_renders(rendered, reference);
+        progress.print(std::format("max abs error {} {}, spectral error {}", cmp.max_abs,
+                                   cmp.max_abs_per_channel, cmp.spectral_error));
+        CHOC_EXPECT_TRUE(cmp.max_abs <= gc.max_abs_tolerance);
+        CHOC_EXPECT_TRUE(cmp.spectral_error <= gc.spectral_tolerance);
+    }
+}
+
+// pulls the events in the given order, chunk_size events at a time
+inline StreamingGrainEventSource::PullFunc make_vector_puller(events_t events, size_t chunk_size)
+{
+    auto pos = std::make_shared<size_t>(0);
+    return [events = std::move(events), pos, chunk_size](GrainEvent *dest, size_t max_events) {
+        size_t count = std::min({max_events, chunk_size, events.size() - *pos});
+        std::copy_n(events.begin() + *pos, count, dest);
+        *pos += count;
+        return count;
+    };
+}
+
+void test_granulator_event_sources(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(GranulatorEventSources);
+    {
+        CHOC_TEST(StreamingReordersWithinLookahead)
+        xenakios::Xoroshiro128Plus rng{31, 41};
+        events_t events;
+        for (int i = 0; i < 100000; ++i)
+            events.push_back(GrainEvent{i * 0.01 + rng.nextFloat64InRange(0.0, 0.5), 0.1f, 0.0f,
+                                        0.5f});
+        events.push_back(GrainEvent{-1.0, 0.1f, 0.0f, 0.5f});
+        // the events are at most 50 events out of order, so a 128 event lookahead is enough
+        StreamingGrainEventSource source{make_vector_puller(events, 100), 128, 32};
+        size_t count = 0;
+        double prevtime = -1.0;
+        bool inorder = true;
+        while (auto ev = source.peek())
+        {
+            inorder = inorder && ev->time_position >= prevtime;
+            prevtime = ev->time_position;
+            source.advance();
+            ++count;
+        }
+        CHOC_EXPECT_TRUE(inorder);
+        CHOC_EXPECT_EQ(count, events.size() - 1);
+        CHOC_EXPECT_EQ(source.get_num_pulled(), events.size());
+        CHOC_EXPECT_TRUE(source.finished());
+    }
+    {
+        CHOC_TEST(StreamingMatchesEventList)
+        GranulatorGoldenCase listcase;
+        listcase.events = make_golden_events(5551, listcase.duration - 0.25);
+        auto streamcase = listcase;
+        streamcase.make_source = [events = listcase.events]() {
+            auto shuffled = events;
+            for (size_t i = 1; i < shuffled.size(); i += 2)
+                std::swap(shuffled[i - 1], shuffled[i]);
+            return std::make_unique<StreamingGrainEventSource>(make_vector_puller(shuffled, 7),
+                                                               16, 4);
+        };
+        auto cmp = compare_golden_renders(render_golden_case(streamcase),
+                                          render_golden_case(listcase));
+        progress.print(std::format("max abs difference {}", cmp.max_abs));
+        CHOC_EXPECT_EQ(cmp.max_abs, 0.0f);
+    }
+}
+
+void test_realtime_check(choc::test::TestProgress &progress)
+{
+#ifdef XEN_RTCHECK
+    CHOC_CATEGORY(RealtimeCheck);
+    {
+        CHOC_TEST(Detection)
+        xenakios::rtcheck::clearViolations();
+        auto v = std::make_unique<std::vector<float>>(100);
+        CHOC_EXPECT_EQ(xenakios::rtcheck::getNumViolations(), 0);
+        {
+            XEN_RTCHECK_AUDIO_SCOPE;
+            v->resize(10000);
+            CHOC_EXPECT_TRUE(xenakios::rtcheck::getNumViolations() > 0);
+            auto count = xenakios::rtcheck::getNumViolations();
+            {
+                XEN_RTCHECK_ALLOW_UNSAFE;
+                v->resize(100000);
+            }
+            CHOC_EXPECT_EQ(xenakios::rtcheck::getNumViolations(), count);
+        }
+        xenakios::rtcheck::clearViolations();
+    }
+    {
+        // the granulator still has known offenders, so this just reports them
+        CHOC_TEST(GranulatorProcessBlock)
+        auto gran = std::make_unique<ToneGranulator>();
+        gran->prepare(44100.0, {}, GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+        *gran->idtoparvalptr[ToneGranulator::PAR_DENSITY] = 6.0f;
+        *gran->idtoparvalptr[ToneGranulator::PAR_STACKCOUNT] = 8.0f;
+        alignas(32) std::array<float, 64 * granul_block_size> procbuf;
+        xenakios::rtcheck::clearViolations();
+        for (int i = 0; i < 44100 * 2; i += granul_block_size)
+        {
+            XEN_RTCHECK_AUDIO_SCOPE;
+            gran->process_block(procbuf);
+        }
+        progress.print(xenakios::rtcheck::getReport());
+        xenakios::rtcheck::clearViolations();
+    }
+#endif
+}
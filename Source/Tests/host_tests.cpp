@@ -0,0 +1,741 @@
+#include "../Host/claphost.h"
+#include "../Common/xen_rtcheck.h"
+#include "../Common/xen_interleave.h"
+#include "tests/choc_UnitTest.h"
+#include "audio/choc_AudioFileFormat_WAV.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <string_view>
+#include <thread>
+
+// Counts the startProcessing and stopProcessing calls of all its instances, and the calls that
+// don't alternate properly, into counters that outlive the processors.
+class ProcessingCountProcessor : public xenakios::XAudioProcessor
+{
+  public:
+    struct Counts
+    {
+        std::atomic<int> numStarts{0};
+        std::atomic<int> numStops{0};
+        std::atomic<int> numUnbalanced{0};
+    };
+    ProcessingCountProcessor(Counts &c) : counts(c) {}
+    ~ProcessingCountProcessor() override
+    {
+        if (started)
+            ++counts.numUnbalanced;
+    }
+    bool startProcessing() noexcept override
+    {
+        if (started)
+            ++counts.numUnbalanced;
+        started = true;
+        ++counts.numStarts;
+        return true;
+    }
+    void stopProcessing() noexcept override
+    {
+        if (!started)
+            ++counts.numUnbalanced;
+        started = false;
+        ++counts.numStops;
+    }
+    clap_process_status process(const clap_process *process) noexcept override
+    {
+        auto &out = process->audio_outputs[0];
+        for (uint32_t ch = 0; ch < out.channel_count; ++ch)
+            std::fill(out.data32[ch], out.data32[ch] + process->frames_count, 0.0f);
+        return CLAP_PROCESS_CONTINUE;
+    }
+
+  private:
+    Counts &counts;
+    bool started = false;
+};
+
+// Runs processAudio from a thread paced like an audio callback, while this thread hammers the
+// control API and adds and removes processors. The blocks that took longer than their duration
+// are only reported, since that depends on the machine running the tests.
+void test_engine_realtime_control(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(ControlWhileStreaming)
+        using clock = std::chrono::steady_clock;
+        const double sr = 44100.0;
+        const unsigned int blocksize = 256;
+        ClapProcessingEngine eng;
+        eng.addProcessorToChain("XenakiosMemoryBufferPlayer", 0);
+        eng.prepareToPlay(sr, blocksize);
+        ProcessingCountProcessor::Counts counts;
+        // like addProcessorToChain does for processors added while playing
+        auto addCountProcessor = [&] {
+            auto entry = std::make_unique<ProcessorEntry>();
+            entry->m_proc = std::make_unique<ProcessingCountProcessor>(counts);
+            entry->name = "ProcessingCount";
+            entry->m_proc->activate(sr, blocksize, blocksize);
+            entry->prepareEventIterator(sr);
+            eng.m_chain.push_back(std::move(entry));
+            eng.publishChain();
+        };
+        int numAdded = 0;
+        choc::buffer::ChannelArrayBuffer<float> inbuf{2, blocksize};
+        choc::buffer::ChannelArrayBuffer<float> outbuf{2, blocksize};
+        inbuf.clear();
+        std::atomic<bool> running{true};
+        std::atomic<int> numBlocks{0};
+        std::atomic<int> numXruns{0};
+#ifdef XEN_RTCHECK
+        xenakios::rtcheck::clearViolations();
+#endif
+        std::thread audioThread{[&] {
+            const auto period = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(blocksize / sr));
+            auto next = clock::now();
+            while (running)
+            {
+                auto start = clock::now();
+                {
+                    XEN_RTCHECK_AUDIO_SCOPE;
+                    eng.processAudio(inbuf.getView(), outbuf.getView());
+                }
+                if (clock::now() - start > period)
+                    ++numXruns;
+                ++numBlocks;
+                next += period;
+                std::this_thread::sleep_until(next);
+            }
+        }};
+        for (int i = 0; i < 2000; ++i)
+        {
+            eng.setSuspended(i % 10 == 9);
+            eng.setMainVolume(-12.0 + i % 12);
+            eng.postParameterMessage(0, 0.01, 0, 0.5);
+            if (i % 100 == 0)
+                eng.allNotesOff();
+            if (i % 200 == 50)
+            {
+                addCountProcessor();
+                ++numAdded;
+            }
+            if (i % 200 == 150)
+                eng.removeProcessorFromChain(1);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        eng.setSuspended(false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        running = false;
+        audioThread.join();
+        progress.print(std::format("{} blocks processed, {} took longer than their duration",
+                                   numBlocks.load(), numXruns.load()));
+        CHOC_EXPECT_TRUE(numBlocks > 0);
+        eng.stopStreaming();
+        // each added processor is removed before the next one is added, and the audio thread had
+        // 50 ms to start each one before it was removed
+        CHOC_EXPECT_EQ(counts.numStarts.load(), numAdded);
+        CHOC_EXPECT_EQ(counts.numStops.load(), numAdded);
+        CHOC_EXPECT_EQ(counts.numUnbalanced.load(), 0);
+#ifdef XEN_RTCHECK
+        size_t numLocks = 0;
+        for (auto &v : xenakios::rtcheck::getViolations())
+        {
+            if (v.type == xenakios::rtcheck::ViolationType::MutexLock ||
+                v.type == xenakios::rtcheck::ViolationType::BlockingCall)
+                numLocks += v.count;
+        }
+        CHOC_EXPECT_EQ(numLocks, 0);
+        xenakios::rtcheck::clearViolations();
+#endif
+    }
+    {
+        CHOC_TEST(RemoveWhileStopped)
+        const unsigned int blocksize = 256;
+        ClapProcessingEngine eng;
+        for (int i = 0; i < 3; ++i)
+            eng.addProcessorToChain("XenakiosMemoryBufferPlayer", 0);
+        eng.prepareToPlay(44100.0, blocksize);
+        choc::buffer::ChannelArrayBuffer<float> inbuf{2, blocksize};
+        choc::buffer::ChannelArrayBuffer<float> outbuf{2, blocksize};
+        inbuf.clear();
+        // never started, so it's destroyed right away and the audio thread must not see it
+        eng.removeProcessorFromChain(2);
+        CHOC_EXPECT_TRUE(eng.m_retiredProcessors.empty());
+        for (int i = 0; i < 4; ++i)
+            eng.processAudio(inbuf.getView(), outbuf.getView());
+        // started, but nothing is processing the chain to stop it, so it's kept until the
+        // stream is stopped
+        eng.removeProcessorFromChain(1);
+        CHOC_EXPECT_EQ(eng.m_retiredProcessors.size(), size_t(1));
+        eng.stopStreaming();
+        CHOC_EXPECT_TRUE(eng.m_retiredProcessors.empty());
+        // the current snapshot still lists the destroyed processor as retired
+        for (int i = 0; i < 4; ++i)
+            eng.processAudio(inbuf.getView(), outbuf.getView());
+        CHOC_EXPECT_EQ(eng.m_chain.size(), size_t(1));
+    }
+    {
+        CHOC_TEST(ChainsOnlyDoesNotPassInput)
+        const unsigned int blocksize = 256;
+        ClapProcessingEngine eng;
+        // the player has no buffer to play, so the chain is silent and so should the output be
+        auto &chain = eng.addChain();
+        chain.addProcessor("XenakiosMemoryBufferPlayer", 0);
+        eng.prepareToPlay(44100.0, blocksize);
+        choc::buffer::ChannelArrayBuffer<float> inbuf{2, blocksize};
+        choc::buffer::ChannelArrayBuffer<float> outbuf{2, blocksize};
+        for (uint32_t ch = 0; ch < 2; ++ch)
+            for (uint32_t i = 0; i < blocksize; ++i)
+                inbuf.getSample(ch, i) = std::sin(i * 0.05f) * 0.5f;
+        float peak = 0.0f;
+        for (int i = 0; i < 8; ++i)
+        {
+            // leftovers in the output buffer must be overwritten too
+            choc::buffer::copy(outbuf, inbuf);
+            eng.processAudio(inbuf.getView(), outbuf.getView());
+            for (uint32_t ch = 0; ch < 2; ++ch)
+                for (uint32_t j = 0; j < blocksize; ++j)
+                    peak = std::max(peak, std::abs(outbuf.getSample(ch, j)));
+        }
+        CHOC_EXPECT_EQ(peak, 0.0f);
+        eng.stopStreaming();
+    }
+}
+
+void test_delayed_message_queue(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(DelayedMessageQueue)
+        DelayedMessageQueue queue;
+        queue.reset(1000);
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> posdist(0, 10000);
+        for (int i = 0; i < 1000; ++i)
+        {
+            auto ev = xenakios::make_event_note(0, CLAP_EVENT_NOTE_ON, 0, 0, 60, i, 1.0);
+            // plenty of equal positions, which must come out in the order they went in
+            queue.schedule(ClapEventSequence::Event(posdist(rng) / 10 * 10, &ev, i % 4));
+        }
+        auto ev = xenakios::make_event_note(0, CLAP_EVENT_NOTE_ON, 0, 0, 60, -1, 1.0);
+        CHOC_EXPECT_FALSE(queue.schedule(ClapEventSequence::Event(0.0, &ev)));
+        CHOC_EXPECT_EQ(queue.getNumDropped(), 1);
+        double prevTime = -1.0;
+        int prevId = -1;
+        int numPopped = 0;
+        ClapEventSequence::Event result;
+        for (int64_t pos = 0; pos < 11000; pos += 64)
+        {
+            while (queue.popDue(pos + 64, result))
+            {
+                CHOC_EXPECT_TRUE(result.timestamp < pos + 64);
+                CHOC_EXPECT_TRUE(result.timestamp >= prevTime);
+                if (result.timestamp == prevTime)
+                    CHOC_EXPECT_TRUE(result.event.note.note_id > prevId);
+                prevTime = result.timestamp;
+                prevId = result.event.note.note_id;
+                ++numPopped;
+            }
+        }
+        CHOC_EXPECT_EQ(numPopped, 1000);
+        CHOC_EXPECT_EQ(queue.size(), 0);
+    }
+}
+
+void test_block_job_runner(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(BlockJobRunner)
+        const size_t numJobs = 8;
+        std::vector<int> results(numJobs, 0);
+        std::vector<std::thread::id> pinnedThreads;
+        std::vector<xenakios::BlockJobRunner::Job> jobs;
+        std::vector<bool> pinned;
+        for (size_t i = 0; i < numJobs; ++i)
+        {
+            jobs.push_back([&results, &pinnedThreads, i] {
+                ++results[i];
+                if (i == 3)
+                    pinnedThreads.push_back(std::this_thread::get_id());
+            });
+            pinned.push_back(i == 3);
+        }
+        xenakios::BlockJobRunner runner(3);
+        runner.setJobs(std::move(jobs), pinned);
+        CHOC_EXPECT_EQ(runner.getNumJobs(), numJobs);
+        for (int block = 0; block < 1000; ++block)
+        {
+            runner.run();
+            // every job has finished when run returns
+            for (size_t i = 0; i < numJobs; ++i)
+                CHOC_EXPECT_EQ(results[i], block + 1);
+        }
+        CHOC_EXPECT_TRUE(std::all_of(pinnedThreads.begin(), pinnedThreads.end(),
+                                     [&](auto id) { return id == pinnedThreads.front(); }));
+    }
+}
+
+void test_chain_buffer_plan(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(ChainBufferPlan)
+        // a synth, an in-place effect, an effect with a mono main input and a sidechain input
+        // and an extra output, and another in-place effect
+        std::vector<ChainBufferPlan::ProcessorPorts> procs;
+        procs.push_back({{}, {{2, 0}}});
+        procs.push_back({{{2, 7}}, {{2, 0, 7}}});
+        procs.push_back({{{1, 0}, {2, 1}}, {{2, 0}, {2, 1}}});
+        procs.push_back({{{2, 3}}, {{2, 0, 3}}});
+        ChainBufferPlan plan;
+        plan.build(procs, {{0, 0, 0}, {1, 1, 1}}, {{0, 0, 0}, {0, 1, 1}, {0, 0, 1}, {1, 0, 2}},
+                   64);
+        CHOC_EXPECT_EQ(plan.getNumSteps(), procs.size());
+        CHOC_EXPECT_TRUE(plan.getStep(1).inPlace);
+        CHOC_EXPECT_FALSE(plan.getStep(2).inPlace);
+        CHOC_EXPECT_TRUE(plan.getStep(3).inPlace);
+        CHOC_EXPECT_EQ(plan.getStep(1).mainInputBuffer, plan.getStep(0).mainOutputBuffer);
+        CHOC_EXPECT_TRUE(plan.getStep(2).mainOutputBuffer != plan.getStep(2).mainInputBuffer);
+        const uint32_t frames = 32;
+        for (int block = 0; block < 3; ++block)
+        {
+            for (float *dest : plan.getRoutedInputs())
+                std::fill(dest, dest + frames, 0.5f);
+            for (size_t i = 0; i < plan.getNumSteps(); ++i)
+            {
+                auto &step = plan.getStep(i);
+                for (float *chan : step.clearBeforeProcess)
+                    std::fill(chan, chan + frames, 0.0f);
+                // the synth outputs 1, the effects double their main input
+                for (size_t port = 0; port < step.outputs.size(); ++port)
+                {
+                    for (uint32_t ch = 0; ch < step.outputs[port].channel_count; ++ch)
+                    {
+                        for (uint32_t j = 0; j < frames; ++j)
+                        {
+                            float in = 0.0f;
+                            if (port == 0 && !step.inputs.empty() &&
+                                ch < step.inputs[0].channel_count)
+                                in = step.inputs[0].data32[ch][j];
+                            step.outputs[port].data32[ch][j] = i == 0 ? 1.0f : 2.0f * in;
+                        }
+                    }
+                }
+            }
+            std::vector<float> out(3 * frames, -1.0f);
+            for (auto &conn : plan.getOutputConnections())
+            {
+                float *dest = &out[conn.destChannel * frames];
+                for (uint32_t j = 0; j < frames; ++j)
+                {
+                    float v = conn.source ? conn.source[j] : 0.0f;
+                    dest[j] = conn.add ? dest[j] + v : v;
+                }
+            }
+            // the second channel is lost at the mono input, the last processor has no second
+            // output port so its destination gets silence
+            CHOC_EXPECT_EQ(out[0], 8.0f);
+            CHOC_EXPECT_EQ(out[frames], 8.0f);
+            CHOC_EXPECT_EQ(out[2 * frames], 0.0f);
+        }
+    }
+}
+
+void test_stream_interleave(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(StreamInterleave)
+        std::mt19937 rng(9004);
+        std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+        size_t mismatches = 0;
+        // channel counts that go through the 4 channel, stereo and single channel paths
+        for (uint32_t numChans : {1u, 2u, 3u, 4u, 6u, 16u, 19u})
+        {
+            const uint32_t frames = 67;
+            std::vector<std::vector<float>> planar(numChans, std::vector<float>(frames));
+            std::vector<const float *> sources;
+            for (auto &chan : planar)
+            {
+                for (auto &x : chan)
+                    x = dist(rng);
+                sources.push_back(chan.data());
+            }
+            std::vector<float> interleaved(numChans * frames);
+            xenakios::interleaveClamped(sources.data(), numChans, interleaved.data(), frames);
+            std::vector<std::vector<float>> back(numChans, std::vector<float>(frames));
+            std::vector<float *> dests;
+            for (auto &chan : back)
+                dests.push_back(chan.data());
+            xenakios::deinterleave(interleaved.data(), numChans, dests.data(), frames);
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                for (uint32_t ch = 0; ch < numChans; ++ch)
+                {
+                    float expected = std::clamp(planar[ch][i], -1.0f, 1.0f);
+                    if (interleaved[i * numChans + ch] != expected || back[ch][i] != expected)
+                        ++mismatches;
+                }
+            }
+        }
+        CHOC_EXPECT_EQ(mismatches, 0);
+    }
+}
+
+void test_null_audio_driver(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(NullAudioDriverClock)
+        const double sr = 48000.0;
+        const uint32_t bufferSize = 256;
+        std::atomic<int64_t> numCalls{0};
+        std::atomic<bool> badChannels{false};
+        NullAudioDriver driver;
+        driver.start(sr, bufferSize, 2, 3,
+                     [&](choc::buffer::ChannelArrayView<float> input,
+                         choc::buffer::ChannelArrayView<float> output) {
+                         if (input.getNumChannels() != 2 || output.getNumChannels() != 3 ||
+                             output.getNumFrames() != bufferSize)
+                             badChannels = true;
+                         ++numCalls;
+                     });
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        driver.stop();
+        auto stats = driver.getStats();
+        CHOC_EXPECT_FALSE(badChannels.load());
+        CHOC_EXPECT_EQ(stats.numCallbacks, numCalls.load());
+        // the clock must neither run fast nor stall, with room for a loaded test machine
+        double expected = 0.5 * sr / bufferSize;
+        CHOC_EXPECT_TRUE(stats.numCallbacks + stats.numSkippedBuffers > expected * 0.8);
+        CHOC_EXPECT_TRUE(stats.numCallbacks <= expected + 2);
+    }
+}
+
+void test_render_cache(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapProcessingEngine);
+    {
+        CHOC_TEST(RenderCacheKeys)
+        auto key = [](std::string_view a, std::string_view b) {
+            return RenderCache::KeyBuilder{}.add(a).add(b).getKey();
+        };
+        CHOC_EXPECT_TRUE(key("ab", "c") == key("ab", "c"));
+        CHOC_EXPECT_TRUE(key("ab", "c") != key("a", "bc"));
+        CHOC_EXPECT_TRUE(RenderCache::KeyBuilder{}.add(0.0).getKey() ==
+                         RenderCache::KeyBuilder{}.add(-0.0).getKey());
+    }
+    {
+        CHOC_TEST(RenderCacheStoreLoad)
+        auto dir = std::filesystem::temp_directory_path() / "xen_render_cache_test";
+        std::filesystem::remove_all(dir);
+        RenderCache cache{dir};
+        choc::buffer::ChannelArrayBuffer<float> audio{3, 1000};
+        for (uint32_t ch = 0; ch < 3; ++ch)
+            for (uint32_t i = 0; i < 1000; ++i)
+                audio.getSample(ch, i) = std::sin(i * 0.01f * (ch + 1));
+        choc::buffer::ChannelArrayBuffer<float> loaded{3, 1000};
+        CHOC_EXPECT_FALSE(cache.load(42, loaded.getView()));
+        cache.store(42, audio.getView(), 44100.0);
+        CHOC_EXPECT_TRUE(cache.load(42, loaded.getView()));
+        CHOC_EXPECT_TRUE(choc::buffer::contentMatches(loaded, audio));
+        // a request for a different length is a miss, not a partial load
+        choc::buffer::ChannelArrayBuffer<float> shorter{3, 500};
+        CHOC_EXPECT_FALSE(cache.load(42, shorter.getView()));
+        CHOC_EXPECT_EQ(cache.getNumHits(), 1);
+        CHOC_EXPECT_EQ(cache.getNumMisses(), 2);
+        std::filesystem::remove_all(dir);
+    }
+    {
+        CHOC_TEST(RenderCacheStreaming)
+        auto dir = std::filesystem::temp_directory_path() / "xen_render_cache_stream_test";
+        std::filesystem::remove_all(dir);
+        RenderCache cache{dir};
+        const uint32_t numChans = 3;
+        const uint32_t blockSize = 100;
+        const uint32_t numBlocks = 25;
+        auto sample = [](uint32_t ch, uint32_t frame) {
+            return std::sin(frame * 0.01f * (ch + 1));
+        };
+        auto writeStem = [&](uint64_t key, bool commit) {
+            auto writer = cache.createWriter(key, numChans, 44100.0);
+            std::vector<float> interleaved(numChans * blockSize);
+            for (uint32_t b = 0; b < numBlocks; ++b)
+            {
+                for (uint32_t i = 0; i < blockSize; ++i)
+                    for (uint32_t ch = 0; ch < numChans; ++ch)
+                        interleaved[i * numChans + ch] = sample(ch, b * blockSize + i);
+                writer->write(interleaved.data(), blockSize);
+            }
+            if (commit)
+                writer->commit();
+        };
+        // an abandoned stem is neither stored nor left behind as a temporary file
+        writeStem(1, false);
+        CHOC_EXPECT_TRUE(std::filesystem::is_empty(dir));
+        CHOC_EXPECT_TRUE(cache.openReader(1, numChans, numBlocks * blockSize) == nullptr);
+        writeStem(2, true);
+        CHOC_EXPECT_TRUE(cache.openReader(2, numChans, blockSize) == nullptr);
+        auto reader = cache.openReader(2, numChans, numBlocks * blockSize);
+        CHOC_EXPECT_TRUE(reader != nullptr);
+        if (reader)
+        {
+            choc::buffer::ChannelArrayBuffer<float> block{numChans, blockSize};
+            int mismatches = 0;
+            // out of order, each read is positioned by its frame index
+            for (uint32_t b : {3u, 0u, 24u, 7u})
+            {
+                CHOC_EXPECT_TRUE(reader->readFrames(b * blockSize, block.getView()));
+                for (uint32_t ch = 0; ch < numChans; ++ch)
+                    for (uint32_t i = 0; i < blockSize; ++i)
+                        if (block.getSample(ch, i) != sample(ch, b * blockSize + i))
+                            ++mismatches;
+            }
+            CHOC_EXPECT_EQ(mismatches, 0);
+        }
+        reader.reset();
+        std::filesystem::remove_all(dir);
+    }
+}
+
+// Writes the value of each parameter event into the output at the frame the event landed on and
+// counts the process calls that were shorter than the minimum frame count it was activated with.
+class EventMarkerProcessor : public xenakios::XAudioProcessor
+{
+  public:
+    uint32_t minFrames = 0;
+    int numProcessCalls = 0;
+    int numShortBlocks = 0;
+    bool activate(double sampleRate, uint32_t minFrameCount,
+                  uint32_t maxFrameCount) noexcept override
+    {
+        minFrames = minFrameCount;
+        return true;
+    }
+    clap_process_status process(const clap_process *process) noexcept override
+    {
+        ++numProcessCalls;
+        if (process->frames_count < minFrames)
+            ++numShortBlocks;
+        auto &out = process->audio_outputs[0];
+        for (uint32_t ch = 0; ch < out.channel_count; ++ch)
+            std::fill(out.data32[ch], out.data32[ch] + process->frames_count, 0.0f);
+        auto inEvents = process->in_events;
+        for (uint32_t i = 0; i < inEvents->size(inEvents); ++i)
+        {
+            auto ev = inEvents->get(inEvents, i);
+            if (ev->type != CLAP_EVENT_PARAM_VALUE || ev->time >= process->frames_count)
+                continue;
+            auto pev = (const clap_event_param_value *)ev;
+            for (uint32_t ch = 0; ch < out.channel_count; ++ch)
+                out.data32[ch][ev->time] = (float)pev->value;
+        }
+        return CLAP_PROCESS_CONTINUE;
+    }
+};
+
+inline choc::buffer::ChannelArrayBuffer<float> read_wav_file(const std::string &filename)
+{
+    choc::audio::WAVAudioFileFormat<false> format;
+    auto reader = format.createReader(filename);
+    if (!reader)
+        return {};
+    const auto &props = reader->getProperties();
+    choc::buffer::ChannelArrayBuffer<float> result{props.numChannels,
+                                                   (unsigned int)props.numFrames};
+    reader->readFrames(0, result.getView());
+    return result;
+}
+
+void test_offline_render(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(OfflineRender);
+    {
+        CHOC_TEST(AutomationSplitEventPlacement)
+        const double sr = 44100.0;
+        // irregularly spaced events, far enough apart for each to start a sub-block
+        std::vector<int64_t> eventFrames;
+        for (int64_t frame = 100; frame < sr * 2.0; frame += 37 + (frame * 7) % 300)
+            eventFrames.push_back(frame);
+        ClapEventSequence seq;
+        for (size_t i = 0; i < eventFrames.size(); ++i)
+            seq.addParameterEvent(false, (eventFrames[i] + 0.5) / sr, -1, -1, -1, -1, 0,
+                                  0.1 + 0.8 * (i % 10) / 10.0);
+        struct RenderResult
+        {
+            choc::buffer::ChannelArrayBuffer<float> audio;
+            int numProcessCalls = 0;
+            int numShortBlocks = 0;
+        };
+        auto render = [&](int split, std::string filename) {
+            ClapProcessingEngine eng;
+            auto marker = std::make_unique<EventMarkerProcessor>();
+            auto markerPtr = marker.get();
+            auto entry = std::make_unique<ProcessorEntry>();
+            entry->m_proc = std::move(marker);
+            entry->name = "EventMarker";
+            eng.m_chain.push_back(std::move(entry));
+            eng.setSequence(0, seq);
+            eng.m_offlineOptions.blockSize = 512;
+            eng.m_offlineOptions.automationSplitFrames = split;
+            eng.processToFile(filename, 2.5, sr, 2, []() { return 0; });
+            return RenderResult{read_wav_file(filename), markerPtr->numProcessCalls,
+                                markerPtr->numShortBlocks};
+        };
+        auto dir = std::filesystem::temp_directory_path();
+        auto unsplitFile = (dir / "xen_offline_unsplit.wav").string();
+        auto splitFile = (dir / "xen_offline_split.wav").string();
+        auto unsplitResult = render(0, unsplitFile);
+        auto splitResult = render(16, splitFile);
+        progress.print(std::format("{} process calls unsplit, {} split",
+                                   unsplitResult.numProcessCalls, splitResult.numProcessCalls));
+        CHOC_EXPECT_TRUE(splitResult.numProcessCalls > unsplitResult.numProcessCalls);
+        CHOC_EXPECT_EQ(unsplitResult.numShortBlocks, 0);
+        CHOC_EXPECT_EQ(splitResult.numShortBlocks, 0);
+        auto &unsplit = unsplitResult.audio;
+        auto &split = splitResult.audio;
+        CHOC_EXPECT_EQ(unsplit.getNumFrames(), (uint32_t)(2.5 * sr));
+        CHOC_EXPECT_TRUE(choc::buffer::contentMatches(unsplit, split));
+        if (unsplit.getNumFrames() == (uint32_t)(2.5 * sr))
+        {
+            int misplaced = 0;
+            for (auto frame : eventFrames)
+            {
+                if (unsplit.getSample(0, frame) == 0.0f || unsplit.getSample(0, frame - 1) != 0.0f)
+                    ++misplaced;
+            }
+            CHOC_EXPECT_EQ(misplaced, 0);
+        }
+        std::filesystem::remove(unsplitFile);
+        std::filesystem::remove(splitFile);
+    }
+    {
+        CHOC_TEST(RenderTail)
+        const double sr = 44100.0;
+        const int blockSize = 512;
+        // a looped DC buffer, faded in at the start and faded out over 0.25 seconds at 0.5
+        std::vector<double> dc(4410, 0.5);
+        ClapEventSequence seq;
+        seq.addAudioBufferEvent(0.0, 0, dc.data(), 1, (int32_t)dc.size(), (int32_t)sr);
+        seq.addAudioRoutingEvent(0.0, 0, 1, 0, 0);
+        seq.addAudioRoutingEvent(0.5, 0, 0, 0, 0);
+        const int64_t lastEventFrame = std::ceil(0.5 * sr);
+        auto filename = (std::filesystem::temp_directory_path() / "xen_offline_tail.wav").string();
+        auto render = [&](const ClapEventSequence &sequence, double duration, bool stopOnSilence,
+                          double maxTailSeconds) {
+            ClapProcessingEngine eng;
+            eng.addProcessorToChain("XenakiosMemoryBufferPlayer", 0);
+            eng.setSequence(0, sequence);
+            eng.m_offlineOptions.blockSize = blockSize;
+            eng.m_offlineOptions.stopOnSilence = stopOnSilence;
+            eng.m_offlineOptions.maxTailSeconds = maxTailSeconds;
+            eng.processToFile(filename, duration, sr, 2, []() { return 0; });
+            auto result = read_wav_file(filename);
+            std::filesystem::remove(filename);
+            return result;
+        };
+        auto openEnded = render(seq, 0.0, true, 30.0);
+        const ClapProcessingEngine::OfflineRenderOptions defaults;
+        const float silenceGain = std::pow(10.0, defaults.silenceThresholdDecibels / 20.0);
+        const int64_t holdFrames = defaults.silenceHoldSeconds * sr;
+        int64_t silenceStart = 0;
+        for (uint32_t ch = 0; ch < openEnded.getNumChannels(); ++ch)
+            for (uint32_t i = 0; i < openEnded.getNumFrames(); ++i)
+                if (std::abs(openEnded.getSample(ch, i)) >= silenceGain)
+                    silenceStart = std::max<int64_t>(silenceStart, i + 1);
+        int64_t numFrames = openEnded.getNumFrames();
+        progress.print(std::format("silent from frame {}, rendered {} frames", silenceStart,
+                                   numFrames));
+        CHOC_EXPECT_TRUE(silenceStart > lastEventFrame);
+        CHOC_EXPECT_TRUE(numFrames >= silenceStart + holdFrames);
+        CHOC_EXPECT_TRUE(numFrames < silenceStart + holdFrames + blockSize);
+        // the silence doesn't cut a positive duration short
+        CHOC_EXPECT_EQ(render(seq, 1.3, true, 30.0).getNumFrames(), (uint32_t)(1.3 * sr));
+        CHOC_EXPECT_EQ(render(seq, 0.1, true, 30.0).getNumFrames(), (uint32_t)(0.1 * sr));
+        // without stopping on silence, an open-ended render runs for the maximum tail
+        CHOC_EXPECT_EQ(render(seq, 0.0, false, 1.0).getNumFrames(),
+                       (uint32_t)(lastEventFrame + sr));
+        // nothing was sent to the plugins, so the silence doesn't end the render
+        CHOC_EXPECT_EQ(render(ClapEventSequence{}, 0.0, true, 1.0).getNumFrames(), (uint32_t)sr);
+    }
+}
+
+// Keeps a single value as its state. The state extension can be disabled to act like a plugin
+// that doesn't support saving its state.
+class StateValueProcessor : public xenakios::XAudioProcessor
+{
+  public:
+    int value = 0;
+    bool supportsState = true;
+    bool stateSave(const clap_ostream *stream) noexcept override
+    {
+        if (!supportsState)
+            return false;
+        return stream->write(stream, &value, sizeof(value)) == sizeof(value);
+    }
+    bool stateLoad(const clap_istream *stream) noexcept override
+    {
+        if (!supportsState)
+            return false;
+        return stream->read(stream, &value, sizeof(value)) == sizeof(value);
+    }
+    clap_process_status process(const clap_process *process) noexcept override
+    {
+        return CLAP_PROCESS_CONTINUE;
+    }
+};
+
+inline std::vector<char> save_processor_state(xenakios::XAudioProcessor &proc)
+{
+    std::vector<char> result;
+    clap_ostream os;
+    os.ctx = &result;
+    os.write = [](const clap_ostream *stream, const void *buffer, uint64_t size) {
+        auto &data = *(std::vector<char> *)stream->ctx;
+        data.insert(data.end(), (const char *)buffer, (const char *)buffer + size);
+        return int64_t(size);
+    };
+    if (!proc.stateSave(&os))
+        result.clear();
+    return result;
+}
+
+void test_instance_pool(choc::test::TestProgress &progress)
+{
+    CHOC_CATEGORY(ClapInstancePool);
+    {
+        CHOC_TEST(ReacquiredInstanceIsReset)
+        ClapInstancePool pool;
+        auto proc = std::make_unique<StateValueProcessor>();
+        auto procPtr = proc.get();
+        ClapInstancePool::Instance instance;
+        instance.initialState = save_processor_state(*proc);
+        instance.proc = std::move(proc);
+        CHOC_EXPECT_FALSE(instance.initialState.empty());
+        procPtr->value = 42;
+        pool.release("statevalue", 0, std::move(instance));
+        CHOC_EXPECT_EQ(pool.getNumPooled(), 1);
+        auto reacquired = pool.acquire("statevalue", 0);
+        CHOC_EXPECT_TRUE(reacquired.proc.get() == procPtr);
+        CHOC_EXPECT_EQ(procPtr->value, 0);
+        CHOC_EXPECT_EQ(pool.getNumPooled(), 0);
+        CHOC_EXPECT_EQ(pool.getNumReused(), 1);
+    }
+    {
+        CHOC_TEST(InstanceWithoutStateIsNotPooled)
+        ClapInstancePool pool;
+        auto proc = std::make_unique<StateValueProcessor>();
+        proc->supportsState = false;
+        ClapInstancePool::Instance instance;
+        instance.initialState = save_processor_state(*proc);
+        instance.proc = std::move(proc);
+        CHOC_EXPECT_TRUE(instance.initialState.empty());
+        pool.release("statevalue", 0, std::move(instance));
+        CHOC_EXPECT_EQ(pool.getNumPooled(), 0);
+    }
+}
@@ -81,6 +81,7 @@ class ClapPluginFormatProcessor : public xenakios::XAudioProcessor
     bool activate(double sampleRate, uint32_t minFrameCount,
                   uint32_t maxFrameCount) noexcept override;
     void deactivate() noexcept override;
+    bool isActivated() const noexcept { return m_activated; }
     uint32_t tailGet() const noexcept override;
     void initParamsExtension();
     uint32_t paramsCount() const noexcept override { return m_ext_params->count(m_plug); }
@@ -0,0 +1,126 @@
+// Offline render benchmark for ClapProcessingEngine::processToFile.
+// Renders a reference chain with a fixed note and automation sequence at a range of block sizes
+// and reports the realtime factor for each, so the per process call overhead can be compared
+// against the cost of the actual processing. Results are printed and also written into a JSON
+// file so that runs from different commits/machines can be compared.
+//
+// usage : claprenderbench [plugin file] [plugin index] [seconds] [output.json]
+// the default plugin is the internal XenakiosMemoryBufferPlayer
+
+#include "../Host/claphost.h"
+#include "text/choc_JSON.h"
+#include "text/choc_Files.h"
+#include <chrono>
+#include <filesystem>
+#include <print>
+
+struct RenderBenchResult
+{
+    int blocksize = 0;
+    int automationsplit = 0;
+    double seconds = 0.0;
+    double realtime_factor = 0.0;
+};
+
+// notes every 100 milliseconds and automation of the first parameter every millisecond, which
+// is about as dense as automation gets in practice
+inline ClapEventSequence make_bench_sequence(double length, clap_id parid)
+{
+    ClapEventSequence seq;
+    for (int i = 0; i < length * 10.0; ++i)
+        seq.addNote(i * 0.1, 0.2, 0, 0, 48 + (i * 7) % 24, -1, 0.5, 0.0);
+    for (int i = 0; i < length * 1000.0; ++i)
+        seq.addParameterEvent(false, i * 0.001, -1, -1, -1, -1, parid, 0.5 + 0.4 * (i % 2));
+    seq.sortEvents();
+    return seq;
+}
+
+inline RenderBenchResult run_render(const std::string &plugfile, int plugindex, double seconds,
+                                    int blocksize, int automationsplit,
+                                    const std::string &outfile)
+{
+    ClapProcessingEngine eng;
+    eng.addProcessorToChain(plugfile, plugindex);
+    clap_id parid = 0;
+    if (eng.getNumParameters(0) > 0)
+    {
+        clap_param_info pinfo;
+        if (eng.m_chain[0]->m_proc->paramsInfo(0, &pinfo))
+            parid = pinfo.id;
+    }
+    eng.setSequence(0, make_bench_sequence(seconds, parid));
+    eng.m_offlineOptions.blockSize = blocksize;
+    eng.m_offlineOptions.stopOnSilence = false;
+    eng.m_offlineOptions.automationSplitFrames = automationsplit;
+    using clock = std::chrono::steady_clock;
+    const auto start_time = clock::now();
+    eng.processToFile(outfile, seconds, 44100.0, 2, []() { return 0; });
+    const std::chrono::duration<double> elapsed = clock::now() - start_time;
+    RenderBenchResult result;
+    result.blocksize = blocksize;
+    result.automationsplit = automationsplit;
+    result.seconds = elapsed.count();
+    result.realtime_factor = seconds / elapsed.count();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    std::string plugfile = "XenakiosMemoryBufferPlayer";
+    int plugindex = 0;
+    double seconds = 30.0;
+    std::string outfile = "clap_render_bench.json";
+    if (argc >= 2)
+        plugfile = argv[1];
+    if (argc >= 3)
+        plugindex = std::atoi(argv[2]);
+    if (argc >= 4)
+        seconds = std::clamp(std::atof(argv[3]), 1.0, 3600.0);
+    if (argc >= 5)
+        outfile = argv[4];
+    auto renderfile = (std::filesystem::temp_directory_path() / "clap_render_bench.wav").string();
+    std::vector<RenderBenchResult> results;
+    try
+    {
+        for (int blocksize : {32, 64, 128, 256, 512, 1024, 2048, 4096})
+            results.push_back(run_render(plugfile, plugindex, seconds, blocksize, 0, renderfile));
+        // large blocks split at the automation, against the small blocks above
+        for (int split : {32, 64, 256})
+            results.push_back(run_render(plugfile, plugindex, seconds, 4096, split, renderfile));
+    }
+    catch (std::exception &ex)
+    {
+        std::print("render failed : {}\n", ex.what());
+        return 1;
+    }
+    std::print("{:<12} {:>12} {:>10} {:>10}\n", "block size", "autom split", "seconds",
+               "rt factor");
+    auto jresults = choc::value::createEmptyArray();
+    for (auto &r : results)
+    {
+        std::print("{:<12} {:>12} {:>10.3f} {:>10.2f}\n", r.blocksize, r.automationsplit,
+                   r.seconds, r.realtime_factor);
+        auto ob = choc::value::createObject("result");
+        ob.setMember("blocksize", r.blocksize);
+        ob.setMember("automationsplit", r.automationsplit);
+        ob.setMember("seconds", r.seconds);
+        ob.setMember("realtime_factor", r.realtime_factor);
+        jresults.addArrayElement(ob);
+    }
+    auto root = choc::value::createObject("claprenderbench");
+    root.setMember("plugin", plugfile);
+    root.setMember("pluginindex", plugindex);
+    root.setMember("render_seconds", seconds);
+    root.setMember("results", jresults);
+    try
+    {
+        choc::file::replaceFileWithContent(outfile, choc::json::toString(root, true));
+        std::print("wrote results to {}\n", outfile);
+    }
+    catch (std::exception &ex)
+    {
+        std::print("could not write results : {}\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
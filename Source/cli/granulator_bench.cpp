@@ -0,0 +1,242 @@
+// Offline performance benchmark for ToneGranulator, does not need Juce.
+// Runs a matrix of scenarios with fixed random seeds and reports the cost per sample frame
+// and the realtime factor for each. Results are printed and also written into a JSON file
+// so that runs from different commits/machines can be compared.
+//
+// usage : granulatorbench [output.json] [seconds per scenario] [scenario name filter]
+
+#include "../granularsynth/granularsynth.h"
+#include "text/choc_JSON.h"
+#include "text/choc_Files.h"
+#include <chrono>
+#include <set>
+#include <print>
+
+struct BenchScenario
+{
+    std::string name;
+    // -1 means self generated grains, otherwise number of grains overlapping at any time
+    // in a generated event list
+    int eventlistvoices = -1;
+    float density = 4.0f;
+    float duration = 0.1f;
+    int stackcount = 1;
+    int ambiorder = 1;
+    int osctype = 0;
+    GrainInsertFX::ModeInfo insert;
+};
+
+struct BenchResult
+{
+    double ns_per_frame = 0.0;
+    double realtime_factor = 0.0;
+    double avg_voices = 0.0;
+    int max_voices = 0;
+    int missed_grains = 0;
+    int64_t frames = 0;
+};
+
+// evenly staggered grains so that close to numvoices grains are always playing
+inline events_t make_bench_events(int numvoices, double length, uint64_t seed)
+{
+    xenakios::Xoroshiro128Plus rng{seed, seed * 31 + 17};
+    events_t result;
+    const double graindur = 0.1;
+    const double step = graindur / numvoices;
+    result.reserve(length / step + 1);
+    double tpos = 0.0;
+    while (tpos < length)
+    {
+        GrainEvent ev{tpos, (float)graindur, rng.nextFloatInRange(-24.0f, 24.0f), 0.5f};
+        ev.azimuth = rng.nextFloatInRange(-180.0f, 180.0f);
+        ev.elevation = rng.nextFloatInRange(-45.0f, 45.0f);
+        ev.generator_type = rng.nextInt32InRange(0, 5);
+        result.push_back(ev);
+        tpos += step;
+    }
+    return result;
+}
+
+inline BenchResult run_scenario(const BenchScenario &sc, double samplerate, double seconds)
+{
+    auto gran = std::make_unique<ToneGranulator>();
+    gran->rng.seed(1234567, 7654321);
+    events_t evlist;
+    // the event list is erased past 120 seconds in prepare
+    if (sc.eventlistvoices > 0)
+        evlist = make_bench_events(sc.eventlistvoices, std::min(seconds + 1.0, 119.0), 98765);
+    gran->prepare(samplerate, std::move(evlist), GranulatorVoice::FR_ALLSERIAL, 0.002, 0.002);
+    gran->set_filter(0, sc.insert.mainmode, sc.insert.awtype, sc.insert.sstmodel,
+                     sc.insert.sstconfig);
+    *gran->idtoparvalptr[ToneGranulator::PAR_AMBORDER] = sc.ambiorder - 1;
+    *gran->idtoparvalptr[ToneGranulator::PAR_DENSITY] = sc.density;
+    *gran->idtoparvalptr[ToneGranulator::PAR_DURATION] = sc.duration;
+    *gran->idtoparvalptr[ToneGranulator::PAR_STACKCOUNT] = sc.stackcount;
+    *gran->idtoparvalptr[ToneGranulator::PAR_OSCTYPE] = sc.osctype;
+
+    alignas(32) std::array<float, 64 * granul_block_size> procbuf;
+    std::fill(procbuf.begin(), procbuf.end(), 0.0f);
+    // run past the ambisonic order change fade and let the voice pool fill up before measuring
+    int warmupframes = samplerate * 1.0;
+    for (int i = 0; i < warmupframes; i += granul_block_size)
+        gran->process_block(procbuf);
+
+    using clock = std::chrono::steady_clock;
+    using ns = std::chrono::duration<double, std::nano>;
+    BenchResult result;
+    int64_t frames = samplerate * seconds;
+    int64_t voicesum = 0;
+    int64_t numblocks = 0;
+    gran->missedgrains = 0;
+    const auto start_time = clock::now();
+    for (int64_t i = 0; i < frames; i += granul_block_size)
+    {
+        gran->process_block(procbuf);
+        int used = gran->numVoicesUsed.load(std::memory_order_relaxed);
+        voicesum += used;
+        result.max_voices = std::max(result.max_voices, used);
+        ++numblocks;
+    }
+    const ns elapsed = clock::now() - start_time;
+    result.frames = numblocks * granul_block_size;
+    result.ns_per_frame = elapsed.count() / result.frames;
+    result.realtime_factor = (result.frames / samplerate * 1000000000.0) / elapsed.count();
+    result.avg_voices = (double)voicesum / numblocks;
+    result.missed_grains = gran->missedgrains;
+    return result;
+}
+
+// one axis at a time is varied around the base scenario, a full cartesian product
+// would take far too long to run to be useful
+inline std::vector<BenchScenario> make_scenarios()
+{
+    std::vector<BenchScenario> result;
+    BenchScenario base;
+    base.name = "base";
+    base.insert = GrainInsertFX::ModeInfo{"-None-", ""};
+    result.push_back(base);
+    for (float density : {2.0f, 6.0f, 8.0f})
+    {
+        auto sc = base;
+        sc.name = std::format("density_{}", density);
+        sc.density = density;
+        result.push_back(sc);
+    }
+    for (int stack : {4, 16})
+    {
+        auto sc = base;
+        sc.name = std::format("stack_{}", stack);
+        sc.stackcount = stack;
+        result.push_back(sc);
+    }
+    for (int order = 1; order <= maxAmbiSonicOrder; ++order)
+    {
+        auto sc = base;
+        sc.name = std::format("ambiorder_{}", order);
+        sc.ambiorder = order;
+        result.push_back(sc);
+    }
+    for (int osc = 0; osc < (int)std::size(osc_infos); ++osc)
+    {
+        auto sc = base;
+        sc.name = std::format("osc_{}", osc_infos[osc].name);
+        sc.osctype = osc;
+        result.push_back(sc);
+    }
+    std::set<std::string> sstgroups;
+    for (auto &mode : GrainInsertFX::getAvailableModes())
+    {
+        bool use = false;
+        if (mode.mainmode == GrainInsertFX::GFXSSTFILTER && sstgroups.size() < 3 &&
+            !sstgroups.contains(mode.groupname))
+        {
+            sstgroups.insert(mode.groupname);
+            use = true;
+        }
+        if (mode.mainmode == GrainInsertFX::GFXAIRWINDOWS ||
+            mode.mainmode == GrainInsertFX::GFXXENAKIOS)
+            use = true;
+        if (use)
+        {
+            auto sc = base;
+            sc.name = std::format("insert_{}", mode.displayname);
+            sc.insert = mode;
+            result.push_back(sc);
+        }
+    }
+    for (int voices : {8, 32, 64})
+    {
+        auto sc = base;
+        sc.name = std::format("eventlist_voices_{}", voices);
+        sc.eventlistvoices = voices;
+        result.push_back(sc);
+    }
+    // roughly the worst case for the plugin
+    auto heavy = base;
+    heavy.name = "heavy_order7_stack16";
+    heavy.ambiorder = maxAmbiSonicOrder;
+    heavy.stackcount = 16;
+    heavy.density = 6.0f;
+    heavy.duration = 0.5f;
+    result.push_back(heavy);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    std::string outfile = "granulator_bench.json";
+    double seconds = 10.0;
+    std::string filter;
+    if (argc >= 2)
+        outfile = argv[1];
+    if (argc >= 3)
+        seconds = std::clamp(std::atof(argv[2]), 0.5, 600.0);
+    if (argc >= 4)
+        filter = argv[3];
+    const double sr = 48000.0;
+    init_filter_infos();
+    auto scenarios = make_scenarios();
+    auto jresults = choc::value::createEmptyArray();
+    std::print("{:<40} {:>10} {:>10} {:>8} {:>8} {:>8}\n", "scenario", "ns/frame", "rt factor",
+               "avg vc", "max vc", "missed");
+    for (auto &sc : scenarios)
+    {
+        if (!filter.empty() && sc.name.find(filter) == std::string::npos)
+            continue;
+        auto r = run_scenario(sc, sr, seconds);
+        std::print("{:<40} {:>10.1f} {:>10.2f} {:>8.1f} {:>8} {:>8}\n", sc.name, r.ns_per_frame,
+                   r.realtime_factor, r.avg_voices, r.max_voices, r.missed_grains);
+        auto ob = choc::value::createObject("scenario");
+        ob.setMember("name", sc.name);
+        ob.setMember("eventlistvoices", sc.eventlistvoices);
+        ob.setMember("density", sc.density);
+        ob.setMember("duration", sc.duration);
+        ob.setMember("stackcount", sc.stackcount);
+        ob.setMember("ambiorder", sc.ambiorder);
+        ob.setMember("osctype", sc.osctype);
+        ob.setMember("insert", sc.insert.displayname);
+        ob.setMember("frames", r.frames);
+        ob.setMember("ns_per_frame", r.ns_per_frame);
+        ob.setMember("realtime_factor", r.realtime_factor);
+        ob.setMember("avg_voices", r.avg_voices);
+        ob.setMember("max_voices", r.max_voices);
+        ob.setMember("missed_grains", r.missed_grains);
+        jresults.addArrayElement(ob);
+    }
+    auto root = choc::value::createObject("granulatorbench");
+    root.setMember("samplerate", sr);
+    root.setMember("seconds_per_scenario", seconds);
+    root.setMember("block_size", granul_block_size);
+    root.setMember("results", jresults);
+    try
+    {
+        choc::file::replaceFileWithContent(outfile, choc::json::toString(root, true));
+        std::print("wrote results to {}\n", outfile);
+    }
+    catch (std::exception &ex)
+    {
+        std::print("could not write results : {}\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
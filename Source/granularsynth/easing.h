@@ -179,7 +179,13 @@ struct EasingLUTS
             data[i][LUTSize] = data[i][LUTSize - 1];
         }
     }
-    template <bool ClampInput> float getValueLERP(size_t funcindex, float x)
+    // the tables are read only after construction, so all users can share one instance
+    static const EasingLUTS &getShared()
+    {
+        static const EasingLUTS luts;
+        return luts;
+    }
+    template <bool ClampInput> float getValueLERP(size_t funcindex, float x) const
     {
         if constexpr (ClampInput)
             x = std::clamp(x, 0.0f, 1.0f);
@@ -4,6 +4,7 @@
 #include "text/choc_StringUtilities.h"
 #include "airwin_consolidated_base.h"
 #include "xenfxbase.h"
+#include <mutex>
 // #include <print>
 
 namespace sfpp = sst::filtersplusplus;
@@ -17,54 +18,56 @@ struct FilterInfo
 
 inline std::vector<FilterInfo> g_filter_infos;
 
-static void init_filter_infos()
+// ToneGranulator constructors call this, possibly from several threads at once
+inline void init_filter_infos()
 {
-    if (g_filter_infos.size() > 0)
-        return;
-    g_filter_infos.reserve(256);
-    auto models = sfpp::Filter::availableModels();
-    std::string address;
-    address.reserve(256);
-    FilterInfo ninfo;
-    ninfo.address = "none";
-    ninfo.model = sst::filtersplusplus::FilterModel::None;
-    ninfo.modelconfig = {};
-    g_filter_infos.push_back(ninfo);
-    for (auto &mod : models)
-    {
-        auto subm = sfpp::Filter::availableModelConfigurations(mod, true);
-        for (auto s : subm)
+    static std::once_flag once;
+    std::call_once(once, []() {
+        g_filter_infos.reserve(256);
+        auto models = sfpp::Filter::availableModels();
+        std::string address;
+        address.reserve(256);
+        FilterInfo ninfo;
+        ninfo.address = "none";
+        ninfo.model = sst::filtersplusplus::FilterModel::None;
+        ninfo.modelconfig = {};
+        g_filter_infos.push_back(ninfo);
+        for (auto &mod : models)
         {
-            address = sfpp::toString(mod);
-            if (s == sfpp::ModelConfig())
-            {
-            }
-            auto [pt, st, dt, smt] = s;
-            if (pt != sfpp::Passband::UNSUPPORTED)
-            {
-                address += "/" + sfpp::toString(pt);
-            }
-            if (st != sfpp::Slope::UNSUPPORTED)
+            auto subm = sfpp::Filter::availableModelConfigurations(mod, true);
+            for (auto s : subm)
             {
-                address += "/" + sfpp::toString(st);
+                address = sfpp::toString(mod);
+                if (s == sfpp::ModelConfig())
+                {
+                }
+                auto [pt, st, dt, smt] = s;
+                if (pt != sfpp::Passband::UNSUPPORTED)
+                {
+                    address += "/" + sfpp::toString(pt);
+                }
+                if (st != sfpp::Slope::UNSUPPORTED)
+                {
+                    address += "/" + sfpp::toString(st);
+                }
+                if (dt != sfpp::DriveMode::UNSUPPORTED)
+                {
+                    address += "/" + sfpp::toString(dt);
+                }
+                if (smt != sfpp::FilterSubModel::UNSUPPORTED)
+                {
+                    address += "/" + sfpp::toString(smt);
+                }
+                address = choc::text::toLowerCase(address);
+                address = choc::text::replace(address, " ", "_", "&", "and", ",", "");
+                FilterInfo info;
+                info.address = address;
+                info.model = mod;
+                info.modelconfig = s;
+                g_filter_infos.push_back(info);
             }
-            if (dt != sfpp::DriveMode::UNSUPPORTED)
-            {
-                address += "/" + sfpp::toString(dt);
-            }
-            if (smt != sfpp::FilterSubModel::UNSUPPORTED)
-            {
-                address += "/" + sfpp::toString(smt);
-            }
-            address = choc::text::toLowerCase(address);
-            address = choc::text::replace(address, " ", "_", "&", "and", ",", "");
-            FilterInfo info;
-            info.address = address;
-            info.model = mod;
-            info.modelconfig = s;
-            g_filter_infos.push_back(info);
         }
-    }
+    });
 }
 
 // Chris has sometimes forgot to initialize variables, so with this we will get at least
@@ -8,6 +8,8 @@
 #include "text/choc_StringUtilities.h"
 #include "text/choc_Files.h"
 #include <variant>
+#include <functional>
+#include <fstream>
 #include "../Common/xen_ambisonics.h"
 #include "../Common/xap_utils.h"
 #include "grainoscillators.h"
@@ -497,7 +499,7 @@ class GranulatorVoice
     float tail_fade_len = 0.005;
     float polarity_gain = 1.0f;
     int prior_osc_type = -1;
-    EasingLUTS *eluts = nullptr;
+    const EasingLUTS *eluts = nullptr;
     std::span<int> osctypemapping;
     // 2x up to 7th order Ambisonics
     alignas(32) std::array<float, 128> ambcoeffs;
@@ -580,7 +582,7 @@ class GranulatorVoice
         }
         */
     }
-    void start(GrainEvent &evpars)
+    void start(const GrainEvent &evpars)
     {
         active = true;
         int newosctype = std::clamp(evpars.generator_type, 0, 6);
@@ -969,6 +971,147 @@ class GranulatorVoice
 
 using events_t = std::vector<GrainEvent>;
 
+// Supplies grain events to ToneGranulator in time order, as an alternative to passing in an
+// events_t. Used from the audio thread, so peek/advance shouldn't block or allocate.
+struct GrainEventSource
+{
+    virtual ~GrainEventSource() = default;
+    // the current event or nullptr when there are no more events, valid until advance is called
+    virtual const GrainEvent *peek() = 0;
+    virtual void advance() = 0;
+};
+
+// Plays back events stored elsewhere, like in a NumPy structured array, in the order given by
+// an index table. The events themselves are not copied or sorted, so they must stay alive and
+// unchanged while the source is in use.
+class IndexedGrainEventSource : public GrainEventSource
+{
+  public:
+    IndexedGrainEventSource(const GrainEvent *events, size_t num_events)
+        : m_events(events)
+    {
+        m_order.reserve(num_events);
+        for (size_t i = 0; i < num_events; ++i)
+        {
+            const auto &e = events[i];
+            if (e.time_position < 0.0)
+                continue;
+            m_order.push_back(i);
+            m_end_time = std::max(m_end_time, e.time_position + e.duration);
+        }
+        auto cmp = [events](uint32_t lhs, uint32_t rhs) {
+            return events[lhs].time_position < events[rhs].time_position;
+        };
+        // scores are often generated in time order already
+        if (!std::is_sorted(m_order.begin(), m_order.end(), cmp))
+            std::stable_sort(m_order.begin(), m_order.end(), cmp);
+    }
+    const GrainEvent *peek() override
+    {
+        return m_pos < m_order.size() ? &m_events[m_order[m_pos]] : nullptr;
+    }
+    void advance() override { ++m_pos; }
+    size_t size() const { return m_order.size(); }
+    double get_end_time() const { return m_end_time; }
+
+  private:
+    const GrainEvent *m_events = nullptr;
+    std::vector<uint32_t> m_order;
+    size_t m_pos = 0;
+    double m_end_time = 0.0;
+};
+
+// Pulls the events from a function a chunk at a time, so arbitrarily long scores can be played
+// with memory proportional to the lookahead only. The events only need to be roughly in time
+// order: the lookahead is kept as a min-heap, so events arriving within lookahead events of
+// their place are reordered, but an event arriving later than that is started late. The pull
+// function is called from the thread processing the granulator, so this is meant for offline
+// rendering, or for pull functions that are themselves realtime safe.
+class StreamingGrainEventSource : public GrainEventSource
+{
+  public:
+    // writes at most max_events events into dest and returns how many it wrote, 0 when finished
+    using PullFunc = std::function<size_t(GrainEvent *dest, size_t max_events)>;
+    StreamingGrainEventSource(PullFunc pull, size_t lookahead = 4096, size_t chunk_size = 1024)
+        : m_pull(std::move(pull)), m_chunk_size(std::max<size_t>(chunk_size, 1)),
+          m_lookahead(std::max(lookahead, m_chunk_size))
+    {
+        m_heap.reserve(m_lookahead);
+        m_chunk.resize(m_chunk_size);
+    }
+    const GrainEvent *peek() override
+    {
+        while (!m_pull_finished && m_heap.size() + m_chunk_size <= m_lookahead)
+            pull_chunk();
+        return m_heap.empty() ? nullptr : &m_heap.front();
+    }
+    void advance() override
+    {
+        if (m_heap.empty())
+            return;
+        std::pop_heap(m_heap.begin(), m_heap.end(), later_first);
+        m_heap.pop_back();
+    }
+    // true when the pull function has finished and all its events have been played
+    bool finished() const { return m_pull_finished && m_heap.empty(); }
+    // end time of the latest ending event pulled so far
+    double get_end_time() const { return m_end_time; }
+    size_t get_num_pulled() const { return m_num_pulled; }
+
+    // reads raw GrainEvent records, like a grain_event_dtype NumPy array saved with tofile
+    static PullFunc pull_from_raw_file(std::string path)
+    {
+        auto is = std::make_shared<std::ifstream>(path, std::ios::binary);
+        if (!is->is_open())
+            throw std::runtime_error(std::format("could not open grain event file {}", path));
+        is->seekg(0, std::ios::end);
+        auto filesize = (size_t)is->tellg();
+        is->seekg(0);
+        if (filesize % sizeof(GrainEvent) != 0)
+            throw std::runtime_error(
+                std::format("grain event file {} size {} is not a multiple of the record size {}",
+                            path, filesize, sizeof(GrainEvent)));
+        return [is](GrainEvent *dest, size_t max_events) -> size_t {
+            is->read((char *)dest, max_events * sizeof(GrainEvent));
+            return is->gcount() / sizeof(GrainEvent);
+        };
+    }
+
+  private:
+    static bool later_first(const GrainEvent &lhs, const GrainEvent &rhs)
+    {
+        return lhs.time_position > rhs.time_position;
+    }
+    void pull_chunk()
+    {
+        size_t count = m_pull(m_chunk.data(), m_chunk_size);
+        if (count == 0)
+        {
+            m_pull_finished = true;
+            return;
+        }
+        count = std::min(count, m_chunk_size);
+        m_num_pulled += count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto &e = m_chunk[i];
+            if (e.time_position < 0.0)
+                continue;
+            m_end_time = std::max(m_end_time, e.time_position + e.duration);
+            m_heap.push_back(e);
+            std::push_heap(m_heap.begin(), m_heap.end(), later_first);
+        }
+    }
+    PullFunc m_pull;
+    size_t m_chunk_size = 0;
+    size_t m_lookahead = 0;
+    std::vector<GrainEvent> m_heap;
+    std::vector<GrainEvent> m_chunk;
+    bool m_pull_finished = false;
+    double m_end_time = 0.0;
+    size_t m_num_pulled = 0;
+};
+
 class MidiNoteModSource
 {
   public:
@@ -1209,12 +1352,15 @@ class ToneGranulator
     std::vector<std::unique_ptr<GranulatorVoice>> voices;
     events_t events;
     events_t events_to_switch;
+    // when set, used instead of the events
+    std::unique_ptr<GrainEventSource> event_source;
+    std::unique_ptr<GrainEventSource> event_source_to_switch;
     events_t scheduledGrains;
     alignas(16) int scheduledIndex = 0;
     std::atomic<int> thread_op{0};
 
     int evindex = 0;
-    int playposframes = 0;
+    int64_t playposframes = 0;
     int num_out_chans = 0;
     int missedgrains = 0;
     alignas(16) double graingen_phase = 0.0;
@@ -1231,23 +1377,103 @@ class ToneGranulator
     std::unordered_map<uint32_t, float> modRanges;
     std::unordered_map<int, int> shapeParToActualShape;
     choc::fifo::SingleReaderSingleWriterFIFO<StepModSource::Message> fifo;
-    struct GrainVisualizerMessage
+    // Grains started during a fixed length time slice are aggregated into pitch and
+    // azimuth/elevation bins, so the cost for the GUI doesn't depend on the grain density.
+    struct GrainVisualizerFrame
     {
+        static constexpr int numPitchBins = 56;
+        static constexpr float minPitch = -48.0f;
+        static constexpr float maxPitch = 64.0f;
+        static constexpr int numAzimuthBins = 36;
+        static constexpr int numElevationBins = 6;
+        // index of the first time slice in the frame. A frame covers several slices when the
+        // GUI didn't fetch the previous frame in time.
+        uint64_t sequence = 0;
+        int numslices = 1;
         double timepos = 0.0;
-        float pitch = 0.0;
-        float duration = 0.001;
-        float gain = 0.0f;
-        float azimuth0degrees = 0.0f;
-        float azimuth1degrees = 0.0f;
-        float elevationdegrees = 0.0f;
-        float visualfade = 1.0f;
+        double timespan = 0.0;
+        int numgrains = 0;
+        alignas(16) std::array<float, numPitchBins> pitchgains{};
+        alignas(16) std::array<float, numPitchBins> pitchdurations{};
+        alignas(16) std::array<float, numAzimuthBins * numElevationBins> spatialgains{};
+        void clear()
+        {
+            numgrains = 0;
+            pitchgains.fill(0.0f);
+            pitchdurations.fill(0.0f);
+            spatialgains.fill(0.0f);
+        }
+        static int pitch_to_bin(float pitch)
+        {
+            int bin = (pitch - minPitch) / (maxPitch - minPitch) * numPitchBins;
+            return std::clamp(bin, 0, numPitchBins - 1);
+        }
+        static int spatial_to_bin(float azimuthdegrees, float elevationdegrees)
+        {
+            float azi = std::fmod(azimuthdegrees + 180.0f, 360.0f);
+            if (azi < 0.0f)
+                azi += 360.0f;
+            int azibin = std::clamp<int>(azi / 360.0f * numAzimuthBins, 0, numAzimuthBins - 1);
+            int elebin = std::clamp<int>((elevationdegrees + 90.0f) / 180.0f * numElevationBins,
+                                         0, numElevationBins - 1);
+            return elebin * numAzimuthBins + azibin;
+        }
+        void add_grain(float pitch, float duration, float gain, float azimuth0, float azimuth1,
+                       float elevation)
+        {
+            ++numgrains;
+            int pbin = pitch_to_bin(pitch);
+            pitchgains[pbin] += gain;
+            pitchdurations[pbin] = std::max(pitchdurations[pbin], duration);
+            spatialgains[spatial_to_bin(azimuth0, elevation)] += gain;
+            if (azimuth1 != azimuth0)
+                spatialgains[spatial_to_bin(azimuth1, elevation)] += gain;
+        }
     };
     struct GrainVisualizerSettings
     {
         double timespantoshow = 8.0;
     };
     GrainVisualizerSettings gvsettings;
-    choc::fifo::SingleReaderSingleWriterFIFO<GrainVisualizerMessage> visualizer_fifo;
+    TripleBuffer<GrainVisualizerFrame> visualizer_frames;
+    uint64_t visualizer_sequence = 0;
+    int visualizer_slice_pos = 0;
+    int visualizer_slice_len = 1024;
+    void add_grain_to_visualizer(const GranulatorVoice &v, const GrainEvent &ev)
+    {
+        visualizer_frames.getWriteBuffer().add_grain(v.pitch_base, v.grain_end_phase / m_sr,
+                                                     v.graingain, v.used_azi0, v.used_azi1,
+                                                     ev.elevation);
+    }
+    void start_visualizer_frame()
+    {
+        auto &frame = visualizer_frames.getWriteBuffer();
+        frame.clear();
+        frame.sequence = visualizer_sequence++;
+        frame.numslices = 1;
+        frame.timepos = playposframes / m_sr;
+        frame.timespan = visualizer_slice_len / m_sr;
+        visualizer_slice_pos = 0;
+    }
+    void advance_visualizer(int frames)
+    {
+        visualizer_slice_pos += frames;
+        if (visualizer_slice_pos < visualizer_slice_len)
+            return;
+        if (visualizer_frames.isPublishedFetched())
+        {
+            visualizer_frames.publish();
+            start_visualizer_frame();
+            return;
+        }
+        // the GUI hasn't taken the previous frame yet, so the grains of the next slice are added
+        // into this one instead of being lost
+        auto &frame = visualizer_frames.getWriteBuffer();
+        ++frame.numslices;
+        ++visualizer_sequence;
+        frame.timespan += visualizer_slice_len / m_sr;
+        visualizer_slice_pos = 0;
+    }
 
     enum PARAMS
     {
@@ -1490,7 +1716,6 @@ class ToneGranulator
     }
     ToneGranulator() : m_sr(44100.0), modmatrix(44100.0)
     {
-        visualizer_fifo.reset(2048);
 
         shapeParToActualShape[0] = GranulatorModMatrix::lfo_t::SINE;
         shapeParToActualShape[1] = GranulatorModMatrix::lfo_t::PULSE;
@@ -1951,7 +2176,7 @@ class ToneGranulator
     std::array<size_t, 2> insertsAWTypes = {0, 0};
     std::array<sfpp::FilterModel, 2> filtersModels{sfpp::FilterModel(), sfpp::FilterModel()};
     std::array<sfpp::ModelConfig, 2> filtersConfigs{sfpp::ModelConfig(), sfpp::ModelConfig()};
-    alignas(32) EasingLUTS eluts;
+    const EasingLUTS &eluts = EasingLUTS::getShared();
     void set_filter(int which, uint8_t mainmode, uint8_t awtype, sfpp::FilterModel mo,
                     sfpp::ModelConfig conf)
     {
@@ -2002,17 +2227,44 @@ class ToneGranulator
             std::print("prepare called while audio thread should do state switch!\n");
         }
         missedgrains = 0;
-        if (evlist.size() > 0)
+        events_to_switch = std::move(evlist);
+        event_source_to_switch.reset();
+        if (events_to_switch.size() > 0)
         {
-            events_to_switch = std::move(evlist);
             std::sort(events_to_switch.begin(), events_to_switch.end(),
                       [](GrainEvent &lhs, GrainEvent &rhs) {
                           return lhs.time_position < rhs.time_position;
                       });
-            std::erase_if(events_to_switch, [](GrainEvent &e) {
-                return e.time_position < 0.0 || (e.time_position + e.duration) > 120.0;
-            });
+            std::erase_if(events_to_switch,
+                          [](GrainEvent &e) { return e.time_position < 0.0; });
         }
+        prepare_voices(samplerate, filter_routing, tail_len, tail_fade_len);
+    }
+
+    // plays the events from the source instead of an events_t
+    void prepare(float samplerate, std::unique_ptr<GrainEventSource> source, int filter_routing,
+                 float tail_len, float tail_fade_len)
+    {
+        if (thread_op == 1)
+        {
+            std::print("prepare called while audio thread should do state switch!\n");
+        }
+        missedgrains = 0;
+        events_to_switch.clear();
+        event_source_to_switch = std::move(source);
+        prepare_voices(samplerate, filter_routing, tail_len, tail_fade_len);
+    }
+
+    // drops the event sources, for when the data they refer to is going away. only call while
+    // the granulator isn't being processed.
+    void release_event_sources()
+    {
+        event_source.reset();
+        event_source_to_switch.reset();
+    }
+
+    void prepare_voices(float samplerate, int filter_routing, float tail_len, float tail_fade_len)
+    {
         for (int i = 0; i < numvoices; ++i)
         {
             auto &v = voices[i];
@@ -2237,6 +2489,7 @@ class ToneGranulator
         if (thread_op == 1)
         {
             std::swap(events_to_switch, events);
+            std::swap(event_source_to_switch, event_source);
             evindex = 0;
             playposframes = 0;
             m_sr = next_samplerate;
@@ -2248,6 +2501,10 @@ class ToneGranulator
             gainlag.snapTo(0.0);
             graingen_phase = 0.0;
             graingen_phase_prior = 2.0;
+            // about 50 visualizer frames per second, so the GUI should normally see all of them
+            visualizer_slice_len = (int)(m_sr / 50.0) / granul_block_size * granul_block_size;
+            visualizer_slice_len = std::max<int>(visualizer_slice_len, granul_block_size);
+            start_visualizer_frame();
             thread_op = 0;
         }
 
@@ -2264,7 +2521,7 @@ class ToneGranulator
 
         handleStepSequencerMessages();
         bool self_generate = false;
-        if (events.size() == 0)
+        if (events.size() == 0 && !event_source)
             self_generate = true;
         bool doambcoeffsnormalization = *idtoparvalptr[PAR_AMBUSENORMALIZATION];
         int bufframecount = 0;
@@ -2303,9 +2560,15 @@ class ToneGranulator
             ambiofadebuf[i] = fadeForLargeStateChange.step();
         if (!self_generate)
         {
-            GrainEvent *ev = nullptr;
-            if (evindex < events.size())
-                ev = &events[evindex];
+            const GrainEvent *ev = nullptr;
+            auto next_event = [this]() -> const GrainEvent * {
+                if (event_source)
+                    return event_source->peek();
+                if (evindex < events.size())
+                    return &events[evindex];
+                return nullptr;
+            };
+            ev = next_event();
             while (ev && std::floor(ev->time_position * m_sr) < playposframes + granul_block_size)
             {
                 bool wasfound = false;
@@ -2316,6 +2579,7 @@ class ToneGranulator
                         // std::print("starting voice {} for event {}\n", j, evindex);
                         voices[j]->grainid = graincount;
                         voices[j]->start(*ev);
+                        add_grain_to_visualizer(*voices[j], *ev);
                         wasfound = true;
                         ++graincount;
                         break;
@@ -2325,11 +2589,11 @@ class ToneGranulator
                 {
                     ++missedgrains;
                 }
-                ++evindex;
-                if (evindex >= events.size())
-                    ev = nullptr;
+                if (event_source)
+                    event_source->advance();
                 else
-                    ev = &events[evindex];
+                    ++evindex;
+                ev = next_event();
             }
         }
         else
@@ -2356,15 +2620,7 @@ class ToneGranulator
                         voices[j]->tail_fade_len = std::clamp(taillen * 0.5, 0.002, 1.0);
                         voices[j]->start(*ev);
                         voicewasfound = true;
-                        GrainVisualizerMessage vmsg;
-                        vmsg.timepos = ev->time_position;
-                        vmsg.pitch = voices[j]->pitch_base;
-                        vmsg.duration = voices[j]->grain_end_phase / m_sr;
-                        vmsg.gain = voices[j]->graingain;
-                        vmsg.azimuth0degrees = voices[j]->used_azi0;
-                        vmsg.azimuth1degrees = voices[j]->used_azi1;
-                        vmsg.elevationdegrees = ev->elevation;
-                        visualizer_fifo.push(vmsg);
+                        add_grain_to_visualizer(*voices[j], *ev);
                         ++graincount;
                         break;
                     }
@@ -2458,6 +2714,7 @@ class ToneGranulator
         compensationgainforgui = gainlag.getValue();
 
         playposframes += granul_block_size;
+        advance_visualizer(granul_block_size);
 
         int voicesused = 0;
         for (auto &v : voices)
@@ -164,6 +164,10 @@ MainPageComponent::MainPageComponent(AudioPluginAudioProcessor &p)
             recordButton->setButtonText("Record");
     };
     mainParamsComponent.addHeaderComponent(recordButton.get());
+    decoderButton = std::make_unique<juce::TextButton>();
+    decoderButton->setButtonText("Decoder");
+    decoderButton->onClick = [this]() { showDecoderMenu(); };
+    mainParamsComponent.addHeaderComponent(decoderButton.get());
     mainParamsComponent.addHeaderComponent(perfcomp.get());
     addAndMakeVisible(infoLabel);
 
@@ -486,6 +490,47 @@ void MainPageComponent::showFilterMenu(int whichfilter)
     menu.showMenuAsync(juce::PopupMenu::Options{});
 }
 
+void MainPageComponent::setDecoder(std::string spec)
+{
+    try
+    {
+        processorRef.setDecoder(spec);
+        processorRef.setStateDirtyHack();
+    }
+    catch (std::exception &ex)
+    {
+        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon,
+                                               "Ambisonic decoder", ex.what());
+    }
+}
+
+void MainPageComponent::showDecoderMenu()
+{
+    auto current = processorRef.getDecoderSpec();
+    auto presets = xenakios::AmbisonicDecoder::getPresetNames();
+    juce::PopupMenu menu;
+    menu.addItem("Default", true, current.empty(), [this]() { setDecoder(""); });
+    menu.addSectionHeader("Presets");
+    for (auto &name : presets)
+        menu.addItem(name, true, current == name, [this, name]() { setDecoder(name); });
+    menu.addSeparator();
+    // a decoder loaded from a file is shown ticked above the file loading item
+    if (!current.empty() && std::find(presets.begin(), presets.end(), current) == presets.end())
+        menu.addItem(juce::File(current).getFileName(), false, true, []() {});
+    menu.addItem("Load decoder file...", [this]() {
+        decoderFileChooser = std::make_unique<juce::FileChooser>("Ambisonic decoder file",
+                                                                 juce::File(), "*.json");
+        decoderFileChooser->launchAsync(juce::FileBrowserComponent::openMode |
+                                            juce::FileBrowserComponent::canSelectFiles,
+                                        [this](const juce::FileChooser &chooser) {
+                                            auto file = chooser.getResult();
+                                            if (file != juce::File())
+                                                setDecoder(file.getFullPathName().toStdString());
+                                        });
+    });
+    menu.showMenuAsync(juce::PopupMenu::Options{}.withTargetComponent(decoderButton.get()));
+}
+
 void MainPageComponent::paint(juce::Graphics &g) { g.fillAll(juce::Colours::darkgrey); }
 
 void MainPageComponent::resized()
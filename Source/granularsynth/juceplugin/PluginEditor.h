@@ -876,8 +876,12 @@ class MainPageComponent final : public juce::Component
 
     std::unique_ptr<PerformanceComponent> perfcomp;
     std::unique_ptr<juce::TextButton> recordButton;
+    std::unique_ptr<juce::TextButton> decoderButton;
+    std::unique_ptr<juce::FileChooser> decoderFileChooser;
 
     void showFilterMenu(int whichfilter);
+    void showDecoderMenu();
+    void setDecoder(std::string spec);
     void updateInsertParameterMetaDatas();
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainPageComponent)
 };
@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "../../Common/xen_rtcheck.h"
 // #include "Tunings.h"
 
 // .withInput("Input", juce::AudioChannelSet::stereo(), true)
@@ -37,6 +38,8 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
     directMidiMappings[24] = ToneGranulator::PAR_AZIMUTH;
     sliceThread.startThread();
     buffer_adapter.reset(1024);
+    stereoDecoder = xenakios::AmbisonicDecoder::makePreset("stereo_ms");
+    decodeInputBuffer.resize(ambisonicOrderNumChannels(maxAmbiSonicOrder) * decodeChunkSize);
     from_gui_fifo.reset(1024);
     params_from_gui_fifo.reset(2048);
     params_to_gui_fifo.reset(2048);
@@ -252,11 +255,19 @@ void AudioPluginAudioProcessor::setStateDirtyHack()
 void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
                                              juce::MidiBuffer &midiMessages)
 {
+    XEN_RTCHECK_AUDIO_SCOPE;
     juce::AudioProcessLoadMeasurer::ScopedTimer perftimer(perfMeasurer, buffer.getNumSamples());
     double cpu_bench_t0 = juce::Time::getMillisecondCounterHiRes();
 
     {
         std::lock_guard<choc::threading::SpinLock> locker(stateLock);
+        if (decoderChanged)
+        {
+            // the previous decoder is destroyed on the message thread by setDecoder
+            retiredDecoder = std::move(activeDecoder);
+            activeDecoder = std::move(pendingDecoder);
+            decoderChanged = false;
+        }
         if (!pendingState.isVoid())
         {
             double t0 = juce::Time::getMillisecondCounterHiRes();
@@ -436,48 +447,57 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
             buffer_adapter.push(adapter_block);
         }
     }
-    procnumoutchs = granulator.num_out_chans;
     buffer.clear();
     auto channelDatas = buffer.getArrayOfWritePointers();
     float *const *recordDatas = nullptr;
     if (recordBuffer.getNumChannels() > 0)
         recordDatas = recordBuffer.getArrayOfWritePointers();
     int granulnumoutchans = granulator.num_out_chans;
-    if (totalNumOutputChannels == 2)
+    bool sn3d = *granulator.idtoparvalptr[ToneGranulator::PAR_AMBUSENORMALIZATION] > 0.5f;
+    const xenakios::AmbisonicDecoder *decoder = activeDecoder.get();
+    if (!decoder && totalNumOutputChannels == 2)
+        decoder = stereoDecoder.get();
+    int numOutsToWrite =
+        std::min(totalNumOutputChannels, xenakios::AmbisonicDecoder::maxOutputChannels);
+    std::array<const float *, ambisonicOrderNumChannels(maxAmbiSonicOrder)> decodeInputs;
+    for (size_t i = 0; i < decodeInputs.size(); ++i)
+        decodeInputs[i] = decodeInputBuffer.data() + i * decodeChunkSize;
+    std::array<float *, xenakios::AmbisonicDecoder::maxOutputChannels> decodeOutputs;
+    for (int pos = 0; pos < buffer.getNumSamples(); pos += decodeChunkSize)
     {
-        const float midGain = 1.414f;
-        for (int j = 0; j < buffer.getNumSamples(); ++j)
+        int chunkLen = std::min(decodeChunkSize, buffer.getNumSamples() - pos);
+        for (int j = 0; j < chunkLen; ++j)
         {
             buffer_adapter.pop(adapter_block);
+            for (int k = 0; k < granulnumoutchans; ++k)
+                decodeInputBuffer[k * decodeChunkSize + j] = adapter_block[k];
             if (recordDatas)
             {
                 for (int k = 0; k < granulnumoutchans; ++k)
-                    recordDatas[k][j] = adapter_block[k];
+                    recordDatas[k][pos + j] = adapter_block[k];
             }
-
-            float m = adapter_block[0] * midGain;
-            float s = adapter_block[1];
-            channelDatas[0][j] = std::clamp((m + s) * 0.5f, -1.0f, 1.0f);
-            channelDatas[1][j] = std::clamp((m - s) * 0.5f, -1.0f, 1.0f);
         }
-        if (recordDatas && isRecording && threadedWriter)
+        if (decoder)
         {
-            threadedWriter->write(recordDatas, buffer.getNumSamples());
+            for (int i = 0; i < numOutsToWrite; ++i)
+                decodeOutputs[i] = channelDatas[i] + pos;
+            decoder->process(decodeInputs.data(), granulnumoutchans, sn3d, decodeOutputs.data(),
+                             numOutsToWrite, chunkLen);
+            for (int i = 0; i < numOutsToWrite; ++i)
+                juce::FloatVectorOperations::clip(decodeOutputs[i], decodeOutputs[i], -1.0f, 1.0f,
+                                                  chunkLen);
         }
-    }
-    if (totalNumOutputChannels >= procnumoutchs)
-    {
-        for (int j = 0; j < buffer.getNumSamples(); ++j)
+        else if (totalNumOutputChannels >= granulnumoutchans)
         {
-            buffer_adapter.pop(adapter_block);
-            for (int i = 0; i < procnumoutchs; ++i)
-            {
-                // float s = workBuffer[j * procnumoutchs + i];
-                float s = adapter_block[i];
-                channelDatas[i][j] = std::clamp(s, -1.0f, 1.0f);
-            }
+            for (int i = 0; i < granulnumoutchans; ++i)
+                juce::FloatVectorOperations::clip(channelDatas[i] + pos, decodeInputs[i], -1.0f,
+                                                  1.0f, chunkLen);
         }
     }
+    if (recordDatas && isRecording && threadedWriter)
+    {
+        threadedWriter->write(recordDatas, buffer.getNumSamples());
+    }
     jassert(buffer.getNumSamples() > 0);
     double cpu_bench_t1 = juce::Time::getMillisecondCounterHiRes();
     double elapsed_secs = (cpu_bench_t1 - cpu_bench_t0) / 1000.0;
@@ -511,6 +531,7 @@ choc::value::Value AudioPluginAudioProcessor::getState()
     }
     state.setMember("params", mainparams);
     state.setMember("gvs_timespan", granulator.gvsettings.timespantoshow);
+    state.setMember("decoder", getDecoderSpec());
     auto filterstates = choc::value::createEmptyArray();
     for (int i = 0; i < 2; ++i)
     {
@@ -712,6 +733,28 @@ void AudioPluginAudioProcessor::changeStateImpl(choc::value::ValueView state)
     }
 }
 
+void AudioPluginAudioProcessor::setDecoder(std::string spec)
+{
+    std::unique_ptr<xenakios::AmbisonicDecoder> decoder;
+    if (!spec.empty())
+        decoder = xenakios::AmbisonicDecoder::create(spec);
+    // these are destroyed here after the lock has been released
+    std::unique_ptr<xenakios::AmbisonicDecoder> retired;
+    std::unique_ptr<xenakios::AmbisonicDecoder> unused;
+    std::lock_guard<choc::threading::SpinLock> locker(stateLock);
+    retired = std::move(retiredDecoder);
+    unused = std::move(pendingDecoder);
+    pendingDecoder = std::move(decoder);
+    decoderChanged = true;
+    decoderSpec = spec;
+}
+
+std::string AudioPluginAudioProcessor::getDecoderSpec()
+{
+    std::lock_guard<choc::threading::SpinLock> locker(stateLock);
+    return decoderSpec;
+}
+
 void AudioPluginAudioProcessor::setState(choc::value::ValueView state)
 {
     std::lock_guard<choc::threading::SpinLock> locker(stateLock);
@@ -734,6 +777,15 @@ void AudioPluginAudioProcessor::setStateInformation(const void *data, int sizeIn
             return;
         choc::value::InputData idata{(const uint8_t *)data, (const uint8_t *)data + sizeInBytes};
         auto state = choc::value::Value::deserialise(idata);
+        // the decoder is built here instead of in changeStateImpl, which runs on the audio thread
+        try
+        {
+            setDecoder(std::string(state["decoder"].getWithDefault("")));
+        }
+        catch (std::exception &ex)
+        {
+            DBG("tonegranulator error creating ambisonic decoder : " << ex.what());
+        }
         setState(state.getView());
     }
     catch (std::exception &ex)
@@ -3,6 +3,7 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_audio_formats/juce_audio_formats.h>
 #include "../granularsynth.h"
+#include "../../Common/xen_ambidecoder.h"
 #include "containers/choc_SingleReaderSingleWriterFIFO.h"
 #include "threading/choc_SpinLock.h"
 
@@ -114,11 +115,29 @@ class AudioPluginAudioProcessor final : public juce::AudioProcessor
     void loadSnapShot(int index);
     void saveSnapShot(int index, choc::value::ValueView state);
 
+    // Sets the ambisonic decoder used for the output, a preset name or a decoder JSON file.
+    // An empty string restores the default, which is raw ambisonics or the mid/side stereo
+    // decode when the host has 2 outputs. Throws if the decoder can't be created.
+    // Call from the message thread.
+    void setDecoder(std::string spec);
+    std::string getDecoderSpec();
+    // makes the host notice that the state changed
+    void setStateDirtyHack();
+
   private:
     alignas(32) std::vector<float> workBuffer;
     alignas(32) choc::fifo::SingleReaderSingleWriterFIFO<
         std::array<float, ambisonicOrderNumChannels(maxAmbiSonicOrder)>> buffer_adapter;
-    void setStateDirtyHack();
+
+    std::string decoderSpec;
+    // owned by the audio thread, swapped in from pendingDecoder under stateLock
+    std::unique_ptr<xenakios::AmbisonicDecoder> activeDecoder;
+    std::unique_ptr<xenakios::AmbisonicDecoder> pendingDecoder;
+    std::unique_ptr<xenakios::AmbisonicDecoder> retiredDecoder;
+    bool decoderChanged = false;
+    std::unique_ptr<xenakios::AmbisonicDecoder> stereoDecoder;
+    static constexpr int decodeChunkSize = 256;
+    std::vector<float> decodeInputBuffer;
 
     std::unordered_map<juce::AudioProcessorParameter *, int> jucepartoindex;
     juce::AudioParameterFloat *dirtyStateParam = nullptr;
@@ -31,10 +31,101 @@ PolarPoint polar_project(float azi_deg, float ele_deg)
             ele_deg >= 0.0f};
 }
 
+// azimuth and elevation in degrees at the centre of a visualizer frame spatial bin
+std::pair<float, float> spatialBinCentre(int bin)
+{
+    using VisFrame = ToneGranulator::GrainVisualizerFrame;
+    int azibin = bin % VisFrame::numAzimuthBins;
+    int elebin = bin / VisFrame::numAzimuthBins;
+    float azimuth = -180.0f + (azibin + 0.5f) * 360.0f / VisFrame::numAzimuthBins;
+    float elevation = -90.0f + (elebin + 0.5f) * 180.0f / VisFrame::numElevationBins;
+    return {azimuth, elevation};
+}
+
+void DashBoardComponent::addFrameToCloudImage(const VisFrame &frame)
+{
+    // grains longer than a frame are drawn ahead into the columns of the following frames,
+    // so the columns are cleared well in advance before they are shown
+    const int maxdurationcolumns = 64;
+    // a frame that covers several time slices is drawn into a column for each of them
+    const uint64_t lastslice = frame.sequence + frame.numslices - 1;
+    uint64_t firstnew = frame.sequence;
+    if (hasReceivedFrames && lastslice > lastFrameSequence)
+        firstnew = lastFrameSequence + 1;
+    if (lastslice - firstnew >= cloudImageWidth)
+        firstnew = lastslice - cloudImageWidth + 1;
+    hasReceivedFrames = true;
+    lastFrameSequence = lastslice;
+    lastFrameTimespan = frame.timespan / frame.numslices;
+    juce::Image::BitmapData bm(cloudImage, juce::Image::BitmapData::readWrite);
+    for (uint64_t seq = firstnew; seq <= lastslice; ++seq)
+    {
+        int x = (seq + maxdurationcolumns + 1) % cloudImageWidth;
+        for (int y = 0; y < VisFrame::numPitchBins; ++y)
+            bm.setPixelColour(x, y, juce::Colours::transparentBlack);
+    }
+    const int numcolumns = std::min<int>(frame.numslices, cloudImageWidth - maxdurationcolumns);
+    const int x = (lastslice - numcolumns + 1) % cloudImageWidth;
+    for (int bin = 0; bin < VisFrame::numPitchBins; ++bin)
+    {
+        float gain = frame.pitchgains[bin];
+        if (gain <= 0.0f)
+            continue;
+        float brightness = std::clamp(gain, 0.0f, 1.0f);
+        float normpitch = (bin + 0.5f) / VisFrame::numPitchBins;
+        auto colour = pitchGradient.getColourAtPosition(normpitch).withBrightness(brightness);
+        int y = VisFrame::numPitchBins - 1 - bin;
+        int durcolumns = std::clamp<int>(frame.pitchdurations[bin] / lastFrameTimespan, 1,
+                                         maxdurationcolumns);
+        for (int i = 0; i < numcolumns - 1 + durcolumns; ++i)
+        {
+            int xx = (x + i) % cloudImageWidth;
+            if (bm.getPixelColour(xx, y).getBrightness() < brightness)
+                bm.setPixelColour(xx, y, colour);
+        }
+    }
+}
+
+juce::Rectangle<float> DashBoardComponent::getPolarArea() const
+{
+    return {35.0f, getHeight() / 2.0f - 200.0f, 400.0f, 400.0f};
+}
+
+juce::Rectangle<float> DashBoardComponent::getPolarBinBounds(int bin) const
+{
+    auto area = getPolarArea();
+    auto [azimuth, elevation] = spatialBinCentre(bin);
+    auto pt = polar_project(-azimuth, elevation);
+    float xcor = area.getCentreX() + pt.x * area.getWidth() / 2.0;
+    float ycor = area.getCentreY() + pt.y * area.getHeight() / 2.0;
+    float ptsize = juce::jmap(elevation, -90.0f, 90.0f, 5.0f, 15.0f);
+    return {xcor - ptsize / 2.0f, ycor - ptsize / 2.0f, ptsize, ptsize};
+}
+
+void DashBoardComponent::repaintDirtyAreas(const std::array<bool, numSpatialBins> &dirtybins)
+{
+    if (showModulatorValues)
+    {
+        repaint();
+        return;
+    }
+    // the cloud, the parameter scope and the CPU graph scroll with the engine time
+    repaint(getLocalBounds().withLeft(500));
+    for (int i = 0; i < numSpatialBins; ++i)
+        if (dirtybins[i])
+            repaint(getPolarBinBounds(i).expanded(1.0f).getSmallestIntegerContainer());
+    float gain = gr->compensationgainforgui.load();
+    if (gain != lastCompensationGain)
+    {
+        lastCompensationGain = gain;
+        repaint(0, 0, 10, getHeight());
+    }
+}
+
 void DashBoardComponent::paintAmbisonicFieldPolar(juce::Graphics &g)
 {
     g.setColour(juce::Colours::white);
-    juce::Rectangle<float> area{35.0f, getHeight() / 2.0f - 200.0f, 400.0f, 400.0f};
+    auto area = getPolarArea();
     g.drawEllipse(area, 2.0f);
     drawRotatedText(g, "LEFT", area.getX() - 10.f, area.getCentreY(), -90.0f);
     drawRotatedText(g, "RIGHT", area.getRight() + 10.0f, area.getCentreY(), 90.0f);
@@ -42,20 +133,17 @@ void DashBoardComponent::paintAmbisonicFieldPolar(juce::Graphics &g)
                juce::Justification::centredTop);
     g.drawText("BACK", area.getCentreX() - 20.0f, area.getBottom(), 40.0f, 20.0f,
                juce::Justification::centredBottom);
-    for (auto &e : persisted_events)
+    for (int i = 0; i < (int)spatialfades.size(); ++i)
     {
-        if (e.visualfade > 0.01)
+        float fade = spatialfades[i];
+        if (fade > visibleFade)
         {
-            auto pt = polar_project(-e.azimuth0degrees, e.elevationdegrees);
-            if (pt.front_hemisphere)
-                g.setColour(juce::Colours::cyan.withAlpha(e.visualfade));
+            auto [azimuth, elevation] = spatialBinCentre(i);
+            if (elevation >= 0.0f)
+                g.setColour(juce::Colours::cyan.withAlpha(fade));
             else
-                g.setColour(juce::Colours::green.withAlpha(e.visualfade));
-            float xcor = area.getCentreX() + pt.x * area.getWidth() / 2.0;
-            float ycor = area.getCentreY() + pt.y * area.getHeight() / 2.0;
-            float ptsize = juce::jmap(e.elevationdegrees, -90.0f, 90.0f, 5.0f, 15.0f);
-            g.fillEllipse(xcor - ptsize / 2.0, ycor - ptsize / 2.0, ptsize, ptsize);
-            e.visualfade *= visualfadecoefficient;
+                g.setColour(juce::Colours::green.withAlpha(fade));
+            g.fillEllipse(getPolarBinBounds(i));
         }
     }
 }
@@ -63,103 +151,22 @@ void DashBoardComponent::paintAmbisonicFieldPolar(juce::Graphics &g)
 void DashBoardComponent::paintAmbisonicFieldHammerProjection(juce::Graphics &g)
 {
     g.saveState();
-    for (auto &e : persisted_events)
+    for (int i = 0; i < (int)spatialfades.size(); ++i)
     {
-        if (e.visualfade > 0.01)
+        float fade = spatialfades[i];
+        if (fade > 0.01f)
         {
-            auto ptcor = haGrid.anglesToPoint(e.azimuth0degrees, -e.elevationdegrees);
+            auto [azimuth, elevation] = spatialBinCentre(i);
+            auto ptcor = haGrid.anglesToPoint(azimuth, -elevation);
             float x = ptcor.getX();
             float y = ptcor.getY();
             haGrid.toArea.transformPoint(x, y);
             y += getHeight() / 2.0 - haGrid.getHeight() / 2.0;
-            g.setColour(juce::Colours::cyan.withAlpha(e.visualfade));
-            e.visualfade *= visualfadecoefficient;
+            g.setColour(juce::Colours::cyan.withAlpha(fade));
             g.fillEllipse(x - 6.0, y - 6.0, 12.0f, 12.0f);
         }
     }
     g.restoreState();
-    return;
-    g.setColour(juce::Colours::white);
-    float ellipW = 400.0f;
-    float h = ellipW / 1.5;
-    float halfW = ellipW / 2.0f;
-    float halfH = h / 2.0;
-    float centerX = halfW;
-    float centerY = getHeight() / 2.0;
-    g.drawEllipse(0.0f, centerY - halfH, ellipW, h, 2.0f);
-    g.drawLine(centerX, centerY - halfH, centerX, centerY + halfH, 2.0f);
-    g.drawLine(centerX - halfW, centerY, centerX + halfW, centerY, 2.0f);
-    float lineX = centerX - halfW / 2.0f;
-    float dx = (lineX - centerX) / halfW;
-    float dy = halfH * std::sqrt(1.0f - dx * dx);
-    g.drawLine(lineX, centerY - dy, lineX, centerY + dy, 2.0f);
-    g.drawText("LEFT", juce::Rectangle<float>(lineX + 2.0f, centerY, 70.0f, 25.0f),
-               juce::Justification::centredLeft);
-    lineX = centerX + halfW / 2.0f;
-    g.drawLine(lineX, centerY - dy, lineX, centerY + dy, 2.0f);
-    g.drawText("RIGHT", juce::Rectangle<float>(lineX + 2.0f, centerY, 70.0f, 25.0f),
-               juce::Justification::centredLeft);
-
-    g.drawText("FRONT", juce::Rectangle<float>(centerX + 2.0, centerY, 70.0f, 25.0f),
-               juce::Justification::centredLeft);
-    g.drawText("BACK", juce::Rectangle<float>(centerX - halfW + 2.0, centerY, 70.0f, 25.0f),
-               juce::Justification::centredLeft);
-    g.drawText("BACK", juce::Rectangle<float>(centerX + halfW - 70.0, centerY, 70.0f, 25.0f),
-               juce::Justification::centredRight);
-    g.drawText("TOP", juce::Rectangle<float>(centerX - 20.0, centerY - halfH - 20.0f, 70.0f, 25.0f),
-               juce::Justification::centredTop);
-    g.drawText("BOTTOM", juce::Rectangle<float>(centerX - 20.0, centerY + halfH, 70.0f, 25.0f),
-               juce::Justification::centredBottom);
-    for (auto &e : persisted_events)
-    {
-        if (e.visualfade > 0.01)
-        {
-            auto drawgrain = [this, halfW, halfH, centerX, centerY, &g, &e](int chan) {
-                const float sqrt2 = 1.41421356f;
-                float radAzi = juce::degreesToRadians(-e.azimuth0degrees);
-                if (chan == 1)
-                    radAzi = juce::degreesToRadians(-e.azimuth1degrees);
-                float radElev = juce::degreesToRadians(e.elevationdegrees);
-                float cosElev = std::cos(radElev);
-                float cosHalfAzi = std::cos(radAzi * 0.5f);
-
-                // The term inside the sqrt can theoretically be slightly negative
-                // due to float precision errors at the very edge (180 deg).
-                float inner = 1.0f + cosElev * cosHalfAzi;
-                float d = std::sqrt(std::max(0.0f, inner));
-
-                // Safety: prevent division by zero at the singularity
-                if (d < 0.001f)
-                    d = 0.001f;
-
-                float x = (2.0f * sqrt2 * cosElev * std::sin(radAzi * 0.5f)) / d;
-                float y = (sqrt2 * std::sin(radElev)) / d;
-
-                // Mapping to your 2:1 Ellipse bounds
-                // This ensures that the dot stays perfectly within the visual ellipse
-                float scaleX = halfW / (2.0f * sqrt2);
-                float scaleY = halfH / sqrt2;
-
-                float pixelX = centerX + (x * scaleX);
-                float pixelY = centerY - (y * scaleY);
-                if (chan == 0)
-                    g.setColour(juce::Colours::lightgreen.withAlpha(e.visualfade));
-                else
-                    g.setColour(juce::Colours::lightcyan.withAlpha(e.visualfade));
-                g.fillEllipse(pixelX - 6.0f, pixelY - 6.0f, 12.0f, 12.0f);
-            };
-            if (std::abs(e.azimuth0degrees - e.azimuth1degrees) > 0.0f)
-            {
-                drawgrain(0);
-                drawgrain(1);
-            }
-            else
-            {
-                drawgrain(0);
-            }
-            e.visualfade = e.visualfade * visualfadecoefficient;
-        }
-    }
 }
 
 void DashBoardComponent::drawCPUGraph(juce::Graphics &g, double enginetime,
@@ -228,18 +235,25 @@ void DashBoardComponent::paint(juce::Graphics &g)
     double enginetime = gr->playposframes / gr->m_sr;
     g.saveState();
     g.reduceClipRegion(juce::Rectangle<int>(cloudArea.getX(), 0, getWidth(), getHeight()));
-    for (auto &e : persisted_events)
+    if (hasReceivedFrames)
     {
-        float alpha = juce::jmap<float>(e.gain, 0.0f, 1.0f, 0.0f, 1.0f);
-        float normpitch = juce::jmap<float>(e.pitch, -48.0f, 64.0f, 0.0f, 1.0f);
-        g.setColour(pitchGradient.getColourAtPosition(normpitch).withBrightness(alpha));
-        float xcor = cloudArea.getWidth() -
-                     ((enginetime - e.timepos) / timespantoshow * cloudArea.getWidth());
-        float ycor = juce::jmap<float>(e.pitch, -48.0, 64.0, cloudArea.getHeight() - 5.0, 0.0);
-        float gw = cloudArea.getWidth() / timespantoshow * e.duration;
-        // xcor = std::clamp<float>(xcor + xoffs, xoffs, getWidth());
-        xcor = xcor + cloudArea.getX();
-        g.fillEllipse(xcor, ycor, gw, 5.0);
+        // the cloud image is a ring buffer of frame columns, so it may need to be drawn in 2 parts
+        int numcolumns = std::clamp<int>(timespantoshow / lastFrameTimespan, 1,
+                                         cloudImageWidth - 66);
+        int lastcolumn = lastFrameSequence % cloudImageWidth;
+        int firstcolumn = (lastcolumn - numcolumns + 1 + cloudImageWidth) % cloudImageWidth;
+        int part0 = std::min(numcolumns, cloudImageWidth - firstcolumn);
+        float colw = cloudArea.getWidth() / numcolumns;
+        int imh = cloudImage.getHeight();
+        g.setImageResamplingQuality(juce::Graphics::lowResamplingQuality);
+        g.drawImage(cloudImage, cloudArea.getX(), cloudArea.getY(), part0 * colw,
+                    cloudArea.getHeight(), firstcolumn, 0, part0, imh);
+        if (part0 < numcolumns)
+        {
+            g.drawImage(cloudImage, cloudArea.getX() + part0 * colw, cloudArea.getY(),
+                        (numcolumns - part0) * colw, cloudArea.getHeight(), 0, 0,
+                        numcolumns - part0, imh);
+        }
     }
 
     paramHistoryPath.clear();
@@ -6,7 +6,18 @@ class DashBoardComponent : public juce::Component
 {
   public:
     ToneGranulator *gr = nullptr;
-    std::vector<ToneGranulator::GrainVisualizerMessage> persisted_events;
+    using VisFrame = ToneGranulator::GrainVisualizerFrame;
+    // one pixel column per visualizer time slice, used as a ring buffer
+    static constexpr int cloudImageWidth = 1024;
+    juce::Image cloudImage{juce::Image::ARGB, cloudImageWidth, VisFrame::numPitchBins, true};
+    uint64_t lastFrameSequence = 0;
+    bool hasReceivedFrames = false;
+    double lastFrameTimespan = 0.02;
+    static constexpr int numSpatialBins = VisFrame::numAzimuthBins * VisFrame::numElevationBins;
+    // spatial bins fainter than this aren't drawn
+    static constexpr float visibleFade = 0.01f;
+    std::array<float, numSpatialBins> spatialfades{};
+    float lastCompensationGain = -1.0f;
     HammerAitovGrid haGrid;
     struct ParamEvent
     {
@@ -17,7 +28,6 @@ class DashBoardComponent : public juce::Component
     std::vector<ParamEvent> paramValuesHistory;
     juce::Path paramHistoryPath;
     double timespantoshow = 8.0;
-    int throttlecounter = 0;
     float visualfadecoefficient = 1.0;
     bool showModulatorValues = false;
 
@@ -39,20 +49,9 @@ class DashBoardComponent : public juce::Component
             visualfadecoefficient = 0.93;
         //else
         //    visualfadecoefficient = std::pow(0.93, 4);
-        persisted_events.reserve(4096);
         paramValuesHistory.reserve(1024);
         vblankAttachment = std::make_unique<juce::VBlankAttachment>(this, [this]() {
-            updateGrainData();
-            if (is_debug())
-            {
-                if (throttlecounter % 1 == 0)
-                    repaint();
-                ++throttlecounter;
-            }
-            else
-            {
-                repaint();
-            }
+            repaintDirtyAreas(updateGrainData());
         });
     }
     void paint(juce::Graphics &g) override;
@@ -97,18 +96,36 @@ class DashBoardComponent : public juce::Component
         menu.showMenuAsync(juce::PopupMenu::Options{});
     }
     void drawCPUGraph(juce::Graphics &g, double enginetime, juce::Rectangle<float> area);
-    void updateGrainData()
+    void addFrameToCloudImage(const VisFrame &frame);
+    juce::Rectangle<float> getPolarArea() const;
+    juce::Rectangle<float> getPolarBinBounds(int bin) const;
+    // repaints the scrolling views and only those spatial bins whose drawing changed
+    void repaintDirtyAreas(const std::array<bool, numSpatialBins> &dirtybins);
+    // returns the spatial bins that need to be repainted
+    std::array<bool, numSpatialBins> updateGrainData()
     {
         timespantoshow = gr->gvsettings.timespantoshow;
-        ToneGranulator::GrainVisualizerMessage msg;
-        while (gr->visualizer_fifo.pop(msg))
+        std::array<bool, numSpatialBins> dirtybins{};
+        for (int i = 0; i < numSpatialBins; ++i)
         {
-            persisted_events.push_back(msg);
+            dirtybins[i] = spatialfades[i] > visibleFade;
+            spatialfades[i] *= visualfadecoefficient;
+        }
+        if (gr->visualizer_frames.fetch())
+        {
+            const auto &frame = gr->visualizer_frames.getReadBuffer();
+            addFrameToCloudImage(frame);
+            for (int i = 0; i < numSpatialBins; ++i)
+            {
+                float gain = std::min(frame.spatialgains[i], 1.0f);
+                if (gain > spatialfades[i])
+                {
+                    spatialfades[i] = gain;
+                    dirtybins[i] = dirtybins[i] || gain > visibleFade;
+                }
+            }
         }
         double enginetime = gr->playposframes / gr->m_sr;
-        std::erase_if(persisted_events, [this, enginetime](auto const &ev) {
-            return ev.timepos + ev.duration < enginetime - timespantoshow;
-        });
         auto cpuload = 0.0;
         if (GetCPULoad)
             cpuload = GetCPULoad();
@@ -116,6 +133,7 @@ class DashBoardComponent : public juce::Component
         std::erase_if(paramValuesHistory, [this, enginetime](auto const &ev) {
             return ev.timestamp < enginetime - timespantoshow;
         });
+        return dirtybins;
     }
 
     void resized() override